@@ -0,0 +1,10 @@
+// Runs the edit batch benchmark (.bench edits in game) without the game, printing its report.
+
+#include <iostream>
+
+#include "EditBatchBenchmark.h"
+
+int main() {
+	std::wcout << cubewg::BenchmarkEditBatch();
+	return 0;
+}
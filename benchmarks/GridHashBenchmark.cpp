@@ -0,0 +1,10 @@
+// Runs the grid hash benchmark (.bench hash in game) without the game, printing its report.
+
+#include <iostream>
+
+#include "GridHashBenchmark.h"
+
+int main() {
+	std::wcout << cubewg::BenchmarkGridHashes();
+	return 0;
+}
@@ -0,0 +1,76 @@
+// Profiles a stand-in for the zones lock (.locks in game) without the game: generation threads taking it at each site while a loader thread holds it in long bursts,
+// as streaming zones in does. Prints the summary .locks gives, and writes the histograms and the trace as .locks export and .profile trace do.
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "LockProfiler.h"
+
+namespace {
+	const int kGenerationThreads = 4;
+	const int kZonesPerThread = 500;
+
+	// stands in for the work done holding the lock
+	void Spin(int iterations) {
+		volatile int sum = 0;
+
+		for (int i = 0; i < iterations; i++) {
+			sum += i;
+		}
+	}
+}
+
+int main() {
+	using namespace cubewg;
+
+	// reentrant, as the zones critical section is
+	std::recursive_mutex zones;
+	std::atomic<bool> done(false);
+
+	std::thread loader([&zones, &done] {
+		while (!done) {
+			// the game's own loading isn't one of the mod's sites, so it isn't profiled
+			std::lock_guard<std::recursive_mutex> lock(zones);
+			Spin(20000);
+		}
+	});
+
+	std::vector<std::thread> generators;
+
+	for (int thread = 0; thread < kGenerationThreads; thread++) {
+		generators.emplace_back([&zones] {
+			for (int zone = 0; zone < kZonesPerThread; zone++) {
+				// a few writes to neighbours, each taking the lock once
+				const LockSite writes[3] = { LockSite::SET_BLOCK, LockSite::FILL_BOX, LockSite::COMMIT };
+
+				for (LockSite site : writes) {
+					ProfiledLock<std::recursive_mutex> lock(zones, site);
+					Spin(200);
+				}
+
+				const long long acquired = LockProfiler::Acquire(zones, LockSite::MARK_FOR_REMESH);
+				LockProfiler::Release(zones, LockSite::MARK_FOR_REMESH, acquired);
+			}
+		});
+	}
+
+	for (std::thread& generator : generators) {
+		generator.join();
+	}
+
+	done = true;
+	loader.join();
+
+	std::wcout << LockProfiler::Summarise(kGenerationThreads * kZonesPerThread);
+
+	if (!LockProfiler::WriteHistograms(L"cubewg-locks.csv") || !Profiler::WriteChromeTrace(L"cubewg-locks-trace.json")) {
+		std::wcout << L"Couldn't write cubewg-locks.csv and cubewg-locks-trace.json" << std::endl;
+		return 1;
+	}
+
+	std::wcout << L"Wrote cubewg-locks.csv and cubewg-locks-trace.json" << std::endl;
+	return 0;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+// The little of CWSDK that the parts of the mod built without the game use: vectors, blocks and zone coordinates.
+// Stands in for the real header in tests and benchmarks only. Matches its names and maths, not its layouts.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <set>
+
+template <typename T>
+struct Vector2 {
+	T x, y;
+
+	Vector2() : x(0), y(0) {
+	}
+
+	Vector2(T x, T y) : x(x), y(y) {
+	}
+
+	bool operator==(const Vector2& other) const {
+		return x == other.x && y == other.y;
+	}
+
+	bool operator!=(const Vector2& other) const {
+		return !(*this == other);
+	}
+};
+
+template <typename T>
+struct Vector3 {
+	T x, y, z;
+
+	Vector3() : x(0), y(0), z(0) {
+	}
+
+	Vector3(T x, T y, T z) : x(x), y(y), z(z) {
+	}
+
+	bool operator==(const Vector3& other) const {
+		return x == other.x && y == other.y && z == other.z;
+	}
+};
+
+typedef Vector2<int> IntVector2;
+typedef Vector3<int> IntVector3;
+typedef Vector2<long long> LongVector2;
+typedef Vector3<long long> LongVector3;
+
+namespace std {
+	template <>
+	struct hash<IntVector2> {
+		size_t operator()(const IntVector2& vector) const {
+			return std::hash<uint64_t>()((uint64_t)(uint32_t)vector.x | ((uint64_t)(uint32_t)vector.y << 32));
+		}
+	};
+}
+
+// division and modulo rounding towards negative infinity, as CWSDK's
+inline long long pydiv(long long a, long long b) {
+	long long quotient = a / b;
+	if (a % b != 0 && (a < 0) != (b < 0)) quotient--;
+	return quotient;
+}
+
+inline long long pymod(long long a, long long b) {
+	long long remainder = a % b;
+	if (remainder != 0 && (remainder < 0) != (b < 0)) remainder += b;
+	return remainder;
+}
+
+namespace cube {
+	const int BLOCKS_PER_ZONE = 64;
+
+	class Block {
+	public:
+		enum Type : char {
+			Air = 0,
+			Solid = 1,
+			Water = 2,
+			Wet = 3,
+			Ground = 4,
+			Lava = 5,
+			Tree = 6,
+			Leaves = 7
+		};
+
+		unsigned char red, green, blue;
+		Type type;
+		bool breakable;
+	};
+
+	class Zone {
+	public:
+		static IntVector2 ZoneCoordsFromBlocks(long long x, long long y) {
+			return IntVector2((int)pydiv(x, BLOCKS_PER_ZONE), (int)pydiv(y, BLOCKS_PER_ZONE));
+		}
+	};
+}
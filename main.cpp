@@ -4,6 +4,13 @@
 #include "src/WorldRegion.h"
 #include "src/JitteredGrid.h"
 #include "src/City.h"
+#include "src/Benchmarks.h"
+#include "src/Kernels.h"
+#include "src/RemeshQueue.h"
+#include "src/BufferJournal.h"
+#include "src/ZoneDeltaCache.h"
+#include "src/Profiler.h"
+#include "src/LockProfiler.h"
 #include "src/hooks/WorldGenHooks.h"
 
 #define LF L"\n";
@@ -15,6 +22,10 @@ namespace cubewg {
 	/* Mod class containing all the functions for the mod.
 	*/
 	class WorldGenMod : GenericMod {
+		City* city = nullptr;
+		// zones changed by generation, remeshed a few each tick
+		RemeshQueue remesh_queue;
+
 		static LongVector3 BlockFromDots(LongVector3 dots) {
 			return LongVector3
 			(
@@ -83,12 +94,8 @@ namespace cubewg {
 					std::wstring w = std::to_wstring(chunks_to_remesh.size()) + LF;
 					cube::GetGame()->PrintMessage((L"Remeshing N Chunks: " + w).c_str());
 
-					std::set<cube::Zone*>::iterator itr;
-
-					for (itr = chunks_to_remesh.begin(); itr != chunks_to_remesh.end(); itr++) {
-						cube::Zone* zone = *itr;
-						zone->chunk.Remesh();
-					}
+					LongVector2 player_zone = ZoneFromBlock(playerPos);
+					remesh_queue.Add(cube::GetGame()->world, IntVector2(player_zone.x, player_zone.y), kRemeshCommandRadius, chunks_to_remesh);
 
 					return 1;
 				}
@@ -113,6 +120,193 @@ namespace cubewg {
 					+ L", OF: " + std::to_wstring(height_ocean_floor) + L")" + LF;
 				cube::GetGame()->PrintMessage(feedback.c_str());
 
+				return 1;
+			} else if (message->substr(0, 7) == L".bench ") {
+				std::wstring report;
+
+				if (RunBenchmark(message->substr(7), *city, report)) {
+					cube::GetGame()->PrintMessage(report.c_str());
+				} else {
+					cube::GetGame()->PrintMessage((L"Unknown Benchmark " + message->substr(7) + L"\n").c_str());
+				}
+
+				return 1;
+			} else if (*message == L".kernels") {
+				cube::GetGame()->PrintMessage(DescribeKernels().c_str());
+
+				return 1;
+			} else if (message->substr(0, 9) == L".kernels ") {
+				KernelIsa isa;
+
+				if (!ParseKernelIsa(message->substr(9), isa)) {
+					cube::GetGame()->PrintMessage((L"Unknown Instruction Set " + message->substr(9) + L"\n").c_str());
+				} else if (ForceKernels(isa)) {
+					cube::GetGame()->PrintMessage((L"Now using " + std::wstring(GetKernelIsaName(isa)) + L" kernels\n").c_str());
+				} else {
+					cube::GetGame()->PrintMessage((std::wstring(GetKernelIsaName(isa)) + L" kernels are unsupported or failed the self-check\n").c_str());
+				}
+
+				return 1;
+			} else if (*message == L".culling") {
+				std::wstring feedback = L"Structures culled before generating: " + std::to_wstring(WorldRegion::GetStructuresCulled())
+					+ L" of " + std::to_wstring(WorldRegion::GetStructureChecks()) + L" zone checks" + LF;
+				cube::GetGame()->PrintMessage(feedback.c_str());
+
+				return 1;
+			} else if (*message == L".remesh") {
+				std::wstring feedback = L"Remesh queue: " + std::to_wstring(remesh_queue.GetPending()) + L" zones waiting, "
+					+ std::to_wstring(remesh_queue.GetRemeshed()) + L" remeshed of " + std::to_wstring(remesh_queue.GetQueued()) + L" queued (duplicates merged)" + LF;
+				cube::GetGame()->PrintMessage(feedback.c_str());
+
+				return 1;
+			} else if (*message == L".journal") {
+				BufferJournal* journal = WorldRegion::GetBufferJournal();
+
+				if (!journal->IsOpen()) {
+					cube::GetGame()->PrintMessage(L"Buffer journal could not be opened; buffers are dropped when their zone unloads\n");
+					return 1;
+				}
+
+				std::wstring feedback = L"Buffer journal: " + std::to_wstring(journal->GetPendingEntries()) + L" buffers ("
+					+ std::to_wstring(journal->GetPendingBytes() / 1024) + L" KB) waiting in " + std::to_wstring(journal->GetMappedBytes() / 1024) + L" KB mapped, "
+					+ std::to_wstring(journal->GetEntriesReplayed()) + L" of " + std::to_wstring(journal->GetEntriesWritten()) + L" replayed, "
+					+ std::to_wstring(journal->GetCompactions()) + L" compactions" + LF;
+				cube::GetGame()->PrintMessage(feedback.c_str());
+
+				return 1;
+			} else if (*message == L".deltas") {
+				ZoneDeltaCache* deltas = WorldRegion::GetDeltaCache();
+				const long long hits = deltas->GetHits();
+				const long long lookups = hits + deltas->GetMisses();
+				const long long recorded = deltas->GetDeltasRecorded();
+
+				std::wstring feedback = L"Zone deltas: " + std::to_wstring(hits) + L" of " + std::to_wstring(lookups) + L" zones replayed ("
+					+ std::to_wstring(lookups ? hits * 100 / lookups : 0) + L"%, " + std::to_wstring(deltas->GetDiskHits()) + L" from disk), "
+					+ std::to_wstring(recorded ? deltas->GetBytesRecorded() / recorded : 0) + L" bytes per zone" + LF;
+				cube::GetGame()->PrintMessage(feedback.c_str());
+
+				feedback = L"Held: " + std::to_wstring(deltas->GetMemoryEntries()) + L" zones (" + std::to_wstring(deltas->GetMemoryBytes() / 1024) + L" KB) in memory, "
+					+ std::to_wstring(deltas->GetDiskEntries()) + L" zones (" + std::to_wstring(deltas->GetDiskBytes() / 1024) + L" KB) on disk" + LF;
+				cube::GetGame()->PrintMessage(feedback.c_str());
+
+				if (WorldRegion::IsVerifyingDeltas() || WorldRegion::GetDeltasVerified() > 0) {
+					feedback = L"Verified: " + std::to_wstring(WorldRegion::GetDeltaMismatches()) + L" of " + std::to_wstring(WorldRegion::GetDeltasVerified())
+						+ L" deltas didn't replay as generated" + LF;
+					cube::GetGame()->PrintMessage(feedback.c_str());
+				}
+
+				return 1;
+			} else if (*message == L".deltas verify") {
+				// every delta recorded from now is replayed and compared with what generating did, until toggled off
+				WorldRegion::SetVerifyDeltas(!WorldRegion::IsVerifyingDeltas());
+				cube::GetGame()->PrintMessage(WorldRegion::IsVerifyingDeltas() ? L"Verifying zone deltas\n" : L"Not verifying zone deltas\n");
+
+				return 1;
+			} else if (*message == L".wgmem") {
+				const BufferMemory memory = WorldRegion::GetBufferMemory();
+
+				std::wstring feedback = L"Buffers: " + std::to_wstring(memory.bytes / 1024) + L" KB of " + std::to_wstring(memory.budget / 1024) + L" KB budget ("
+					+ std::to_wstring(memory.free_bytes / 1024) + L" KB freed and pooled), " + std::to_wstring(memory.blocks) + L" blocks in " + std::to_wstring(memory.buffers) + L" buffers from " + std::to_wstring(memory.owners) + L" zones" + LF;
+				cube::GetGame()->PrintMessage(feedback.c_str());
+
+				feedback = L"Peak: " + std::to_wstring(memory.peak_bytes / 1024) + L" KB, " + std::to_wstring(memory.peak_buffers) + L" buffers from " + std::to_wstring(memory.peak_owners) + L" zones" + LF;
+				cube::GetGame()->PrintMessage(feedback.c_str());
+
+				feedback = L"Evicted (" + std::wstring(memory.eviction == BufferEviction::FARTHEST ? L"farthest" : L"oldest") + L" first): "
+					+ std::to_wstring(memory.owners_evicted) + L" zones, " + std::to_wstring(memory.bytes_evicted / 1024) + L" KB, "
+					+ std::to_wstring(memory.owners_dropped) + L" zones lost as the journal wasn't open" + LF;
+				cube::GetGame()->PrintMessage(feedback.c_str());
+
+				return 1;
+			} else if (message->substr(0, 7) == L".wgmem ") {
+				// .wgmem <budget in MB> [oldest|farthest]
+				std::wistringstream arguments(message->substr(7));
+				size_t megabytes;
+				std::wstring eviction = L"oldest";
+
+				const bool has_budget = (bool)(arguments >> megabytes);
+				arguments >> eviction;
+
+				if (!has_budget || (eviction != L"oldest" && eviction != L"farthest")) {
+					cube::GetGame()->PrintMessage(L"Usage: .wgmem <budget in MB> [oldest|farthest]\n");
+				} else {
+					WorldRegion::SetBufferBudget(megabytes * 1024 * 1024, eviction == L"farthest" ? BufferEviction::FARTHEST : BufferEviction::OLDEST);
+					cube::GetGame()->PrintMessage((L"Buffer budget is now " + std::to_wstring(megabytes) + L" MB, evicting " + eviction + L" first\n").c_str());
+				}
+
+				return 1;
+			} else if (*message == L".profile") {
+				std::wstring summary = Profiler::Summarise();
+
+				if (!CUBEWG_PROFILE) {
+					cube::GetGame()->PrintMessage(L"Profiling was compiled out (CUBEWG_PROFILE is 0)\n");
+				} else if (summary.empty()) {
+					cube::GetGame()->PrintMessage(L"Nothing profiled yet\n");
+				} else {
+					cube::GetGame()->PrintMessage(summary.c_str());
+				}
+
+				return 1;
+			} else if (*message == L".profile trace") {
+				// next to the buffer journal, one per game process
+				wchar_t temp_path[MAX_PATH + 1];
+				const DWORD length = GetTempPathW(MAX_PATH + 1, temp_path);
+				const std::wstring path = std::wstring(length > 0 && length <= MAX_PATH ? temp_path : L"") + L"cubewg-trace-" + std::to_wstring(GetCurrentProcessId()) + L".json";
+
+				if (Profiler::WriteChromeTrace(path)) {
+					cube::GetGame()->PrintMessage((L"Wrote trace to " + path + L", open it in chrome://tracing or ui.perfetto.dev\n").c_str());
+				} else {
+					cube::GetGame()->PrintMessage((L"Couldn't write trace to " + path + L"\n").c_str());
+				}
+
+				return 1;
+			} else if (*message == L".profile reset") {
+				Profiler::Reset();
+				cube::GetGame()->PrintMessage(L"Profile cleared\n");
+
+				return 1;
+			} else if (*message == L".profile on" || *message == L".profile off") {
+				Profiler::SetEnabled(*message == L".profile on");
+				cube::GetGame()->PrintMessage(Profiler::IsEnabled() ? L"Profiling on\n" : L"Profiling off\n");
+
+				return 1;
+			} else if (*message == L".locks") {
+				std::wstring summary = LockProfiler::Summarise(WorldRegion::GetAllocations().zones);
+
+				if (!CUBEWG_PROFILE) {
+					cube::GetGame()->PrintMessage(L"Profiling was compiled out (CUBEWG_PROFILE is 0)\n");
+				} else if (summary.empty()) {
+					cube::GetGame()->PrintMessage(L"The zones lock hasn't been taken yet\n");
+				} else {
+					cube::GetGame()->PrintMessage((L"Zones lock, by where it was taken:\n" + summary).c_str());
+				}
+
+				return 1;
+			} else if (*message == L".locks export") {
+				wchar_t temp_path[MAX_PATH + 1];
+				const DWORD length = GetTempPathW(MAX_PATH + 1, temp_path);
+				const std::wstring path = std::wstring(length > 0 && length <= MAX_PATH ? temp_path : L"") + L"cubewg-locks-" + std::to_wstring(GetCurrentProcessId()) + L".csv";
+
+				if (LockProfiler::WriteHistograms(path)) {
+					cube::GetGame()->PrintMessage((L"Wrote lock histograms to " + path + L"\n").c_str());
+				} else {
+					cube::GetGame()->PrintMessage((L"Couldn't write lock histograms to " + path + L"\n").c_str());
+				}
+
+				return 1;
+			} else if (*message == L".locks reset") {
+				LockProfiler::Reset();
+				cube::GetGame()->PrintMessage(L"Lock profile cleared\n");
+
+				return 1;
+			} else if (*message == L".gridcache") {
+				JitteredPointCache* cache = city->GetGridCache();
+
+				std::wstring feedback = L"City grid cache (" + std::to_wstring(cache->GetCapacity()) + L" slots): "
+					+ std::to_wstring(cache->GetHits()) + L" hits, "
+					+ std::to_wstring(cache->GetMisses()) + L" misses" + LF;
+				cube::GetGame()->PrintMessage(feedback.c_str());
+
 				return 1;
 			} else if (allpos || message->substr(0, 5) == L".pos ") {
 				cube::Creature* player = cube::GetGame()->GetPlayer();
@@ -166,7 +360,13 @@ namespace cubewg {
 		 * @return	{void}
 		*/
 		virtual void OnGameTick(cube::Game* game) override {
-			return;
+			cube::Creature* player = game->GetPlayer();
+
+			if (!player) return;
+
+			LongVector2 player_zone = ZoneFromBlock(BlockFromDots(player->entity_data.position));
+			WorldRegion::SetPlayerZone(IntVector2(player_zone.x, player_zone.y));
+			remesh_queue.Drain(game->world, IntVector2(player_zone.x, player_zone.y), std::chrono::microseconds(kRemeshTickBudgetMicros));
 		}
 
 		/* Function hook that gets called on intialization of cubeworld.
@@ -174,11 +374,14 @@ namespace cubewg {
 		 * @return	{void}
 		*/
 		virtual void Initialize() override {
+			// before anything samples a grid
+			InitKernels();
+
 			SetupOverwriteWorldgen();
 
 			WorldRegion::Initialise();
 
-			City* city = new City;
+			city = new City;
 			WorldRegion::AddStructure(L"city", city);
 
 			return;
@@ -188,15 +391,13 @@ namespace cubewg {
 		*/
 		virtual void OnZoneGenerated(cube::Zone* zone) override {
 			if (1) return;
-			WorldRegion region = WorldRegion(zone);
+			WorldRegion region(zone);
 
 			std::set<cube::Zone*> to_remesh;
 
 			WorldRegion::GenerateInZone(zone, to_remesh);
-
-			for (cube::Zone* zone : to_remesh) {
-				zone->chunk.Remesh();
-			}
+			// a zone's generation only reaches its neighbours
+			remesh_queue.Add(zone->world, zone->position, 1, to_remesh);
 
 			/*for (int x = 0; x < 64; x++) {
 				for (int y = 0; y < 64; y++) {
@@ -209,6 +410,7 @@ namespace cubewg {
 		}
 
 		virtual void OnZoneDestroy(cube::Zone* zone) override {
+			remesh_queue.Remove(zone->position);
 			WorldRegion::CleanUpBuffers(zone->position);
 		}
 	};
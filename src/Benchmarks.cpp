@@ -0,0 +1,527 @@
+#include "Benchmarks.h"
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "CubeBuffer.h"
+#include "EditBatch.h"
+#include "GridHashBenchmark.h"
+#include "HeightmapCache.h"
+#include "Kernels.h"
+#include "MemoryPool.h"
+#include "WorldRegion.h"
+
+// kernel benchmark: runs the length of a tile column, as the tile sampler does
+const int kKernelRunLength = 64;
+const int kKernelRuns = 1 << 16;
+
+template <typename Kernel>
+static double KernelThroughput(Kernel kernel) {
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < kKernelRuns; i++) {
+		kernel(i);
+	}
+
+	auto end = std::chrono::steady_clock::now();
+	return (double)kKernelRuns * kKernelRunLength / std::chrono::duration<double>(end - start).count();
+}
+
+std::wstring cubewg::BenchmarkKernels() {
+	std::wstring report;
+
+	for (int isa = 0; isa < kKernelIsaCount; isa++) {
+		const KernelTable* kernels = GetKernelTable((KernelIsa)isa);
+
+		if (!kernels) {
+			report += std::wstring(GetKernelIsaName((KernelIsa)isa)) + L": not supported\n";
+			continue;
+		}
+
+		double ys[kKernelRunLength];
+		double dists[kKernelRunLength];
+		double dists_2[kKernelRunLength];
+
+		for (int i = 0; i < kKernelRunLength; i++) {
+			ys[i] = i / (double)kKernelRunLength;
+			dists[i] = dists_2[i] = 1000.0;
+		}
+
+		const double nearest = KernelThroughput([&](int i) { kernels->nearest_run((i & 7) * 0.25, (i & 3) * 0.5, ys, kKernelRunLength, dists); });
+		const double worley = KernelThroughput([&](int i) { kernels->worley_run((i & 7) * 0.25, (i & 3) * 0.5, ys, kKernelRunLength, dists, dists_2); });
+		const double legacy = KernelThroughput([&](int i) { kernels->legacy_doubles(0, i, 0, kKernelRunLength, dists_2); });
+		const double counter = KernelThroughput([&](int i) { kernels->counter_doubles(0, i, 0, kKernelRunLength, dists_2); });
+
+		// the sink is printed so the timed loops can't be optimised out
+		report += std::wstring(GetKernelIsaName((KernelIsa)isa)) + L": nearest " + std::to_wstring((long long)nearest) + L"/s"
+			+ L", worley " + std::to_wstring((long long)worley) + L"/s"
+			+ L", legacy hash " + std::to_wstring((long long)legacy) + L"/s"
+			+ L", counter hash " + std::to_wstring((long long)counter) + L"/s"
+			+ L" (sink " + std::to_wstring(dists[0] + dists_2[kKernelRunLength - 1]) + L")"
+			+ (kernels == &GetKernels() ? L", in use\n" : L"\n");
+	}
+
+	return report;
+}
+
+// city benchmark: a square of zones wide enough to hold several cities, and the empty land between them
+const int kCityBenchmarkZones = 128;
+// as City's own grid has
+const int kCityBenchmarkGridCacheSlots = 256;
+
+// Synthetic terrain standing in for a zone's fields in the city benchmark: the base z of each column, indexed as zone->fields.
+static void FillCityBenchmarkTerrain(const IntVector2& zone_position, int* base_zs) {
+	for (int x = 0; x < cube::BLOCKS_PER_ZONE; x++) {
+		for (int y = 0; y < cube::BLOCKS_PER_ZONE; y++) {
+			const int world_x = zone_position.x * cube::BLOCKS_PER_ZONE + x;
+			const int world_y = zone_position.y * cube::BLOCKS_PER_ZONE + y;
+			base_zs[x * cube::BLOCKS_PER_ZONE + y] = ((world_x * 7 + world_y * 13) & 31) - 4;
+		}
+	}
+}
+
+// The city stages as they were before the scratch tile, kept as the benchmark's baseline: the zone's distances sampled into a tile, one pass flattening every column,
+// then a second testing every column's distance again for walls and pavement, and the building test sampling the grid once more.
+// Works on synthetic terrain rather than a zone, so junk isn't removed, and adds up the heights it would build walls and pavement at rather than building. Buildings are counted apart,
+// as lots now follow the plan of the zone's city (see CityPlan::lots), which differs from the old test where cities overlap. Returns false if no city reaches the zone.
+static bool WalkCityTwoPass(cubewg::CitiesGrid& grid, const cubewg::CityPlan& radii, const IntVector2& zone_position, int* base_zs, double* sqr_dists, long long& sink, int& buildings) {
+	const double zone_min_x = zone_position.x * cube::BLOCKS_PER_ZONE;
+	const double zone_min_y = zone_position.y * cube::BLOCKS_PER_ZONE;
+
+	if (grid.PointsInRect(zone_min_x, zone_min_y, zone_min_x + cube::BLOCKS_PER_ZONE - 1, zone_min_y + cube::BLOCKS_PER_ZONE - 1, radii.shape_radius + 1, [](const cubewg::JitteredPoint&, int64_t, int64_t) {}) == 0) {
+		return false;
+	}
+
+	cubewg::JitteredPoint centre = grid.FindNearestPoint(zone_min_x, zone_min_y);
+	const int flattened_height = (int)cube::GetGame()->world->GetZoneStructureHeight(centre.x / cube::BLOCKS_PER_ZONE, centre.y / cube::BLOCKS_PER_ZONE);
+	const double sqr_border_radius = radii.border_radius * radii.border_radius;
+	const double sqr_wall_radius = radii.wall_radius * radii.wall_radius;
+	const double sqr_shape_radius = radii.shape_radius * radii.shape_radius;
+
+	grid.SqrDist2NearestTile(zone_min_x, zone_min_y, cube::BLOCKS_PER_ZONE, cube::BLOCKS_PER_ZONE, sqr_dists);
+
+	// flatten terrain
+	for (int i = 0; i < cube::BLOCKS_PER_ZONE * cube::BLOCKS_PER_ZONE; i++) {
+		if (sqr_dists[i] < sqr_wall_radius) {
+			base_zs[i] = flattened_height;
+		} else if (sqr_dists[i] < sqr_shape_radius) {
+			float prog = sqrtf((sqr_dists[i] - sqr_wall_radius) / (sqr_shape_radius - sqr_wall_radius));
+			base_zs[i] = (int)(flattened_height + prog * (base_zs[i] - flattened_height));
+		}
+	}
+
+	// walls and pavement
+	for (int i = 0; i < cube::BLOCKS_PER_ZONE * cube::BLOCKS_PER_ZONE; i++) {
+		const double sqr_dist = sqr_dists[i];
+
+		if (sqr_dist <= sqr_wall_radius && sqr_dist >= sqr_border_radius) {
+			const bool walkway = sqr_dist <= radii.walkway_outer_radius * radii.walkway_outer_radius && sqr_dist >= radii.walkway_inner_radius * radii.walkway_inner_radius;
+			sink += base_zs[i] + (walkway ? 11 : 14);
+		} else if (sqr_dist < sqr_border_radius) {
+			sink += base_zs[i];
+		}
+	}
+
+	// buildings
+	if (grid.SqrDist2Nearest(zone_min_x + 32, zone_min_y + 32) < radii.building_radius * radii.building_radius) {
+		buildings++;
+	}
+
+	return true;
+}
+
+// The city stages as City::Generate runs them, on the same synthetic terrain: planned into the tile, then one pass over the columns the city covers.
+static bool WalkCityTile(cubewg::City& planner, cubewg::CityTile& tile, const IntVector2& zone_position, int* base_zs, long long& sink, int& buildings) {
+	if (!planner.PlanZone(zone_position, tile)) {
+		return false;
+	}
+
+	const cubewg::CityPlan& plan = *tile.plan;
+	const double sqr_wall_radius = plan.wall_radius * plan.wall_radius;
+	const double sqr_shape_radius = plan.shape_radius * plan.shape_radius;
+
+	for (const cubewg::FootprintSpan& span : tile.spans) {
+		for (int y = span.min_y; y <= span.max_y; y++) {
+			const int i = span.x * cube::BLOCKS_PER_ZONE + y;
+			const cubewg::CityRing ring = tile.rings[i];
+
+			if (ring == cubewg::CityRing::OUTSIDE) continue;
+
+			if (ring != cubewg::CityRing::BLEND) {
+				base_zs[i] = plan.flattened_height;
+			} else {
+				float prog = sqrtf((tile.sqr_dists[i] - sqr_wall_radius) / (sqr_shape_radius - sqr_wall_radius));
+				base_zs[i] = (int)(plan.flattened_height + prog * (base_zs[i] - plan.flattened_height));
+			}
+
+			if (ring == cubewg::CityRing::BORDER || ring == cubewg::CityRing::WALL) {
+				sink += base_zs[i] + (ring == cubewg::CityRing::WALL ? 11 : 14);
+			} else if (ring == cubewg::CityRing::PLAZA) {
+				sink += base_zs[i];
+			}
+		}
+	}
+
+	if (plan.HasLot(zone_position)) {
+		buildings++;
+	}
+
+	return true;
+}
+
+std::wstring cubewg::BenchmarkCity(City& city) {
+	// Plans through a city of its own, so the plans it makes don't push the live city's out of its cache, and its grid cache starts cold every run. So does the baseline's grid.
+	std::unique_ptr<City> planner = std::make_unique<City>();
+	CitiesGrid baseline_grid(0);
+	baseline_grid.EnableCache(kCityBenchmarkGridCacheSlots);
+	// the radii are the same for every city
+	const std::shared_ptr<const CityPlan> radii = planner->GetPlan(IntVector2(0, 0));
+	// reused the way City::Generate reuses its tile
+	std::unique_ptr<CityTile> tile = std::make_unique<CityTile>();
+	std::vector<int> base_zs(CityTile::kSize);
+	std::vector<double> sqr_dists(CityTile::kSize);
+	int planned = 0;
+	int baseline_planned = 0;
+	long long sink = 0;
+	long long baseline_sink = 0;
+	int buildings = 0;
+	int baseline_buildings = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int x = 0; x < kCityBenchmarkZones; x++) {
+		for (int y = 0; y < kCityBenchmarkZones; y++) {
+			FillCityBenchmarkTerrain(IntVector2(x, y), base_zs.data());
+
+			if (WalkCityTwoPass(baseline_grid, *radii, IntVector2(x, y), base_zs.data(), sqr_dists.data(), baseline_sink, baseline_buildings)) {
+				baseline_planned++;
+			}
+		}
+	}
+
+	auto middle = std::chrono::steady_clock::now();
+
+	for (int x = 0; x < kCityBenchmarkZones; x++) {
+		for (int y = 0; y < kCityBenchmarkZones; y++) {
+			FillCityBenchmarkTerrain(IntVector2(x, y), base_zs.data());
+
+			if (WalkCityTile(*planner, *tile, IntVector2(x, y), base_zs.data(), sink, buildings)) {
+				planned++;
+			}
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+	const double baseline_seconds = std::chrono::duration<double>(middle - start).count();
+	const double seconds = std::chrono::duration<double>(end - middle).count();
+	const int zones = kCityBenchmarkZones * kCityBenchmarkZones;
+
+	std::wstring report = L"city stages: two passes " + std::to_wstring((long long)(zones / baseline_seconds)) + L" zones/s, one pass over the tile "
+		+ std::to_wstring((long long)(zones / seconds)) + L" zones/s ("
+		+ std::to_wstring(planned) + L" of " + std::to_wstring(zones) + L" zones near a city, "
+		+ std::to_wstring(buildings) + L" buildings (" + std::to_wstring(baseline_buildings) + L" by the old test), "
+		+ std::to_wstring(planner->GetCachedPlans()) + L" city plans cached"
+		+ (sink == baseline_sink && planned == baseline_planned ? L")\n" : L", the two built differently)\n");
+
+	const long long generated = city.GetZonesGenerated();
+
+	if (generated == 0) {
+		return report + L"generation: no zones generated yet\n";
+	}
+
+	return report + L"generation: " + std::to_wstring((long long)(generated / (city.GetGenerateNanos() * 1e-9))) + L" zones/s over "
+		+ std::to_wstring(generated) + L" zones generated in game\n";
+}
+
+// cube buffer benchmark: a city centred this far outside the buffered zone, so its wall and the edge of its plaza cross it
+const int kBufferCityOffset = -250;
+const int kBufferWallHeight = 14;
+
+// Counts the bytes allocated through it, for measuring standard containers.
+template <typename T>
+struct CountingAllocator {
+	typedef T value_type;
+
+	size_t* bytes;
+
+	CountingAllocator(size_t* bytes) : bytes(bytes) {
+	}
+
+	template <typename U>
+	CountingAllocator(const CountingAllocator<U>& other) : bytes(other.bytes) {
+	}
+
+	T* allocate(size_t n) {
+		*bytes += n * sizeof(T);
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T* p, size_t n) {
+		*bytes -= n * sizeof(T);
+		std::allocator<T>().deallocate(p, n);
+	}
+
+	template <typename U>
+	bool operator==(const CountingAllocator<U>& other) const {
+		return bytes == other.bytes;
+	}
+
+	template <typename U>
+	bool operator!=(const CountingAllocator<U>& other) const {
+		return bytes != other.bytes;
+	}
+};
+
+std::wstring cubewg::BenchmarkCubeBuffers() {
+	typedef std::pair<const IntVector3, cube::Block> Entry;
+	size_t map_bytes = 0;
+	std::unordered_map<IntVector3, cube::Block, std::hash<IntVector3>, std::equal_to<IntVector3>, CountingAllocator<Entry>> map(0, std::hash<IntVector3>(), std::equal_to<IntVector3>(), CountingAllocator<Entry>(&map_bytes));
+	CubeBuffer buffer;
+
+	const cube::Block wall = BlockOf(130, 150, 160);
+	const cube::Block pavement = BlockOf(90, 90, 90, cube::Block::Ground);
+	const double sqr_border_radius = 282.0 * 282.0;
+	const double sqr_wall_radius = 318.0 * 318.0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int x = 0; x < cube::BLOCKS_PER_ZONE; x++) {
+		for (int y = 0; y < cube::BLOCKS_PER_ZONE; y++) {
+			const double dx = x - kBufferCityOffset;
+			const double dy = y - cube::BLOCKS_PER_ZONE / 2;
+			const double sqr_dist = dx * dx + dy * dy;
+			// uneven ground, as the blocks are placed on the terrain
+			const int base_z = 30 + (x * 7 + y * 3) % 4;
+
+			if (sqr_dist < sqr_border_radius) {
+				map[IntVector3(x, y, base_z)] = pavement;
+				buffer.Set(IntVector3(x, y, base_z), pavement);
+			} else if (sqr_dist <= sqr_wall_radius) {
+				// block by block, as the wall used to be built
+				for (int z = base_z; z < base_z + kBufferWallHeight; z++) {
+					map[IntVector3(x, y, z)] = wall;
+					buffer.Set(IntVector3(x, y, z), wall);
+				}
+			}
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(end - start).count();
+	const size_t blocks = buffer.GetBlockCount();
+
+	if (blocks == 0 || blocks != map.size()) {
+		return L"cube buffers: buffered block counts disagree\n";
+	}
+
+	return L"cube buffers: " + std::to_wstring(blocks) + L" blocks, hash map " + std::to_wstring((double)(map_bytes + sizeof(map)) / blocks) + L" bytes/block"
+		+ L", paletted " + std::to_wstring((double)buffer.GetMemoryUsage() / blocks) + L" bytes/block"
+		+ L" (filled both in " + std::to_wstring((long long)(seconds * 1e6)) + L" us)\n";
+}
+
+// arena benchmark: zones generated, each with a new batch of trees
+const int kArenaZones = 50;
+
+// Takes memory from the heap, counting the allocations as a pool would.
+class CountingHeap : public cubewg::MemoryPool {
+public:
+	void* Allocate(size_t bytes) override {
+		allocations++;
+		heap_allocations++;
+		return ::operator new(bytes);
+	}
+
+	void Free(void* pointer, size_t bytes) override {
+		::operator delete(pointer);
+	}
+};
+
+// Builds a batch of trees for each zone from the pool, as a structure would while generating, and returns how long it took.
+// An arena is reset after each zone, as GenerateInZone does. Adds the allocations made, and how many needed the heap.
+static double GenerateTrees(cubewg::MemoryPool& pool, cubewg::Arena* arena, long long& allocations, long long& heap_allocations) {
+	auto start = std::chrono::steady_clock::now();
+
+	for (int zone = 0; zone < kArenaZones; zone++) {
+		{
+			cubewg::EditBatch edits(&pool);
+			WriteBenchmarkTrees(edits);
+			edits.GetBlockCount();
+		}
+
+		if (arena) {
+			allocations += arena->GetAllocations();
+			heap_allocations += arena->GetHeapAllocations();
+			arena->Reset();
+		}
+	}
+
+	if (!arena) {
+		allocations += pool.GetAllocations();
+		heap_allocations += pool.GetHeapAllocations();
+	}
+
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::wstring cubewg::BenchmarkArenas() {
+	CountingHeap heap;
+	Arena arena;
+	long long heap_allocations = 0;
+	long long arena_allocations = 0;
+	long long arena_heap_allocations = 0;
+	long long unused = 0;
+
+	const double heap_seconds = GenerateTrees(heap, nullptr, unused, heap_allocations);
+	// the first run grows the arena to fit a zone, as the first zones generated do
+	GenerateTrees(arena, &arena, unused, unused);
+	const double arena_seconds = GenerateTrees(arena, &arena, arena_allocations, arena_heap_allocations);
+
+	std::wstring report = L"tree batches: heap " + std::to_wstring((long long)(kArenaZones / heap_seconds)) + L" zones/s, "
+		+ std::to_wstring(heap_allocations / kArenaZones) + L" heap allocations/zone; arena "
+		+ std::to_wstring((long long)(kArenaZones / arena_seconds)) + L" zones/s, " + std::to_wstring(arena_allocations / kArenaZones) + L" allocations/zone, "
+		+ std::to_wstring(arena_heap_allocations) + L" heap allocations in " + std::to_wstring(kArenaZones) + L" zones\n";
+
+	const GenerationAllocations allocations = WorldRegion::GetAllocations();
+
+	if (allocations.zones == 0) {
+		return report + L"generation: no zones generated yet\n";
+	}
+
+	return report + L"generation: " + std::to_wstring(allocations.zones) + L" zones generated, per zone "
+		+ std::to_wstring((double)allocations.arena / allocations.zones) + L" arena allocations ("
+		+ std::to_wstring((double)allocations.arena_heap / allocations.zones) + L" from the heap), "
+		+ std::to_wstring((double)allocations.buffers / allocations.zones) + L" buffer allocations ("
+		+ std::to_wstring((double)allocations.buffers_heap / allocations.zones) + L" from the heap)\n";
+}
+
+// heightmap benchmark: times over every column of the zone for every heightmap
+const int kHeightmapRounds = 20;
+
+std::wstring cubewg::BenchmarkHeightmaps() {
+	cube::Game* game = cube::GetGame();
+	cube::Creature* player = game->GetPlayer();
+
+	if (!player) {
+		return L"heightmaps: no player\n";
+	}
+
+	const LongVector3 position = player->entity_data.position;
+	const IntVector2 zone_pos(
+		(int)pydiv(pydiv(position.x, cube::DOTS_PER_BLOCK), cube::BLOCKS_PER_ZONE),
+		(int)pydiv(pydiv(position.y, cube::DOTS_PER_BLOCK), cube::BLOCKS_PER_ZONE));
+
+	// held throughout, so the zone can't unload while it's measured
+	EnterCriticalSection(&game->world->zones_critical_section);
+	cube::Zone* zone = game->world->GetZone(zone_pos);
+
+	if (!zone) {
+		LeaveCriticalSection(&game->world->zones_critical_section);
+		return L"heightmaps: the zone you are in hasn't loaded\n";
+	}
+
+	// a tile of its own, so the cache in use isn't disturbed
+	std::unique_ptr<HeightmapTile> tile = std::make_unique<HeightmapTile>();
+	long long sink = 0;
+	int mismatches = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int round = 0; round < kHeightmapRounds; round++) {
+		tile->Fill(zone);
+	}
+
+	auto filled = std::chrono::steady_clock::now();
+
+	for (int round = 0; round < kHeightmapRounds; round++) {
+		for (int heightmap = 0; heightmap < kHeightmapCount; heightmap++) {
+			for (int x = 0; x < cube::BLOCKS_PER_ZONE; x++) {
+				for (int y = 0; y < cube::BLOCKS_PER_ZONE; y++) {
+					sink += HeightmapCache::ScanColumn(zone, x, y, (Heightmap)heightmap);
+				}
+			}
+		}
+	}
+
+	auto scanned = std::chrono::steady_clock::now();
+
+	// uncached, but through the column view rather than GetBlock
+	for (int round = 0; round < kHeightmapRounds; round++) {
+		for (int heightmap = 0; heightmap < kHeightmapCount; heightmap++) {
+			for (int i = 0; i < HeightmapTile::kSize; i++) {
+				int column[kHeightmapCount];
+				HeightmapCache::ComputeColumn(zone->fields[i], column);
+				sink += column[heightmap];
+			}
+		}
+	}
+
+	auto viewed = std::chrono::steady_clock::now();
+
+	for (int round = 0; round < kHeightmapRounds; round++) {
+		for (int heightmap = 0; heightmap < kHeightmapCount; heightmap++) {
+			for (int x = 0; x < cube::BLOCKS_PER_ZONE; x++) {
+				for (int y = 0; y < cube::BLOCKS_PER_ZONE; y++) {
+					sink += tile->Get(zone, x, y, (Heightmap)heightmap);
+				}
+			}
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	// the cached heights must be exactly what scanning the column gives
+	for (int heightmap = 0; heightmap < kHeightmapCount; heightmap++) {
+		for (int x = 0; x < cube::BLOCKS_PER_ZONE; x++) {
+			for (int y = 0; y < cube::BLOCKS_PER_ZONE; y++) {
+				if (tile->Get(zone, x, y, (Heightmap)heightmap) != HeightmapCache::ScanColumn(zone, x, y, (Heightmap)heightmap)) {
+					mismatches++;
+				}
+			}
+		}
+	}
+
+	LeaveCriticalSection(&game->world->zones_critical_section);
+
+	const double queries = (double)kHeightmapRounds * kHeightmapCount * HeightmapTile::kSize;
+	const double fill_seconds = std::chrono::duration<double>(filled - start).count();
+	const double scan_seconds = std::chrono::duration<double>(scanned - filled).count();
+	const double view_seconds = std::chrono::duration<double>(viewed - scanned).count();
+	const double cached_seconds = std::chrono::duration<double>(end - viewed).count();
+
+	return L"heightmaps: column scan " + std::to_wstring((long long)(queries / scan_seconds)) + L" queries/s, column view "
+		+ std::to_wstring((long long)(queries / view_seconds)) + L" queries/s, cached "
+		+ std::to_wstring((long long)(queries / cached_seconds)) + L" queries/s, filling a tile takes "
+		+ std::to_wstring(fill_seconds * 1e6 / kHeightmapRounds) + L" us (" + std::to_wstring(mismatches) + L" mismatches, sink "
+		+ std::to_wstring(sink) + L")\n";
+}
+
+bool cubewg::RunBenchmark(const std::wstring& name, City& city, std::wstring& report) {
+	if (name == L"hash") {
+		report = BenchmarkGridHashes();
+		return true;
+	} else if (name == L"kernels") {
+		report = BenchmarkKernels();
+		return true;
+	} else if (name == L"city") {
+		report = BenchmarkCity(city);
+		return true;
+	} else if (name == L"buffers") {
+		report = BenchmarkCubeBuffers();
+		return true;
+	} else if (name == L"edits") {
+		report = BenchmarkEditBatch();
+		return true;
+	} else if (name == L"heights") {
+		report = BenchmarkHeightmaps();
+		return true;
+	} else if (name == L"arena") {
+		report = BenchmarkArenas();
+		return true;
+		return true;
+	}
+
+	return false;
+}
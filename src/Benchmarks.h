@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+
+#include "City.h"
+#include "EditBatchBenchmark.h"
+#include "GridHashBenchmark.h"
+
+namespace cubewg {
+	/* Debug benchmarks, run in game through the .bench chat command.
+	 * Each returns a report to print in chat, one line per result.
+	 */
+
+	// BenchmarkGridHashes is in GridHashBenchmark.h, as it builds without the game.
+
+	/* Measures the throughput of each supported variant of the grid kernels (see Kernels.h), in positions or cells per second.
+	*/
+	std::wstring BenchmarkKernels();
+
+	/* Measures how many zones per second the city stages handle over zones near and far from cities, on synthetic terrain: planned into the tile and walked in one pass, as City::Generate does,
+	 * against the two passes over every column it used to make. Also reports how many zones per second the whole of City::Generate has handled in game so far.
+	 */
+	std::wstring BenchmarkCity(City& city);
+
+	/* Compares the bytes per block of CubeBuffer against a hash map of whole blocks (as buffers used to be), filled with the part of a city's wall and plaza which spills over a zone edge.
+	*/
+	std::wstring BenchmarkCubeBuffers();
+
+	// BenchmarkEditBatch is in EditBatchBenchmark.h, as it builds without the game.
+
+	/* Compares building a batch of trees for each of a run of zones with memory from the heap against memory from an arena reset after each zone, counting the heap allocations of each.
+	 * Then reports the allocations per zone generated in game so far, from arenas and from the pools holding neighbours' buffers.
+	 */
+	std::wstring BenchmarkArenas();
+
+	/* Compares how many height queries per second scanning the column through GetBlock handles (as GetHeight used to), reading it through a ColumnView, and the cached heightmaps, over the zone the player is in,
+	 * and checks the two agree on every column.
+	 */
+	std::wstring BenchmarkHeightmaps();
+
+	/* Runs the benchmark with the given name, writing its report into report. Returns false if there is no benchmark by that name.
+	 * Benchmarks of structures use the ones given, as they are in the world.
+	 */
+	bool RunBenchmark(const std::wstring& name, City& city, std::wstring& report);
+}
@@ -0,0 +1,218 @@
+#include "BufferJournal.h"
+
+#include <algorithm>
+#include <cstring>
+
+static size_t PadEntry(size_t bytes) {
+	return (bytes + cubewg::JournalEntry::kRunsAlignment - 1) & ~(cubewg::JournalEntry::kRunsAlignment - 1);
+}
+
+cubewg::BufferJournal::BufferJournal() : file(INVALID_HANDLE_VALUE), mapping(nullptr), view(nullptr), capacity(0), end(0), applied_bytes(0),
+	entries_written(0), entries_replayed(0), compactions(0) {
+}
+
+cubewg::BufferJournal::~BufferJournal() {
+	this->Unmap();
+
+	// deletes the file, as it was opened with FILE_FLAG_DELETE_ON_CLOSE
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+	}
+}
+
+bool cubewg::BufferJournal::Open(const std::wstring& path) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// temporary, so the system keeps it in memory if it can, rather than writing it out
+	file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	if (!this->Map(kInitialCapacity)) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+		return false;
+	}
+
+	return true;
+}
+
+bool cubewg::BufferJournal::IsOpen() const {
+	return view != nullptr;
+}
+
+bool cubewg::BufferJournal::Map(size_t new_capacity) {
+	this->Unmap();
+
+	// mapping past the end of the file grows it
+	mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)new_capacity >> 32), (DWORD)new_capacity, nullptr);
+
+	if (!mapping) return false;
+
+	view = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, new_capacity));
+
+	if (!view) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+		return false;
+	}
+
+	capacity = new_capacity;
+	return true;
+}
+
+void cubewg::BufferJournal::Unmap() {
+	if (view) {
+		UnmapViewOfFile(view);
+		view = nullptr;
+	}
+
+	if (mapping) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+}
+
+bool cubewg::BufferJournal::Write(const IntVector2& target, const CubeBuffer& blocks) {
+	size_t run_count, palette_size;
+	const CubeBuffer::Run* runs = blocks.GetRuns(run_count);
+	const cube::Block* palette = blocks.GetPalette(palette_size);
+
+	if (run_count == 0) return true;
+
+	JournalEntry::Header header;
+	header.state = kPending;
+	header.target_x = target.x;
+	header.target_y = target.y;
+	header.palette_size = (uint32_t)palette_size;
+	header.run_count = (uint32_t)run_count;
+
+	IntVector2 min, max;
+	blocks.GetBounds(min, max);
+	header.min_x = min.x;
+	header.min_y = min.y;
+	header.max_x = max.x;
+	header.max_y = max.y;
+
+	const size_t palette_bytes = PadEntry(palette_size * sizeof(cube::Block));
+	const size_t size = PadEntry(sizeof(JournalEntry::Header) + palette_bytes + run_count * sizeof(CubeBuffer::Run));
+	header.size = (uint32_t)size;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!view) return false;
+
+	if (end + size > capacity) {
+		// reclaim applied entries before growing the file, in case that makes room
+		if (applied_bytes > 0) {
+			this->Compact();
+		}
+
+		if (end + size > capacity) {
+			size_t new_capacity = capacity;
+
+			while (end + size > new_capacity) {
+				new_capacity *= 2;
+			}
+
+			if (!this->Map(new_capacity)) {
+				// keep what was written so far
+				if (!this->Map(capacity)) {
+					// can't happen unless the system is out of address space, in which case the pending entries are lost
+					pending.clear();
+					end = 0;
+					applied_bytes = 0;
+				}
+
+				return false;
+			}
+		}
+	}
+
+	char* entry = view + end;
+	std::memcpy(entry, &header, sizeof(header));
+	std::memcpy(entry + sizeof(header), palette, palette_size * sizeof(cube::Block));
+	std::memcpy(entry + sizeof(header) + palette_bytes, runs, run_count * sizeof(CubeBuffer::Run));
+
+	pending[target].push_back(end);
+	end += size;
+	entries_written++;
+	return true;
+}
+
+void cubewg::BufferJournal::Compact() {
+	// Entries only move down the file, so moving them in order never overwrites one not yet moved.
+	size_t read = 0;
+	size_t write = 0;
+
+	while (read < end) {
+		const JournalEntry::Header* header = reinterpret_cast<const JournalEntry::Header*>(view + read);
+		const size_t size = header->size;
+
+		if (header->state == kPending) {
+			if (write != read) {
+				std::memmove(view + write, view + read, size);
+			}
+
+			write += size;
+		}
+
+		read += size;
+	}
+
+	end = write;
+	applied_bytes = 0;
+	compactions++;
+
+	// every pending entry has moved, so find them again
+	pending.clear();
+
+	for (size_t offset = 0; offset < end;) {
+		const JournalEntry::Header* header = reinterpret_cast<const JournalEntry::Header*>(view + offset);
+		pending[IntVector2(header->target_x, header->target_y)].push_back(offset);
+		offset += header->size;
+	}
+}
+
+void cubewg::BufferJournal::Clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	pending.clear();
+	end = 0;
+	applied_bytes = 0;
+}
+
+size_t cubewg::BufferJournal::GetPendingEntries() {
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t entries = 0;
+
+	for (const auto& target : pending) {
+		entries += target.second.size();
+	}
+
+	return entries;
+}
+
+size_t cubewg::BufferJournal::GetPendingBytes() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return end - applied_bytes;
+}
+
+size_t cubewg::BufferJournal::GetMappedBytes() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return view ? capacity : 0;
+}
+
+long long cubewg::BufferJournal::GetEntriesWritten() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries_written;
+}
+
+long long cubewg::BufferJournal::GetEntriesReplayed() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries_replayed;
+}
+
+long long cubewg::BufferJournal::GetCompactions() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return compactions;
+}
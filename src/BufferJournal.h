@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cwsdk.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CubeBuffer.h"
+
+namespace cubewg {
+	/* One buffer written to the journal, read in place from the mapped file. Reads the same as the CubeBuffer it was written from.
+	*/
+	class JournalEntry {
+	public:
+		struct Header {
+			// the whole entry, padded to 8 bytes
+			uint32_t size;
+			uint32_t state;
+			int32_t target_x;
+			int32_t target_y;
+			// bounds of the runs in x and y, as CubeBuffer::GetBounds gives
+			int32_t min_x;
+			int32_t min_y;
+			int32_t max_x;
+			int32_t max_y;
+			uint32_t palette_size;
+			uint32_t run_count;
+		};
+
+		// the palette follows the header, then the runs
+		static const size_t kRunsAlignment = 8;
+	private:
+		const Header* header;
+	public:
+		explicit JournalEntry(const Header* header) : header(header) {
+		}
+
+		IntVector2 GetTarget() const {
+			return IntVector2(header->target_x, header->target_y);
+		}
+
+		const cube::Block* GetPalette() const {
+			return reinterpret_cast<const cube::Block*>(header + 1);
+		}
+
+		const CubeBuffer::Run* GetRuns() const {
+			const size_t palette_bytes = (header->palette_size * sizeof(cube::Block) + kRunsAlignment - 1) & ~(kRunsAlignment - 1);
+			return reinterpret_cast<const CubeBuffer::Run*>(reinterpret_cast<const char*>(header + 1) + palette_bytes);
+		}
+
+		/* Calls callback(x, y, min_z, max_z, block) for every run, as CubeBuffer::ForEachRun.
+		*/
+		template <typename Callback>
+		void ForEachRun(Callback callback) const {
+			const cube::Block* palette = this->GetPalette();
+			const CubeBuffer::Run* runs = this->GetRuns();
+
+			for (uint32_t i = 0; i < header->run_count; i++) {
+				const CubeBuffer::Run& run = runs[i];
+				callback(run.column / cube::BLOCKS_PER_ZONE, run.column % cube::BLOCKS_PER_ZONE, run.min_z, run.max_z, palette[run.block]);
+			}
+		}
+
+		bool GetBounds(IntVector2& min, IntVector2& max) const {
+			if (header->run_count == 0) return false;
+
+			min = IntVector2(header->min_x, header->min_y);
+			max = IntVector2(header->max_x, header->max_y);
+			return true;
+		}
+	};
+
+	/* Append-only file of buffers waiting for zones which haven't loaded, kept for the buffers' owners after they unload.
+	 * The file is mapped into memory, so entries are written and replayed in place without copying them into buffers again.
+	 * Replayed entries are marked applied, and their space is reclaimed by compacting once enough of the file is applied.
+	 * The file is only for this session: it is made afresh when opened and deleted when closed. Thread safe.
+	 */
+	class BufferJournal {
+	private:
+		enum State : uint32_t {
+			kPending = 1,
+			kApplied = 2
+		};
+
+		static const size_t kInitialCapacity = 4 * 1024 * 1024;
+		// applied bytes which must pile up before compacting is worth it
+		static const size_t kCompactionBytes = 4 * 1024 * 1024;
+
+		std::mutex mutex;
+		HANDLE file;
+		HANDLE mapping;
+		char* view;
+		size_t capacity;
+		// end of the last entry
+		size_t end;
+		size_t applied_bytes;
+		// offsets of the pending entries by target zone, oldest first
+		std::unordered_map<IntVector2, std::vector<size_t>> pending;
+
+		long long entries_written;
+		long long entries_replayed;
+		long long compactions;
+
+		bool Map(size_t new_capacity);
+		void Unmap();
+		// Moves the pending entries down over the applied ones. The mutex must be held.
+		void Compact();
+	public:
+		BufferJournal();
+		~BufferJournal();
+
+		BufferJournal(const BufferJournal&) = delete;
+		BufferJournal& operator=(const BufferJournal&) = delete;
+
+		/* Creates the journal's file at the path, replacing any there. Returns false if it couldn't be created and mapped, in which case nothing can be written.
+		*/
+		bool Open(const std::wstring& path);
+		bool IsOpen() const;
+
+		/* Writes the buffer to the journal for the target zone. Returns false if the journal isn't open or the file couldn't grow to fit it.
+		*/
+		bool Write(const IntVector2& target, const CubeBuffer& blocks);
+
+		/* Calls callback(const JournalEntry&) for every entry pending for the target zone, oldest first, and marks them applied.
+		 * The entries are only valid during the callback. The journal is locked meanwhile, so the callback must not use it.
+		 * Returns the number of entries replayed.
+		 */
+		template <typename Callback>
+		size_t Replay(const IntVector2& target, Callback callback);
+
+		/* Drops every pending entry, as when the world they were for has been left. The file stays mapped, to be written over.
+		*/
+		void Clear();
+
+		/* Entries and bytes waiting to be replayed, and the size of the file mapped.
+		*/
+		size_t GetPendingEntries();
+		size_t GetPendingBytes();
+		size_t GetMappedBytes();
+
+		long long GetEntriesWritten();
+		long long GetEntriesReplayed();
+		long long GetCompactions();
+	};
+
+	template <typename Callback>
+	size_t BufferJournal::Replay(const IntVector2& target, Callback callback) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto entries = pending.find(target);
+
+		if (entries == pending.end()) return 0;
+
+		const std::vector<size_t> offsets = std::move(entries->second);
+		pending.erase(entries);
+
+		for (size_t offset : offsets) {
+			JournalEntry::Header* header = reinterpret_cast<JournalEntry::Header*>(view + offset);
+			callback(JournalEntry(header));
+			header->state = kApplied;
+			applied_bytes += header->size;
+		}
+
+		entries_replayed += (long long)offsets.size();
+
+		if (applied_bytes >= kCompactionBytes && applied_bytes * 2 >= end) {
+			this->Compact();
+		}
+
+		return offsets.size();
+	}
+}
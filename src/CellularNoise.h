@@ -0,0 +1,282 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "JitteredGrid.h"
+
+namespace cubewg {
+	enum class CellularMetric {
+		// Reported squared, like JitteredGrid::SqrDist2Nearest.
+		EUCLIDEAN,
+		MANHATTAN,
+		CHEBYSHEV
+	};
+
+	/* The nearest points to a position, nearest first.
+	*/
+	struct CellularSample {
+		static const int kMaxRank = 4;
+
+		// F1..F4: distance to the nearest, second nearest... point. Scaled up.
+		double distances[kMaxRank];
+		// grid area each point belongs to, which identifies its cell
+		int64_t grid_xs[kMaxRank];
+		int64_t grid_ys[kMaxRank];
+		// the data of each point, as in JitteredPoint
+		int64_t data[kMaxRank];
+
+		/* 'd2-d1' type cellular noise, as JitteredGrid::Worley2 (but exact, see CellularNoise).
+		*/
+		double F2MinusF1() const {
+			return distances[1] - distances[0];
+		}
+	};
+
+	/* Cellular noise over the points of a jittered grid. Finds the nearest points (up to CellularSample::kMaxRank), their cells and data in one pass, for any metric.
+	 * Searches outwards ring by ring, skipping any grid area whose points can't beat the current furthest result, and stops once a whole ring can't.
+	 * Unlike the searches in JitteredGrid, the results are exact whatever the relaxation, and nearby results usually only need the 3x3 centre.
+	 *
+	 * @param Grid: a BasicJitteredGrid. The noise keeps a copy, which shares the grid's cache.
+	 */
+	template <typename Grid>
+	class CellularNoise {
+	private:
+		typedef typename Grid::RealType Real;
+
+		Grid grid;
+		CellularMetric metric;
+		// how many of the nearest points to find
+		int rank_count;
+
+		// how far outside the known range of jitter to assume points might be, to keep the bounds safe from rounding
+		static constexpr double kBoundSlack = 1e-6;
+	public:
+		CellularNoise(const Grid& grid, const CellularMetric metric, const int rank_count = CellularSample::kMaxRank) : grid(grid), metric(metric) {
+			this->rank_count = std::max(1, std::min(rank_count, (int)CellularSample::kMaxRank));
+		}
+
+		/* Samples the nearest points to the given position. Only the first rank_count entries of the sample are filled in.
+		*/
+		CellularSample Sample(double x, double y);
+
+		/* Samples every integer position in the width x height tile starting at [origin_x, origin_y]. The points around the tile are only sampled once.
+		 * Results are identical to calling Sample per position.
+		 *
+		 * @param out: at least width * height samples. The result for [origin_x + x, origin_y + y] is written to out[x * height + y].
+		 */
+		void SampleTile(double origin_x, double origin_y, int width, int height, CellularSample* out);
+
+	private:
+		Real Distance(Real dx, Real dy) const;
+
+		// Lower bound on the distance given lower bounds on the gap per axis.
+		double DistanceBound(double gap_x, double gap_y) const;
+
+		/* Searches around the unscaled position. Point lookup is (grid_x, grid_y, Real& point_x, Real& point_y) and data lookup is (grid_x, grid_y) -> int64_t.
+		*/
+		template <typename PointLookup, typename DataLookup>
+		void Search(Real x, Real y, PointLookup point_lookup, DataLookup data_lookup, CellularSample& sample);
+	};
+
+	// methods
+
+	template <typename Grid>
+	typename CellularNoise<Grid>::Real CellularNoise<Grid>::Distance(Real dx, Real dy) const {
+		const Real zero = Real(0.0);
+
+		switch (this->metric) {
+		case CellularMetric::MANHATTAN:
+			return (dx < zero ? zero - dx : dx) + (dy < zero ? zero - dy : dy);
+		case CellularMetric::CHEBYSHEV:
+			return std::max(dx < zero ? zero - dx : dx, dy < zero ? zero - dy : dy);
+		default:
+			return dx * dx + dy * dy;
+		}
+	}
+
+	template <typename Grid>
+	double CellularNoise<Grid>::DistanceBound(double gap_x, double gap_y) const {
+		gap_x = std::max(0.0, gap_x);
+		gap_y = std::max(0.0, gap_y);
+
+		switch (this->metric) {
+		case CellularMetric::MANHATTAN:
+			return gap_x + gap_y;
+		case CellularMetric::CHEBYSHEV:
+			return std::max(gap_x, gap_y);
+		default:
+			return gap_x * gap_x + gap_y * gap_y;
+		}
+	}
+
+	template <typename Grid>
+	template <typename PointLookup, typename DataLookup>
+	void CellularNoise<Grid>::Search(Real x, Real y, PointLookup point_lookup, DataLookup data_lookup, CellularSample& sample) {
+		const int64_t cgrid_x = FloorToInt(x);
+		const int64_t cgrid_y = FloorToInt(y);
+		const double query_x = ToDouble(x);
+		const double query_y = ToDouble(y);
+
+		// A point lies within [area + 1.5r - 1, area + 1 - 0.5r] on each axis, see AxisGap
+		const double relaxation = this->grid.GetRelaxation();
+		const double jitter_min = 1.5 * relaxation - 1 - kBoundSlack;
+		const double jitter_max = 1 - 0.5 * relaxation + kBoundSlack;
+
+		Real distances[CellularSample::kMaxRank];
+		int found = 0;
+
+		for (int ring = 0; ; ring++) {
+			if (found == this->rank_count) {
+				// every area in this ring (and beyond) is at least ring areas away on some axis
+				const double gap = std::min(
+					std::min(query_x - (cgrid_x - ring + jitter_max), (cgrid_x + ring + jitter_min) - query_x),
+					std::min(query_y - (cgrid_y - ring + jitter_max), (cgrid_y + ring + jitter_min) - query_y));
+
+				if (this->DistanceBound(gap, 0) >= ToDouble(distances[found - 1])) break;
+			}
+
+			for (int xo = -ring; xo <= ring; xo++) {
+				const int64_t grid_x = cgrid_x + xo;
+				const double gap_x = std::max((grid_x + jitter_min) - query_x, query_x - (grid_x + jitter_max));
+
+				for (int yo = -ring; yo <= ring; yo++) {
+					// only the edge of the ring
+					if (xo != -ring && xo != ring && yo != -ring && yo != ring) continue;
+
+					const int64_t grid_y = cgrid_y + yo;
+
+					if (found == this->rank_count) {
+						const double gap_y = std::max((grid_y + jitter_min) - query_y, query_y - (grid_y + jitter_max));
+
+						if (this->DistanceBound(gap_x, gap_y) >= ToDouble(distances[found - 1])) continue;
+					}
+
+					Real point_x, point_y;
+					point_lookup(grid_x, grid_y, point_x, point_y);
+					const Real point_dist = this->Distance(point_x - x, point_y - y);
+
+					if (found == this->rank_count && !(point_dist < distances[found - 1])) continue;
+
+					// insert in order, dropping the furthest if full
+					int index = found < this->rank_count ? found++ : found - 1;
+
+					while (index > 0 && point_dist < distances[index - 1]) {
+						distances[index] = distances[index - 1];
+						sample.grid_xs[index] = sample.grid_xs[index - 1];
+						sample.grid_ys[index] = sample.grid_ys[index - 1];
+						index--;
+					}
+
+					distances[index] = point_dist;
+					sample.grid_xs[index] = grid_x;
+					sample.grid_ys[index] = grid_y;
+				}
+			}
+		}
+
+		// Scale up output. Euclidean distances are squared so scale by the square, see JitteredGrid::SqrDist2Nearest.
+		const double scale = this->grid.GetScale();
+		const double distance_scale = this->metric == CellularMetric::EUCLIDEAN ? scale * scale : scale;
+
+		for (int i = 0; i < CellularSample::kMaxRank; i++) {
+			if (i < found) {
+				sample.distances[i] = ToDouble(distances[i]) * distance_scale;
+				sample.data[i] = data_lookup(sample.grid_xs[i], sample.grid_ys[i]);
+			} else {
+				sample.distances[i] = 0;
+				sample.grid_xs[i] = 0;
+				sample.grid_ys[i] = 0;
+				sample.data[i] = 0;
+			}
+		}
+	}
+
+	template <typename Grid>
+	CellularSample CellularNoise<Grid>::Sample(double x, double y) {
+		CellularSample sample;
+
+		// Scale down inputs
+		const double scale = this->grid.GetScale();
+
+		this->Search(Real(x / scale), Real(y / scale),
+			[this](int64_t grid_x, int64_t grid_y, Real& point_x, Real& point_y) { this->grid.CellPoint(grid_x, grid_y, point_x, point_y); },
+			[this](int64_t grid_x, int64_t grid_y) { return this->grid.CellData(grid_x, grid_y); },
+			sample);
+
+		return sample;
+	}
+
+	template <typename Grid>
+	void CellularNoise<Grid>::SampleTile(double origin_x, double origin_y, int width, int height, CellularSample* out) {
+		if (width <= 0 || height <= 0) return;
+
+		// Covers the 5x5 search of every position, which is nearly always enough. Anything further out is looked up as normal.
+		const int kMargin = 2;
+
+		// Scale down inputs, once per column and row rather than once per position.
+		const double scale = this->grid.GetScale();
+		std::vector<Real> xs(width);
+		std::vector<Real> ys(height);
+
+		for (int x = 0; x < width; x++) {
+			xs[x] = Real((origin_x + x) / scale);
+		}
+
+		for (int y = 0; y < height; y++) {
+			ys[y] = Real((origin_y + y) / scale);
+		}
+
+		const int64_t min_grid_x = std::min(FloorToInt(xs.front()), FloorToInt(xs.back())) - kMargin;
+		const int64_t min_grid_y = std::min(FloorToInt(ys.front()), FloorToInt(ys.back())) - kMargin;
+		const int points_width = (int)(std::max(FloorToInt(xs.front()), FloorToInt(xs.back())) + kMargin - min_grid_x) + 1;
+		const int points_height = (int)(std::max(FloorToInt(ys.front()), FloorToInt(ys.back())) + kMargin - min_grid_y) + 1;
+
+		std::vector<Real> point_xs(points_width * points_height);
+		std::vector<Real> point_ys(points_width * points_height);
+		// data is only looked up for the points in a result, so fill it in as it is needed
+		std::vector<int64_t> point_data(points_width * points_height);
+		std::vector<bool> has_data(points_width * points_height, false);
+
+		for (int i = 0; i < points_width; i++) {
+			this->grid.CellRow(min_grid_x + i, min_grid_y, points_height, &point_xs[i * points_height], &point_ys[i * points_height]);
+		}
+
+		auto point_lookup = [&](int64_t grid_x, int64_t grid_y, Real& point_x, Real& point_y) {
+			const int64_t i = grid_x - min_grid_x;
+			const int64_t j = grid_y - min_grid_y;
+
+			if (i >= 0 && j >= 0 && i < points_width && j < points_height) {
+				point_x = point_xs[i * points_height + j];
+				point_y = point_ys[i * points_height + j];
+			} else {
+				this->grid.CellPoint(grid_x, grid_y, point_x, point_y);
+			}
+		};
+
+		auto data_lookup = [&](int64_t grid_x, int64_t grid_y) {
+			const int64_t i = grid_x - min_grid_x;
+			const int64_t j = grid_y - min_grid_y;
+
+			if (i >= 0 && j >= 0 && i < points_width && j < points_height) {
+				const int64_t index = i * points_height + j;
+
+				if (!has_data[index]) {
+					point_data[index] = this->grid.CellData(grid_x, grid_y);
+					has_data[index] = true;
+				}
+
+				return point_data[index];
+			}
+
+			return this->grid.CellData(grid_x, grid_y);
+		};
+
+		for (int x = 0; x < width; x++) {
+			for (int y = 0; y < height; y++) {
+				this->Search(xs[x], ys[y], point_lookup, data_lookup, out[x * height + y]);
+			}
+		}
+	}
+}
@@ -1,18 +1,30 @@
 #include "City.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 
-const int kCityGridScale = 2000;
+#include "ColumnView.h"
+#include "Profiler.h"
+
+// A zone searches 25 to 36 grid areas of the city grid, mostly shared with its neighbours.
+const int kCityGridCacheSlots = 256;
 
 const double kCityBorderRadius = 282;
 const double kCityWallRadius = kCityBorderRadius + 36;
 const double kCityShapeRadius = kCityWallRadius + 100;
+// the lower walkway along the top of the wall
+const double kCityWalkwayInner = 284;
+const double kCityWalkwayOuter = 314;
+// zones whose centre is within this get a building
+const double kCityBuildingRadius = 269;
+
+// Plans are dropped once no zone of their city is loaded, so this is only reached if zones never unload. Plans in use are kept over it.
+const size_t kCityPlanCacheCapacity = 64;
 
-#define SQR_CITY_BORDER_RADIUS (kCityBorderRadius * kCityBorderRadius)
-#define SQR_CITY_WALL_RADIUS   (kCityWallRadius * kCityWallRadius)
-#define SQR_CITY_SHAPE_RADIUS  (kCityShapeRadius * kCityShapeRadius)
+cubewg::City::City() : cities_grid(CitiesGrid(0)), zones_generated(0), generate_nanos(0) {
+	cities_grid.EnableCache(kCityGridCacheSlots);
 
-cubewg::City::City() : cities_grid(JitteredGrid(0, 0.2, kCityGridScale)) {
 	city_wall = BlockOf(130, 150, 160);
 	pavement = BlockOf(90, 90, 90, cube::Block::Ground);
 	air = BlockOf(0, 0, 0, cube::Block::Air);
@@ -21,6 +33,10 @@ cubewg::City::City() : cities_grid(JitteredGrid(0, 0.2, kCityGridScale)) {
 cubewg::City::~City() {
 }
 
+cubewg::JitteredPointCache* cubewg::City::GetGridCache() const {
+	return cities_grid.GetCache();
+}
+
 int cubewg::City::GenerateAt(WorldRegion& region, const IntVector3& origin, std::set<cube::Zone*>& to_remesh) {
 	JitteredPoint pos = cities_grid.FindNearestPoint(origin.x, origin.y);
 
@@ -36,110 +52,382 @@ int cubewg::City::GenerateAt(WorldRegion& region, const IntVector3& origin, std:
 	return 0;
 }
 
-bool cubewg::City::Generate(WorldRegion& region, const IntVector2& zone_position, std::set<cube::Zone*>& to_remesh) {
-	bool generated = false;
+bool cubewg::City::MayIntersectZone(const IntVector2& zone_position) {
+	// Whether any city centre is within the shape radius of the zone. A block of slack covers rounding between the box test and the per-block distances in PlanZone.
+	const double zone_min_x = zone_position.x * cube::BLOCKS_PER_ZONE;
+	const double zone_min_y = zone_position.y * cube::BLOCKS_PER_ZONE;
+	return cities_grid.PointsInRect(zone_min_x, zone_min_y, zone_min_x + cube::BLOCKS_PER_ZONE - 1, zone_min_y + cube::BLOCKS_PER_ZONE - 1, kCityShapeRadius + 1, [](const JitteredPoint& centre, int64_t grid_x, int64_t grid_y) {}) > 0;
+}
 
-	// flatten terrain
-	JitteredPoint center = cities_grid.FindNearestPoint(zone_position.x * cube::BLOCKS_PER_ZONE, zone_position.y * cube::BLOCKS_PER_ZONE);
-	int flattened_height = (int) cube::GetGame()->world->GetZoneStructureHeight(center.x / cube::BLOCKS_PER_ZONE, center.y / cube::BLOCKS_PER_ZONE);
+bool cubewg::CityPlan::HasLot(const IntVector2& zone_position) const {
+	return std::find(lots.begin(), lots.end(), zone_position) != lots.end();
+}
 
-	cube::Zone* zone = region.GetZone({ zone_position.x * cube::BLOCKS_PER_ZONE, zone_position.y * cube::BLOCKS_PER_ZONE });
+std::shared_ptr<const cubewg::CityPlan> cubewg::City::MakePlan(int64_t grid_x, int64_t grid_y, const JitteredPoint& centre) {
+	std::shared_ptr<CityPlan> plan = std::make_shared<CityPlan>();
+	plan->grid_x = grid_x;
+	plan->grid_y = grid_y;
+	plan->centre_x = centre.x;
+	plan->centre_y = centre.y;
+	plan->flattened_height = (int) cube::GetGame()->world->GetZoneStructureHeight(centre.x / cube::BLOCKS_PER_ZONE, centre.y / cube::BLOCKS_PER_ZONE);
+	plan->border_radius = kCityBorderRadius;
+	plan->wall_radius = kCityWallRadius;
+	plan->shape_radius = kCityShapeRadius;
+	plan->walkway_inner_radius = kCityWalkwayInner;
+	plan->walkway_outer_radius = kCityWalkwayOuter;
+	plan->building_radius = kCityBuildingRadius;
+	plan->seed = centre.data;
 
-	for (int x = 0; x < cube::BLOCKS_PER_ZONE; x++) {
-		for (int y = 0; y < cube::BLOCKS_PER_ZONE; y++) {
-			double sqr_dist_2_city_centre = cities_grid.SqrDist2Nearest((zone_position.x * cube::BLOCKS_PER_ZONE + x), (zone_position.y * cube::BLOCKS_PER_ZONE + y));
+	// a building goes in each zone whose centre column is close enough to the city centre
+	const int half_zone = cube::BLOCKS_PER_ZONE / 2;
+	const int min_zone_x = (int)std::floor((centre.x - kCityBuildingRadius - half_zone) / cube::BLOCKS_PER_ZONE);
+	const int max_zone_x = (int)std::ceil((centre.x + kCityBuildingRadius - half_zone) / cube::BLOCKS_PER_ZONE);
+	const int min_zone_y = (int)std::floor((centre.y - kCityBuildingRadius - half_zone) / cube::BLOCKS_PER_ZONE);
+	const int max_zone_y = (int)std::ceil((centre.y + kCityBuildingRadius - half_zone) / cube::BLOCKS_PER_ZONE);
 
-			int field_index = x * cube::BLOCKS_PER_ZONE + y;
-			cube::Field* field = &zone->fields[field_index];
-			bool sea = field->base_z < -1;
+	for (int zone_x = min_zone_x; zone_x <= max_zone_x; zone_x++) {
+		for (int zone_y = min_zone_y; zone_y <= max_zone_y; zone_y++) {
+			// the same calculation as the zone's distance tile, so the lots line up exactly with the rings
+			double sqr_dist = cities_grid.SqrDist2Cell(grid_x, grid_y, zone_x * cube::BLOCKS_PER_ZONE + half_zone, zone_y * cube::BLOCKS_PER_ZONE + half_zone);
 
-			if (sqr_dist_2_city_centre < SQR_CITY_WALL_RADIUS) {
-				field->base_z = flattened_height;
-			} else if (sqr_dist_2_city_centre < SQR_CITY_SHAPE_RADIUS) {
-				float prog = sqrtf((sqr_dist_2_city_centre - SQR_CITY_WALL_RADIUS) / (SQR_CITY_SHAPE_RADIUS - SQR_CITY_WALL_RADIUS));
-				int interpolated_height = (int)(flattened_height + prog * (field->base_z - flattened_height));
-				field->base_z = interpolated_height;
+			if (sqr_dist < kCityBuildingRadius * kCityBuildingRadius) {
+				plan->lots.push_back(IntVector2(zone_x, zone_y));
 			}
+		}
+	}
 
-			// remove junk
-			if (sqr_dist_2_city_centre < SQR_CITY_WALL_RADIUS) {
-				cube::Block* b = zone->GetBlock(IntVector3(x, y, field->base_z));
-				cube::Block base = BlockOf(b->red, b->green, b->blue, b->type);
-				
-				if (!sea && b && b->type == b->Water) {
-					field->blocks.clear();
-					region.SetBlock(LongVector3(x, y, field->base_z), base, to_remesh);
-					region.SetBlock(LongVector3(x, y, 1 + field->base_z), base, to_remesh);
-				}
-				//
-				else {
-					field->blocks.clear();
+	return plan;
+}
+
+std::shared_ptr<const cubewg::CityPlan> cubewg::City::GetPlan(const IntVector2& zone_position) {
+	int64_t grid_x, grid_y;
+	JitteredPoint centre = cities_grid.FindNearestPoint(zone_position.x * cube::BLOCKS_PER_ZONE, zone_position.y * cube::BLOCKS_PER_ZONE, grid_x, grid_y);
+	const std::pair<int64_t, int64_t> key(grid_x, grid_y);
+
+	{
+		std::lock_guard<std::mutex> lock(plans_mutex);
+		auto cached = plans.find(key);
+
+		if (cached != plans.end()) {
+			return cached->second.plan;
+		}
+	}
+
+	// made outside the lock as it asks the game for the height. Another thread may make the same plan meanwhile, in which case theirs is kept.
+	std::shared_ptr<const CityPlan> plan = MakePlan(grid_x, grid_y, centre);
+
+	std::lock_guard<std::mutex> lock(plans_mutex);
+	auto cached = plans.find(key);
+
+	if (cached != plans.end()) {
+		return cached->second.plan;
+	}
+
+	if (plans.size() >= kCityPlanCacheCapacity) {
+		// Drop a plan no loaded zone uses. One in use is kept even over capacity, as the zones tracking it would otherwise unload against a plan made since.
+		auto evict = std::find_if(plans.begin(), plans.end(), [](const auto& cached) { return cached.second.loaded_zones <= 0; });
+
+		if (evict != plans.end()) {
+			plans.erase(evict);
+		}
+	}
+
+	plans[key] = CachedPlan{ plan, 0 };
+	return plan;
+}
+
+void cubewg::City::TrackZone(const IntVector2& zone_position, const std::shared_ptr<const CityPlan>& plan) {
+	const std::pair<int64_t, int64_t> key(plan->grid_x, plan->grid_y);
+	std::lock_guard<std::mutex> lock(plans_mutex);
+
+	if (zone_plans.emplace(zone_position, key).second) {
+		auto cached = plans.find(key);
+
+		// another thread may have evicted it since GetPlan, while no zone used it
+		if (cached == plans.end()) {
+			cached = plans.emplace(key, CachedPlan{ plan, 0 }).first;
+		}
+
+		cached->second.loaded_zones++;
+	}
+}
+
+void cubewg::City::OnZoneUnloaded(const IntVector2& zone_position) {
+	std::lock_guard<std::mutex> lock(plans_mutex);
+	auto zone_plan = zone_plans.find(zone_position);
+
+	if (zone_plan == zone_plans.end()) {
+		return;
+	}
+
+	auto cached = plans.find(zone_plan->second);
+	zone_plans.erase(zone_plan);
+
+	if (cached != plans.end() && --cached->second.loaded_zones <= 0) {
+		plans.erase(cached);
+	}
+}
+
+int cubewg::City::GetCachedPlans() {
+	std::lock_guard<std::mutex> lock(plans_mutex);
+	return (int)plans.size();
+}
+
+bool cubewg::City::PlanZone(const IntVector2& zone_position, CityTile& tile) {
+	const int zone_min_x = zone_position.x * cube::BLOCKS_PER_ZONE;
+	const int zone_min_y = zone_position.y * cube::BLOCKS_PER_ZONE;
+	const int zone_max_x = zone_min_x + cube::BLOCKS_PER_ZONE - 1;
+	const int zone_max_y = zone_min_y + cube::BLOCKS_PER_ZONE - 1;
+
+	// the cities reaching the zone, with the grid areas they are in
+	struct NearbyCity {
+		JitteredPoint centre;
+		int64_t grid_x;
+		int64_t grid_y;
+	};
+
+	std::vector<NearbyCity> cities;
+
+	cities_grid.PointsInRect(zone_min_x, zone_min_y, zone_max_x, zone_max_y, kCityShapeRadius + 1, [&](const JitteredPoint& centre, int64_t grid_x, int64_t grid_y) {
+		cities.push_back(NearbyCity{ centre, grid_x, grid_y });
+	});
+
+	// skip zones no city reaches. This search is the only one, so GenerateInZone's MayIntersectZone check isn't repeated here.
+	if (cities.empty()) {
+		return false;
+	}
+
+	std::fill(tile.sqr_dists, tile.sqr_dists + CityTile::kSize, INFINITY);
+	std::fill(tile.rings, tile.rings + CityTile::kSize, CityRing::OUTSIDE);
+	tile.spans.clear();
+
+	// Distance from each column a city covers to that city's centre, keeping the nearest. The footprints are grown by a block so no column within the shape radius
+	// is missed to rounding; the distances themselves are exact, and the same as SqrDist2Nearest gives.
+	std::vector<FootprintSpan> city_spans;
+
+	for (const NearbyCity& city : cities) {
+		city_spans.clear();
+		Footprint::Circle(city.centre.x, city.centre.y, kCityShapeRadius).Rasterise(zone_min_x, zone_min_y, zone_max_x, zone_max_y, 1, city_spans);
+
+		for (const FootprintSpan& span : city_spans) {
+			const int x = span.x - zone_min_x;
+
+			for (int y = span.min_y - zone_min_y; y <= span.max_y - zone_min_y; y++) {
+				const double sqr_dist = cities_grid.SqrDist2Cell(city.grid_x, city.grid_y, zone_min_x + x, zone_min_y + y);
+				double& nearest = tile.sqr_dists[x * cube::BLOCKS_PER_ZONE + y];
+				nearest = std::min(nearest, sqr_dist);
+			}
+
+			tile.spans.push_back(FootprintSpan(x, span.min_y - zone_min_y, span.max_y - zone_min_y));
+		}
+	}
+
+	tile.plan = GetPlan(zone_position);
+	const CityPlan& plan = *tile.plan;
+
+	// Where cities overlap the zone, merge their spans so each column is visited once.
+	std::sort(tile.spans.begin(), tile.spans.end(), [](const FootprintSpan& a, const FootprintSpan& b) { return a.x != b.x ? a.x < b.x : a.min_y < b.min_y; });
+	size_t merged = 0;
+
+	for (size_t i = 0; i < tile.spans.size(); i++) {
+		if (merged > 0 && tile.spans[merged - 1].x == tile.spans[i].x && tile.spans[i].min_y <= tile.spans[merged - 1].max_y + 1) {
+			tile.spans[merged - 1].max_y = std::max(tile.spans[merged - 1].max_y, tile.spans[i].max_y);
+		} else {
+			tile.spans[merged++] = tile.spans[i];
+		}
+	}
+
+	tile.spans.erase(tile.spans.begin() + merged, tile.spans.end());
+
+	const double sqr_border_radius = plan.border_radius * plan.border_radius;
+	const double sqr_wall_radius = plan.wall_radius * plan.wall_radius;
+	const double sqr_shape_radius = plan.shape_radius * plan.shape_radius;
+	const double sqr_walkway_inner_radius = plan.walkway_inner_radius * plan.walkway_inner_radius;
+	const double sqr_walkway_outer_radius = plan.walkway_outer_radius * plan.walkway_outer_radius;
+
+	// Everything the cities cover blends back to the terrain, until the plazas and rings are laid over it.
+	for (const FootprintSpan& span : tile.spans) {
+		for (int y = span.min_y; y <= span.max_y; y++) {
+			const int i = span.x * cube::BLOCKS_PER_ZONE + y;
+			tile.rings[i] = tile.sqr_dists[i] < sqr_shape_radius ? CityRing::BLEND : CityRing::OUTSIDE;
+		}
+	}
+
+	// The plazas, shrunk by a block so every column in them is surely inside the border. The columns left at their edge are in the rings below.
+	for (const NearbyCity& city : cities) {
+		city_spans.clear();
+		Footprint::Circle(city.centre.x, city.centre.y, plan.border_radius - 1).Rasterise(zone_min_x, zone_min_y, zone_max_x, zone_max_y, 0, city_spans);
+
+		for (const FootprintSpan& span : city_spans) {
+			const int x = span.x - zone_min_x;
+			std::fill(tile.rings + x * cube::BLOCKS_PER_ZONE + span.min_y - zone_min_y, tile.rings + x * cube::BLOCKS_PER_ZONE + span.max_y - zone_min_y + 1, CityRing::PLAZA);
+		}
+	}
+
+	// The walls, grown by two blocks to overlap the plazas and the blend, so only columns near a wall are tested against its radii.
+	for (const NearbyCity& city : cities) {
+		city_spans.clear();
+		Footprint::Annulus(city.centre.x, city.centre.y, plan.border_radius, plan.wall_radius).Rasterise(zone_min_x, zone_min_y, zone_max_x, zone_max_y, 2, city_spans);
+
+		for (const FootprintSpan& span : city_spans) {
+			const int x = span.x - zone_min_x;
+
+			for (int y = span.min_y - zone_min_y; y <= span.max_y - zone_min_y; y++) {
+				const int i = x * cube::BLOCKS_PER_ZONE + y;
+				const double sqr_dist = tile.sqr_dists[i];
+
+				if (sqr_dist < sqr_border_radius) {
+					tile.rings[i] = CityRing::PLAZA;
+				} else if (sqr_dist <= sqr_wall_radius) {
+					// the walkway is lower than the faces either side of it
+					tile.rings[i] = (sqr_dist <= sqr_walkway_outer_radius && sqr_dist >= sqr_walkway_inner_radius) ? CityRing::WALL : CityRing::BORDER;
 				}
 			}
 		}
 	}
 
-	// generate city walls and pavement
-	for (int x = 0; x < cube::BLOCKS_PER_ZONE; x++) {
-		for (int y = 0; y < cube::BLOCKS_PER_ZONE; y++) {
-			double sqr_dist_2_city_centre = cities_grid.SqrDist2Nearest((zone_position.x * cube::BLOCKS_PER_ZONE + x), (zone_position.y * cube::BLOCKS_PER_ZONE + y));
+	return true;
+}
+
+bool cubewg::City::Generate(WorldRegion& region, const IntVector2& zone_position, std::set<cube::Zone*>& to_remesh) {
+	auto start = std::chrono::steady_clock::now();
+	bool generated = false;
+
+	// reused between zones generated on the same thread, as it is too big to want on the stack
+	thread_local CityTile tile;
+	bool planned;
+
+	{
+		CUBEWG_PROFILE_SCOPE("City plan");
+		planned = PlanZone(zone_position, tile);
+	}
+
+	if (!planned) {
+		RecordGenerate(start);
+		return false;
+	}
+
+	const CityPlan& plan = *tile.plan;
+	TrackZone(zone_position, tile.plan);
+
+	const int flattened_height = plan.flattened_height;
+	const double sqr_wall_radius = plan.wall_radius * plan.wall_radius;
+	const double sqr_shape_radius = plan.shape_radius * plan.shape_radius;
 
-			if (sqr_dist_2_city_centre <= SQR_CITY_WALL_RADIUS && sqr_dist_2_city_centre >= SQR_CITY_BORDER_RADIUS) {
-				generated = true;
-				int height = region.GetBaseZ(LongVector2(x, y));//region.GetHeight(LongVector2(x, y), Heightmap::WORLD_SURFACE) + 1;
-				const int wall_height = (sqr_dist_2_city_centre <= 314 * 314 && sqr_dist_2_city_centre >= 284 * 284) ? 11 : 14;
+	cube::Zone* zone = region.GetZone({ zone_position.x * cube::BLOCKS_PER_ZONE, zone_position.y * cube::BLOCKS_PER_ZONE });
+
+	{
+		// flattening, clearing junk, walls and pavement, timed together as they share the pass
+		CUBEWG_PROFILE_SCOPE("City flatten and walls");
+
+		// Every stage but buildings only reads and writes its own column, so they run in one pass, one column at a time, over the columns the city covers.
+		for (const FootprintSpan& span : tile.spans) {
+			const int x = span.x;
+
+			for (int y = span.min_y; y <= span.max_y; y++) {
+				int field_index = x * cube::BLOCKS_PER_ZONE + y;
+				const CityRing ring = tile.rings[field_index];
+
+				if (ring == CityRing::OUTSIDE) continue;
+
+				double sqr_dist_2_city_centre = tile.sqr_dists[field_index];
+				cube::Field* field = &zone->fields[field_index];
+				bool sea = field->base_z < -1;
+
+				// flatten terrain. Columns exactly on the wall radius blend by nothing, which is the same as flattening.
+				if (ring != CityRing::BLEND) {
+					field->base_z = flattened_height;
+				} else {
+					float prog = sqrtf((sqr_dist_2_city_centre - sqr_wall_radius) / (sqr_shape_radius - sqr_wall_radius));
+					int interpolated_height = (int)(flattened_height + prog * (field->base_z - flattened_height));
+					field->base_z = interpolated_height;
+				}
 
-				if (height != kNoPosition) {
-					int zo = 0;
-					// make space for rivers
-					int field_index = x * cube::BLOCKS_PER_ZONE + y;
-					cube::Field* field = &zone->fields[field_index];
-					if (!field->blocks.empty()) {
-						zo = 6; // not empty = water block
+				// remove junk. Not on the wall radius itself, although the wall is built there.
+				if (sqr_dist_2_city_centre < sqr_wall_radius) {
+					const cube::Block* b = ColumnView(*field).Get(field->base_z);
+
+					if (!sea && b && b->type == b->Water) {
+						cube::Block base = BlockOf(b->red, b->green, b->blue, b->type);
+						field->blocks.clear();
+						region.SetBlock(LongVector3(x, y, field->base_z), base, to_remesh);
+						region.SetBlock(LongVector3(x, y, 1 + field->base_z), base, to_remesh);
+					}
+					//
+					else {
+						field->blocks.clear();
 					}
+				}
+
+				tile.base_zs[field_index] = field->base_z;
+				// the fields were changed directly, behind the region's back
+				region.InvalidateHeights(LongVector2(x, y));
+
+				// generate city walls and pavement
+				if (ring == CityRing::BORDER || ring == CityRing::WALL) {
+					generated = true;
+					int height = tile.base_zs[field_index];//region.GetHeight(LongVector2(x, y), Heightmap::WORLD_SURFACE) + 1;
+					const int wall_height = ring == CityRing::WALL ? 11 : 14;
+
+					if (height != kNoPosition) {
+						int zo = 0;
+						// make space for rivers
+						if (!field->blocks.empty()) {
+							zo = 6; // not empty = water block
+						}
 
-					// TODO account for lava and trees
-					for (; zo < wall_height; zo++) {
-						region.SetBlock(LongVector3(x, y, height + zo), city_wall, to_remesh);
+						// TODO account for lava and trees
+						region.FillColumn(x, y, height + zo, height + wall_height - 1, city_wall, to_remesh);
 					}
 				}
-			}
-			else if (sqr_dist_2_city_centre < SQR_CITY_BORDER_RADIUS) {
-				generated = true;
-				int height = region.GetHeight(LongVector2(x, y), Heightmap::WORLD_SURFACE) + 1;
+				else if (ring == CityRing::PLAZA) {
+					generated = true;
+					int height = region.GetHeight(LongVector2(x, y), Heightmap::WORLD_SURFACE) + 1;
 
-				if (height != kNoPosition) {
-					region.SetBlock(LongVector3(x, y, height - 1), pavement, to_remesh);
+					if (height != kNoPosition) {
+						region.SetBlock(LongVector3(x, y, height - 1), pavement, to_remesh);
+					}
 				}
 			}
 		}
 	}
 
-	// generate buildings
-	double zone_centre_dist_to_city_centre = cities_grid.SqrDist2Nearest((zone_position.x * cube::BLOCKS_PER_ZONE + 32), (zone_position.y * cube::BLOCKS_PER_ZONE + 32));
+	// generate buildings. The centre column of a lot is in the plaza, so its base z is in the tile.
+	const int centre_index = 32 * cube::BLOCKS_PER_ZONE + 32;
 
-	if (zone_centre_dist_to_city_centre < 269 * 269) {
+	if (plan.HasLot(zone_position)) {
+		CUBEWG_PROFILE_SCOPE("City buildings");
 		generated = true;
-		int height = region.GetBaseZ(LongVector2(32, 32));//region.GetHeight(LongVector2(32, 32), Heightmap::WORLD_SURFACE) + 1;
+		int height = tile.base_zs[centre_index];//region.GetHeight(LongVector2(32, 32), Heightmap::WORLD_SURFACE) + 1;
 
 		cube::Block* abv_surface_block = region.GetBlock(LongVector3(32, 32, height));
 		
 		if (abv_surface_block) {
-			for (int xo = -10; xo <= 10; xo++) {
-				int local_x = xo + 32;
-
-				for (int yo = -10; yo <= 10; yo++) {
-					int local_y = yo + 32;
-
-					if (std::abs(xo) == 10 || std::abs(yo) == 10) { // only on borders
-						for (int zo = 0; zo <= 10; zo++) {
-							region.SetBlock(LongVector3(local_x, local_y, zo + height), city_wall, to_remesh);
-						}
-					}
-				}
-			}
+			// only on borders: the two sides along y, then the two along x between them. Batched, as each side is a separate box.
+			EditBatch edits(region.GetArena());
+			const int low = 32 - 10;
+			const int high = 32 + 10;
+			edits.FillBox(LongVector3(low, low, height), LongVector3(low, high, height + 10), city_wall);
+			edits.FillBox(LongVector3(high, low, height), LongVector3(high, high, height + 10), city_wall);
+			edits.FillBox(LongVector3(low + 1, low, height), LongVector3(high - 1, low, height + 10), city_wall);
+			edits.FillBox(LongVector3(low + 1, high, height), LongVector3(high - 1, high, height + 10), city_wall);
+			region.Commit(edits, to_remesh);
 		}
 	}
 
+	RecordGenerate(start);
 	return generated;
 }
+
+void cubewg::City::RecordGenerate(std::chrono::steady_clock::time_point start) {
+	zones_generated++;
+	generate_nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+long long cubewg::City::GetZonesGenerated() const {
+	return zones_generated.load();
+}
+
+long long cubewg::City::GetGenerateNanos() const {
+	return generate_nanos.load();
+}
@@ -1,21 +1,140 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "WorldRegion.h"
 #include "Structure.h"
 #include "JitteredGrid.h"
+#include "JitteredPointCache.h"
+#include "Footprint.h"
 
 namespace cubewg {
+	const int kCityGridScale = 2000;
+
+	/* Grid of city centres: relaxation 0.2, scale kCityGridScale. Uses the legacy search areas so cities stay where they are in existing worlds.
+	*/
+	typedef BasicJitteredGrid<double, std::ratio<1, 5>, std::ratio<kCityGridScale>, kLegacySearchRadius> CitiesGrid;
+
+	/* Where a column lies relative to the nearest city centre, from the centre outwards.
+	*/
+	enum class CityRing : uint8_t {
+		// inside the walls, paved over
+		PLAZA,
+		// the inner and outer faces of the wall, built full height
+		BORDER,
+		// the walkway between the faces, built lower
+		WALL,
+		// outside the walls, where the terrain blends from the city's height back to its own
+		BLEND,
+		// untouched by the city
+		OUTSIDE
+	};
+
+	/* Everything about a city which doesn't depend on the zone being generated. Computed once per city and shared by every zone the city spans.
+	*/
+	struct CityPlan {
+		// the city grid area the city's centre is in, which identifies the city
+		int64_t grid_x;
+		int64_t grid_y;
+		double centre_x;
+		double centre_y;
+		// the height the city is flattened to
+		int flattened_height;
+		// ring radii, in blocks from the centre
+		double border_radius;
+		double wall_radius;
+		double shape_radius;
+		double walkway_inner_radius;
+		double walkway_outer_radius;
+		double building_radius;
+		// the zones which have a building at their centre
+		std::vector<IntVector2> lots;
+		// for layout choices, from the data of the city's point
+		int64_t seed;
+
+		bool HasLot(const IntVector2& zone_position) const;
+	};
+
+	/* Per-zone scratch for city generation. Filled once per zone and read by every stage, rather than each stage sampling the grid and zone again.
+	 * Indexed the same as zone->fields.
+	 */
+	struct CityTile {
+		static const int kSize = cube::BLOCKS_PER_ZONE * cube::BLOCKS_PER_ZONE;
+
+		// squared distance from each column to the nearest city centre, for columns in spans. Infinity elsewhere.
+		double sqr_dists[kSize];
+		// OUTSIDE for every column not in spans
+		CityRing rings[kSize];
+		// base z of each column after flattening. Only filled for columns in the city (not OUTSIDE).
+		int base_zs[kSize];
+		// the plan of the zone's city, whose slice of it the zone generates
+		std::shared_ptr<const CityPlan> plan;
+		// the columns (zone-local) covered by the footprint of any city reaching the zone. The only columns the city stages visit.
+		std::vector<FootprintSpan> spans;
+	};
+
 	class City : public Structure {
 	private:
-		JitteredGrid cities_grid;
+		CitiesGrid cities_grid;
 		cube::Block city_wall;
 		cube::Block pavement;
 		cube::Block air;
+
+		// live generation throughput, for .bench city
+		std::atomic<long long> zones_generated;
+		std::atomic<long long> generate_nanos;
+
+		struct CachedPlan {
+			std::shared_ptr<const CityPlan> plan;
+			// how many loaded zones were generated from the plan. The plan is dropped when this reaches 0.
+			int loaded_zones;
+		};
+
+		// Plans by city grid area, and the city grid area of each loaded zone's plan.
+		std::mutex plans_mutex;
+		std::map<std::pair<int64_t, int64_t>, CachedPlan> plans;
+		std::unordered_map<IntVector2, std::pair<int64_t, int64_t>> zone_plans;
+
+		void RecordGenerate(std::chrono::steady_clock::time_point start);
+		std::shared_ptr<const CityPlan> MakePlan(int64_t grid_x, int64_t grid_y, const JitteredPoint& centre);
+		// Marks the zone as loaded with the given plan, so the plan is kept until the zone unloads.
+		void TrackZone(const IntVector2& zone_position, const std::shared_ptr<const CityPlan>& plan);
 	public:
 		City();
 		~City();
 
 		int GenerateAt(WorldRegion& region, const IntVector3& origin, std::set<cube::Zone*>& to_remesh) override;
 		bool Generate(WorldRegion& region, const IntVector2& zone_position, std::set<cube::Zone*>& to_remesh) override;
+		bool MayIntersectZone(const IntVector2& zone_position) override;
+		void OnZoneUnloaded(const IntVector2& zone_position) override;
+
+		/* Gets the plan of the city the zone belongs to: the city nearest its corner. Plans are cached while any zone generated from them is loaded.
+		*/
+		std::shared_ptr<const CityPlan> GetPlan(const IntVector2& zone_position);
+
+		/* How many city plans are cached.
+		*/
+		int GetCachedPlans();
+
+		/* Fills in the plan, spans, distances and rings of the tile for the given zone. Returns false, leaving the tile unfilled, if no city reaches the zone.
+		*/
+		bool PlanZone(const IntVector2& zone_position, CityTile& tile);
+
+		/* Gets the point cache of the city grid, for reporting how well it does.
+		*/
+		JitteredPointCache* GetGridCache() const;
+
+		/* How many zones Generate has been called for, and the total time spent in it.
+		*/
+		long long GetZonesGenerated() const;
+		long long GetGenerateNanos() const;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cwsdk.h>
+
+#include <algorithm>
+
+namespace cubewg {
+	/* Reads the blocks of a field's column straight from its block vector, which runs up from base z.
+	 * Saves going through Zone::GetBlock for each z, which redoes the field lookup and base z offset every time.
+	 * Blocks outside the vector are nullptr, as GetBlock gives. The searches ask their predicate about the nullptr once for each side of the vector, so it must only depend on the block.
+	 */
+	class ColumnView {
+	private:
+		const cube::Field* field;
+	public:
+		explicit ColumnView(const cube::Field& field) : field(&field) {
+		}
+
+		int GetBaseZ() const {
+			return field->base_z;
+		}
+
+		/* The z of the highest block in the vector, or base z - 1 if it's empty.
+		*/
+		int GetTopZ() const {
+			return field->base_z + (int)field->blocks.size() - 1;
+		}
+
+		bool IsEmpty() const {
+			return field->blocks.empty();
+		}
+
+		const cube::Block* Get(int z) const {
+			const int i = z - field->base_z;
+			return i >= 0 && i < (int)field->blocks.size() ? &field->blocks[i] : nullptr;
+		}
+
+		/* Finds the lowest z from min_z to max_z (inclusive) where predicate(block) is true, going up through the column. Blocks outside the vector are passed as nullptr.
+		 * Returns false if there is none.
+		 */
+		template <typename Predicate>
+		bool FindUp(int min_z, int max_z, Predicate predicate, int& found_z) const {
+			const int base_z = field->base_z;
+			const int size = (int)field->blocks.size();
+			const cube::Block* blocks = field->blocks.data();
+
+			// below the vector, then through it, then above it
+			int z = min_z;
+
+			if (z <= max_z && z < base_z) {
+				if (predicate(nullptr)) { found_z = z; return true; }
+				z = base_z;
+			}
+
+			const int top = std::min(max_z, base_z + size - 1);
+
+			for (; z <= top; z++) {
+				if (predicate(&blocks[z - base_z])) { found_z = z; return true; }
+			}
+
+			if (z <= max_z && predicate(nullptr)) {
+				found_z = z;
+				return true;
+			}
+
+			return false;
+		}
+
+		/* Finds the highest z from min_z to max_z (inclusive) where predicate(block) is true, going down through the column. Blocks outside the vector are passed as nullptr.
+		 * Returns false if there is none.
+		 */
+		template <typename Predicate>
+		bool FindDown(int min_z, int max_z, Predicate predicate, int& found_z) const {
+			const int base_z = field->base_z;
+			const int size = (int)field->blocks.size();
+			const cube::Block* blocks = field->blocks.data();
+
+			// above the vector, then through it, then below it
+			int z = max_z;
+
+			if (z >= min_z && z >= base_z + size) {
+				if (predicate(nullptr)) { found_z = z; return true; }
+				z = base_z + size - 1;
+			}
+
+			const int bottom = std::max(min_z, base_z);
+
+			for (; z >= bottom; z--) {
+				if (predicate(&blocks[z - base_z])) { found_z = z; return true; }
+			}
+
+			if (z >= min_z && predicate(nullptr)) {
+				found_z = z;
+				return true;
+			}
+
+			return false;
+		}
+	};
+}
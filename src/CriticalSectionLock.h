@@ -0,0 +1,28 @@
+#pragma once
+
+#include <windows.h>
+
+namespace cubewg {
+	/* The game's zones lock, world->zones_critical_section, as a lock ProfiledLock and LockProfiler take. Reentrant, as critical sections are.
+	 * Apart from LockProfiler.h, so the profiler builds without Windows, as the lock harness does.
+	 */
+	class CriticalSectionLock {
+	private:
+		CRITICAL_SECTION* section;
+	public:
+		explicit CriticalSectionLock(CRITICAL_SECTION* section) : section(section) {
+		}
+
+		bool try_lock() {
+			return TryEnterCriticalSection(section) != 0;
+		}
+
+		void lock() {
+			EnterCriticalSection(section);
+		}
+
+		void unlock() {
+			LeaveCriticalSection(section);
+		}
+	};
+}
@@ -0,0 +1,212 @@
+#include "CubeBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Buffers which are written out of order but not read compact once they have this many times the runs they had when last compacted,
+// so overwrites don't pile up until the neighbour loads. Never below the minimum, so small buffers don't compact on every few writes.
+const size_t kCompactGrowth = 4;
+const size_t kCompactMinRuns = 1024;
+
+cubewg::CubeBuffer::CubeBuffer(MemoryPool* pool) : palette(PoolAllocator<cube::Block>(pool)), last_block(0), runs(PoolAllocator<Run>(pool)), compact(true), compacted_runs(0), block_count(0) {
+}
+
+uint16_t cubewg::CubeBuffer::PaletteIndex(const cube::Block& block) {
+	// Buffers hold a handful of distinct blocks (a structure's materials), often the same one many times in a row, so a linear search beats hashing.
+	// Compared bytewise, as Block has no operator==.
+	if (last_block < palette.size() && std::memcmp(&palette[last_block], &block, sizeof(cube::Block)) == 0) {
+		return last_block;
+	}
+
+	for (size_t i = 0; i < palette.size(); i++) {
+		if (std::memcmp(&palette[i], &block, sizeof(cube::Block)) == 0) {
+			last_block = (uint16_t)i;
+			return last_block;
+		}
+	}
+
+	if (palette.size() > UINT16_MAX) {
+		throw std::length_error("Too many distinct blocks in one cube buffer.");
+	}
+
+	palette.push_back(block);
+	last_block = (uint16_t)(palette.size() - 1);
+	return last_block;
+}
+
+void cubewg::CubeBuffer::Append(int column, int min_z, int max_z, uint16_t block) {
+	if (!runs.empty()) {
+		Run& last = runs.back();
+
+		// continues the last run
+		if (last.column == column && last.block == block && last.max_z + 1 == min_z) {
+			last.max_z = max_z;
+			block_count += (size_t)(max_z - min_z + 1);
+			return;
+		}
+
+		// anything but the next run in field order needs sorting out later
+		if (last.column > column || (last.column == column && last.max_z >= min_z)) {
+			compact = false;
+		}
+	}
+
+	runs.push_back(Run{ (uint16_t)column, block, min_z, max_z });
+	block_count += (size_t)(max_z - min_z + 1);
+
+	if (!compact && runs.size() >= kCompactGrowth * std::max(compacted_runs, kCompactMinRuns)) {
+		this->Compact();
+	}
+}
+
+void cubewg::CubeBuffer::Set(const IntVector3& local_block_pos, const cube::Block& block) {
+	this->SetColumn(local_block_pos.x, local_block_pos.y, local_block_pos.z, local_block_pos.z, block);
+}
+
+void cubewg::CubeBuffer::SetColumn(int x, int y, int min_z, int max_z, const cube::Block& block) {
+	if (min_z > max_z) return;
+
+	this->Append(x * cube::BLOCKS_PER_ZONE + y, min_z, max_z, this->PaletteIndex(block));
+}
+
+void cubewg::CubeBuffer::Merge(const CubeBuffer& other) {
+	other.ForEachRun([this](int x, int y, int min_z, int max_z, const cube::Block& block) {
+		this->SetColumn(x, y, min_z, max_z, block);
+	});
+}
+
+void cubewg::CubeBuffer::Compact() const {
+	if (compact) return;
+
+	// by column, keeping the order runs were written in within each column
+	std::stable_sort(runs.begin(), runs.end(), [](const Run& a, const Run& b) { return a.column < b.column; });
+
+	// from the same pool as the runs, so result can be swapped in
+	Runs result(runs.get_allocator());
+	Runs column_runs(runs.get_allocator());
+	Runs next(runs.get_allocator());
+	result.reserve(runs.size());
+	block_count = 0;
+
+	for (size_t start = 0; start < runs.size();) {
+		size_t end = start + 1;
+
+		while (end < runs.size() && runs[end].column == runs[start].column) {
+			end++;
+		}
+
+		// write each run over the column in turn, so later writes replace what they overlap
+		column_runs.clear();
+
+		for (size_t i = start; i < end; i++) {
+			const Run& added = runs[i];
+			bool placed = false;
+			next.clear();
+
+			for (const Run& run : column_runs) {
+				if (run.max_z < added.min_z || run.min_z > added.max_z) {
+					// untouched. The new run goes before the first run above it.
+					if (!placed && run.min_z > added.max_z) {
+						next.push_back(added);
+						placed = true;
+					}
+
+					next.push_back(run);
+					continue;
+				}
+
+				// replaced, apart from any ends sticking out either side
+				if (run.min_z < added.min_z) {
+					next.push_back(Run{ run.column, run.block, run.min_z, added.min_z - 1 });
+				}
+
+				if (run.max_z > added.max_z) {
+					if (!placed) {
+						next.push_back(added);
+						placed = true;
+					}
+
+					next.push_back(Run{ run.column, run.block, added.max_z + 1, run.max_z });
+				}
+			}
+
+			if (!placed) {
+				next.push_back(added);
+			}
+
+			column_runs.swap(next);
+		}
+
+		// join neighbouring runs of the same block
+		for (const Run& run : column_runs) {
+			if (!result.empty() && result.back().column == run.column && result.back().block == run.block && result.back().max_z + 1 == run.min_z) {
+				result.back().max_z = run.max_z;
+			} else {
+				result.push_back(run);
+			}
+
+			block_count += (size_t)(run.max_z - run.min_z + 1);
+		}
+
+		start = end;
+	}
+
+	runs.swap(result);
+	compact = true;
+	compacted_runs = runs.size();
+}
+
+const cubewg::CubeBuffer::Run* cubewg::CubeBuffer::GetRuns(size_t& count) const {
+	this->Compact();
+	count = runs.size();
+	return runs.data();
+}
+
+const cube::Block* cubewg::CubeBuffer::GetPalette(size_t& count) const {
+	count = palette.size();
+	return palette.data();
+}
+
+bool cubewg::CubeBuffer::IsEmpty() const {
+	return runs.empty();
+}
+
+void cubewg::CubeBuffer::Clear() {
+	palette.clear();
+	runs.clear();
+	last_block = 0;
+	compact = true;
+	compacted_runs = 0;
+	block_count = 0;
+}
+
+bool cubewg::CubeBuffer::GetBounds(IntVector2& min, IntVector2& max) const {
+	if (runs.empty()) return false;
+
+	min = IntVector2(cube::BLOCKS_PER_ZONE, cube::BLOCKS_PER_ZONE);
+	max = IntVector2(-1, -1);
+
+	for (const Run& run : runs) {
+		const int x = run.column / cube::BLOCKS_PER_ZONE;
+		const int y = run.column % cube::BLOCKS_PER_ZONE;
+		min.x = std::min(min.x, x);
+		min.y = std::min(min.y, y);
+		max.x = std::max(max.x, x);
+		max.y = std::max(max.y, y);
+	}
+
+	return true;
+}
+
+size_t cubewg::CubeBuffer::GetBlockCount() const {
+	this->Compact();
+	return block_count;
+}
+
+size_t cubewg::CubeBuffer::GetMemoryUsage() const {
+	const MemoryPool* pool = palette.get_allocator().pool;
+	const auto allocated = [pool](size_t bytes) -> size_t { return bytes == 0 || !pool ? bytes : pool->GetAllocationSize(bytes); };
+
+	return sizeof(CubeBuffer) + allocated(palette.capacity() * sizeof(cube::Block)) + allocated(runs.capacity() * sizeof(Run));
+}
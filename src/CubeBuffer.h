@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cwsdk.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "MemoryPool.h"
+
+namespace std {
+	template <>
+	struct hash<Vector3<int>> {
+		std::size_t operator()(const Vector3<int>& k) const {
+			uint64_t x = (uint32_t)k.x;
+			uint64_t y = (uint32_t)k.y;
+			uint64_t vec2key = x | (y << 32);
+
+			uint64_t z = (uint32_t)k.z;
+			vec2key = vec2key * 31L + z;
+
+			// Call into the MSVC-STL FNV-1a std::hash function.
+			return std::hash<uint64_t>()(vec2key);
+		}
+	};
+}
+
+namespace cubewg {
+	/* Blocks waiting to be pasted into a zone, by zone-local position. Later writes to a position replace earlier ones.
+	 * Stored compactly: each distinct block once in a palette, and each column as runs of z sharing a palette entry, all in one array in field order.
+	 * A wall 14 blocks high is one run rather than 14 hash map nodes each holding a whole block.
+	 */
+	class CubeBuffer {
+	public:
+		struct Run {
+			// x * BLOCKS_PER_ZONE + y, as zone->fields is indexed
+			uint16_t column;
+			// index into the palette
+			uint16_t block;
+			int min_z;
+			int max_z;
+		};
+	private:
+		typedef std::vector<Run, PoolAllocator<Run>> Runs;
+
+		std::vector<cube::Block, PoolAllocator<cube::Block>> palette;
+		uint16_t last_block;
+		// Runs in the order they were written. Writes in field order, bottom up, keep them sorted with no overlaps (compact) as they are added;
+		// any other order is sorted out by Compact the next time the buffer is read, or once the runs have grown well past their last compacted size.
+		mutable Runs runs;
+		mutable bool compact;
+		// how many runs there were after the last Compact
+		mutable size_t compacted_runs;
+		// only kept up to date while compact
+		mutable size_t block_count;
+
+		uint16_t PaletteIndex(const cube::Block& block);
+		void Append(int column, int min_z, int max_z, uint16_t block);
+		// Sorts the runs into field order, resolving overlaps in favour of the later write.
+		void Compact() const;
+	public:
+		/* The buffer's memory comes from the pool, or the heap if it is nullptr.
+		*/
+		explicit CubeBuffer(MemoryPool* pool = nullptr);
+
+		void Set(const IntVector3& local_block_pos, const cube::Block& block);
+
+		/* Sets the column at [x, y] from min_z to max_z inclusive.
+		*/
+		void SetColumn(int x, int y, int min_z, int max_z, const cube::Block& block);
+
+		/* Sets every block of the other buffer in this one, replacing what is here.
+		*/
+		void Merge(const CubeBuffer& other);
+
+		/* Calls callback(local_block_pos, block) for every block, column by column in field order and up each column.
+		*/
+		template <typename Callback>
+		void ForEach(Callback callback) const;
+
+		/* Calls callback(x, y, min_z, max_z, block) for every run of the same block in a column, in the same order as ForEach.
+		*/
+		template <typename Callback>
+		void ForEachRun(Callback callback) const;
+
+		/* The runs, compacted, and the palette they index, as held in memory. For copying the buffer out whole, as BufferJournal does.
+		*/
+		const Run* GetRuns(size_t& count) const;
+		const cube::Block* GetPalette(size_t& count) const;
+
+		bool IsEmpty() const;
+
+		/* Removes every block, keeping the memory for reuse.
+		*/
+		void Clear();
+
+		/* Gets the smallest box holding every block, in x and y. Returns false if the buffer is empty.
+		*/
+		bool GetBounds(IntVector2& min, IntVector2& max) const;
+
+		/* The number of blocks buffered, and the approximate number of bytes used to hold them, as the buffer's pool rounds its allocations.
+		*/
+		size_t GetBlockCount() const;
+		size_t GetMemoryUsage() const;
+	};
+
+	template <typename Callback>
+	void CubeBuffer::ForEach(Callback callback) const {
+		this->ForEachRun([&callback](int x, int y, int min_z, int max_z, const cube::Block& block) {
+			for (int z = min_z; z <= max_z; z++) {
+				callback(IntVector3(x, y, z), block);
+			}
+		});
+	}
+
+	template <typename Callback>
+	void CubeBuffer::ForEachRun(Callback callback) const {
+		this->Compact();
+
+		for (const Run& run : runs) {
+			callback(run.column / cube::BLOCKS_PER_ZONE, run.column % cube::BLOCKS_PER_ZONE, run.min_z, run.max_z, palette[run.block]);
+		}
+	}
+}
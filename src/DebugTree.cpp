@@ -22,10 +22,11 @@ int cubewg::DebugTree::GenerateAt(WorldRegion& region, const IntVector3& origin,
 	const int y = origin.y;
 	const int z = origin.z;
 
+	// the tree is written in one go at the end, as it often straddles zones
+	EditBatch edits(region.GetArena());
+
 	// generate trunk
-	for (int i = 0; i < kHeight - 4; i++) {
-		region.SetBlock(LongVector3(x, y, z + i), log, to_remesh);
-	}
+	edits.FillColumn(x, y, z, z + kHeight - 5, log);
 
 	// generate leaves
 	for (int i = kHeight - 4; i < kHeight; i++) {
@@ -39,23 +40,16 @@ int cubewg::DebugTree::GenerateAt(WorldRegion& region, const IntVector3& origin,
 					int total_y = y + yo;
 
 					if (xo == 0 || yo == 0) { // not corners
-						region.SetBlock(LongVector3(total_x, total_y, total_z), blue_leaves, to_remesh);
+						edits.SetBlock(LongVector3(total_x, total_y, total_z), blue_leaves);
 					}
 				}
 			}
 		} else {
-			for (int xo = -2; xo <= 2; xo++) {
-				int totalX = x + xo;
-
-				for (int yo = -2; yo <= 2; yo++) {
-					int totalY = y + yo;
-
-					region.SetBlock(LongVector3(totalX, totalY, total_z), blue_leaves, to_remesh);
-				}
-			}
+			edits.FillBox(LongVector3(x - 2, y - 2, total_z), LongVector3(x + 2, y + 2, total_z), blue_leaves);
 		}
 	}
 
+	region.Commit(edits, to_remesh);
 	return 0;
 }
 
@@ -0,0 +1,85 @@
+#include "EditBatch.h"
+
+#include <tuple>
+
+cubewg::EditBatch::EditBatch(MemoryPool* pool) : pool(pool), zones(PoolAllocator<ZoneEntry>(pool)), last_zone(0, 0), last_buffer(nullptr), writes(0) {
+}
+
+cubewg::CubeBuffer& cubewg::EditBatch::BufferFor(int zone_x, int zone_y) {
+	const std::pair<int, int> zone(zone_x, zone_y);
+
+	// map nodes never move, so the pointer stays valid until the map is cleared
+	if (!last_buffer || last_zone != zone) {
+		last_zone = zone;
+		auto buffer = zones.find(zone);
+
+		if (buffer == zones.end()) {
+			buffer = zones.emplace(std::piecewise_construct, std::forward_as_tuple(zone), std::forward_as_tuple(pool)).first;
+		}
+
+		last_buffer = &buffer->second;
+	}
+
+	return *last_buffer;
+}
+
+void cubewg::EditBatch::SetBlock(LongVector3 block_pos, cube::Block block) {
+	const IntVector2 zone = cube::Zone::ZoneCoordsFromBlocks(block_pos.x, block_pos.y);
+	this->BufferFor(zone.x, zone.y).Set(IntVector3(pymod(block_pos.x, cube::BLOCKS_PER_ZONE), pymod(block_pos.y, cube::BLOCKS_PER_ZONE), block_pos.z), block);
+	writes++;
+}
+
+void cubewg::EditBatch::FillColumn(long long x, long long y, long long min_z, long long max_z, cube::Block block) {
+	this->FillBox(LongVector3(x, y, min_z), LongVector3(x, y, max_z), block);
+}
+
+void cubewg::EditBatch::FillBox(LongVector3 min, LongVector3 max, cube::Block block) {
+	if (min.x > max.x || min.y > max.y || min.z > max.z) return;
+
+	for (long long x = min.x; x <= max.x; x++) {
+		for (long long y = min.y; y <= max.y; y++) {
+			const IntVector2 zone = cube::Zone::ZoneCoordsFromBlocks(x, y);
+			this->BufferFor(zone.x, zone.y).SetColumn(pymod(x, cube::BLOCKS_PER_ZONE), pymod(y, cube::BLOCKS_PER_ZONE), (int)min.z, (int)max.z, block);
+		}
+	}
+
+	writes += (max.x - min.x + 1) * (max.y - min.y + 1) * (max.z - min.z + 1);
+}
+
+long long cubewg::EditBatch::GetWriteCount() const {
+	return writes;
+}
+
+long long cubewg::EditBatch::GetBlockCount() const {
+	long long blocks = 0;
+
+	for (const auto& zone : zones) {
+		blocks += (long long)zone.second.GetBlockCount();
+	}
+
+	return blocks;
+}
+
+int cubewg::EditBatch::GetZoneCount() const {
+	int count = 0;
+
+	for (const auto& zone : zones) {
+		if (!zone.second.IsEmpty()) count++;
+	}
+
+	return count;
+}
+
+void cubewg::EditBatch::Clear() {
+	// a zone and its neighbours
+	if (zones.size() > 9) {
+		zones.clear();
+	} else {
+		for (auto& zone : zones) {
+			zone.second.Clear();
+		}
+	}
+
+	last_buffer = nullptr;
+	writes = 0;
+}
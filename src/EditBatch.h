@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cwsdk.h>
+
+#include <map>
+#include <utility>
+
+#include "CubeBuffer.h"
+#include "MemoryPool.h"
+
+namespace cubewg {
+	/* Block writes collected to be applied to a WorldRegion at once, through WorldRegion::Commit.
+	 * Writes are grouped by the zone they land in and deduplicated as they are added (the last write to a position wins), so committing resolves each zone,
+	 * takes each lock and marks each zone to remesh once, rather than once per block.
+	 * Positions are the same as the region's: block positions for world regions, and zone-local positions (reaching into the 8 neighbours) for zone regions.
+	 */
+	class EditBatch {
+	private:
+		typedef std::pair<const std::pair<int, int>, CubeBuffer> ZoneEntry;
+
+		MemoryPool* pool;
+		// writes by the zone they land in, in zone-local positions
+		std::map<std::pair<int, int>, CubeBuffer, std::less<std::pair<int, int>>, PoolAllocator<ZoneEntry>> zones;
+		// structures write near where they last wrote, so the last zone written skips the map lookup
+		std::pair<int, int> last_zone;
+		CubeBuffer* last_buffer;
+		long long writes;
+
+		CubeBuffer& BufferFor(int zone_x, int zone_y);
+	public:
+		/* The batch's memory comes from the pool (usually the region's arena), or the heap if it is nullptr.
+		*/
+		explicit EditBatch(MemoryPool* pool = nullptr);
+
+		void SetBlock(LongVector3 block_pos, cube::Block block);
+
+		/* Sets every block in the column at [x, y] from min_z to max_z inclusive.
+		*/
+		void FillColumn(long long x, long long y, long long min_z, long long max_z, cube::Block block);
+
+		/* Sets every block in the box from min to max inclusive.
+		*/
+		void FillBox(LongVector3 min, LongVector3 max, cube::Block block);
+
+		/* Calls callback(zone, writes) for each zone written to, where writes is a CubeBuffer of the writes in zone-local positions.
+		 * Zones are absolute for world regions, and relative to the region's zone for zone regions.
+		 */
+		template <typename Callback>
+		void ForEachZone(Callback callback) const;
+
+		/* Removes every write. The buffers of the last few zones are kept for reuse, as a batch is usually reused near where it was last used.
+		*/
+		void Clear();
+
+		/* The number of blocks written, counting writes which replaced earlier ones, and the number of distinct positions written.
+		*/
+		long long GetWriteCount() const;
+		long long GetBlockCount() const;
+		int GetZoneCount() const;
+	};
+
+	template <typename Callback>
+	void EditBatch::ForEachZone(Callback callback) const {
+		for (const auto& zone : zones) {
+			// zones kept from before the last Clear may be empty
+			if (!zone.second.IsEmpty()) {
+				callback(IntVector2(zone.first.first, zone.first.second), zone.second);
+			}
+		}
+	}
+}
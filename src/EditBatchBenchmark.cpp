@@ -0,0 +1,58 @@
+#include "EditBatchBenchmark.h"
+
+#include <chrono>
+
+// edit batch benchmark: trees this far apart, so their leaves overlap, over a zone and half of each neighbour
+const int kEditTreeSpacing = 4;
+const int kEditRounds = 20;
+
+// The block BlockOf gives, without the world region it comes with.
+static cube::Block TreeBlock(int r, int g, int b, cube::Block::Type type) {
+	cube::Block block = {};
+	block.red = r;
+	block.green = g;
+	block.blue = b;
+	block.type = type;
+	block.breakable = false;
+	return block;
+}
+
+void cubewg::WriteBenchmarkTrees(EditBatch& edits) {
+	const cube::Block log = TreeBlock(130, 90, 0, cube::Block::Tree);
+	const cube::Block leaves = TreeBlock(0, 30, 140, cube::Block::Leaves);
+
+	for (int x = -cube::BLOCKS_PER_ZONE / 2; x < cube::BLOCKS_PER_ZONE * 3 / 2; x += kEditTreeSpacing) {
+		for (int y = -cube::BLOCKS_PER_ZONE / 2; y < cube::BLOCKS_PER_ZONE * 3 / 2; y += kEditTreeSpacing) {
+			edits.FillColumn(x, y, 0, 5, log);
+			edits.FillBox(LongVector3(x - 2, y - 2, 6), LongVector3(x + 2, y + 2, 8), leaves);
+			edits.FillBox(LongVector3(x - 1, y, 9), LongVector3(x + 1, y, 9), leaves);
+			edits.SetBlock(LongVector3(x, y - 1, 9), leaves);
+			edits.SetBlock(LongVector3(x, y + 1, 9), leaves);
+		}
+	}
+}
+
+std::wstring cubewg::BenchmarkEditBatch() {
+	EditBatch edits;
+	long long writes = 0;
+	long long blocks = 0;
+	int zones = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int round = 0; round < kEditRounds; round++) {
+		WriteBenchmarkTrees(edits);
+
+		// counting the blocks sorts out the overlaps, as committing would
+		writes += edits.GetWriteCount();
+		blocks += edits.GetBlockCount();
+		zones = edits.GetZoneCount();
+		edits.Clear();
+	}
+
+	auto end = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(end - start).count();
+
+	return L"edit batch: " + std::to_wstring((long long)(writes / seconds)) + L" writes/s, "
+		+ std::to_wstring(writes / kEditRounds) + L" writes to " + std::to_wstring(blocks / kEditRounds) + L" blocks in " + std::to_wstring(zones) + L" zones per batch\n";
+}
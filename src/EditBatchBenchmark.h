@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+#include "EditBatch.h"
+
+namespace cubewg {
+	/* Writes overlapping trees into the batch, over a zone and half of each neighbour, as DebugTree builds them.
+	*/
+	void WriteBenchmarkTrees(EditBatch& edits);
+
+	/* Measures how many writes per second an EditBatch takes, grouping and deduplicating them, for overlapping trees across a zone and its neighbours.
+	 * Runs without a world, so only the batch itself is measured, not committing it. Needs nothing from the game, so also builds as a program of its own: see benchmarks/.
+	 */
+	std::wstring BenchmarkEditBatch();
+}
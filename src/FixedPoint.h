@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+using std::int64_t;
+using std::uint64_t;
+
+namespace cubewg {
+	/* Signed 32.32 fixed point number. Gives the same result on every machine regardless of floating point settings.
+	 * Only provides the operations jittered grids need.
+	 */
+	struct FixedPoint {
+		static const int kFractionBits = 32;
+
+		int64_t raw;
+
+		FixedPoint() : raw(0) {
+		}
+
+		FixedPoint(int64_t value) : raw((int64_t)((uint64_t)value << kFractionBits)) {
+		}
+
+		explicit FixedPoint(double value) : raw((int64_t)(value * 4294967296.0)) {
+		}
+
+		static FixedPoint FromRaw(int64_t raw) {
+			FixedPoint result;
+			result.raw = raw;
+			return result;
+		}
+
+		double ToDouble() const {
+			return (double)raw * (1.0 / 4294967296.0);
+		}
+
+		// Rounds towards negative infinity.
+		int64_t Floor() const {
+			return raw >> kFractionBits;
+		}
+
+		FixedPoint operator+(FixedPoint other) const {
+			return FromRaw(raw + other.raw);
+		}
+
+		FixedPoint operator-(FixedPoint other) const {
+			return FromRaw(raw - other.raw);
+		}
+
+		FixedPoint operator*(FixedPoint other) const {
+			// 64 x 64 -> 128 bit multiply from 32 bit halves, as not every compiler we build with has a 128 bit integer.
+			const bool negative = (raw < 0) != (other.raw < 0);
+			const uint64_t a = raw < 0 ? 0 - (uint64_t)raw : (uint64_t)raw;
+			const uint64_t b = other.raw < 0 ? 0 - (uint64_t)other.raw : (uint64_t)other.raw;
+
+			const uint64_t a_high = a >> 32;
+			const uint64_t a_low = a & 0xFFFFFFFFULL;
+			const uint64_t b_high = b >> 32;
+			const uint64_t b_low = b & 0xFFFFFFFFULL;
+
+			const uint64_t product = (a_high * b_high << 32) + a_high * b_low + a_low * b_high + (a_low * b_low >> 32);
+			return FromRaw(negative ? (int64_t)(0 - product) : (int64_t)product);
+		}
+
+		bool operator<(FixedPoint other) const {
+			return raw < other.raw;
+		}
+
+		bool operator<=(FixedPoint other) const {
+			return raw <= other.raw;
+		}
+
+		bool operator==(FixedPoint other) const {
+			return raw == other.raw;
+		}
+	};
+}
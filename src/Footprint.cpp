@@ -0,0 +1,217 @@
+#include "Footprint.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Adds the y range at which the circle crosses the line at x, if it does.
+static void CircleInterval(double x, double centre_x, double centre_y, double radius, std::vector<cubewg::FootprintPoint>& intervals) {
+	const double dx = x - centre_x;
+	const double sqr_half_chord = radius * radius - dx * dx;
+
+	if (radius >= 0 && sqr_half_chord >= 0) {
+		const double half_chord = std::sqrt(sqr_half_chord);
+		intervals.push_back(cubewg::FootprintPoint(centre_y - half_chord, centre_y + half_chord));
+	}
+}
+
+// Adds the y range of a convex polygon within the strip [min_x, max_x], if it reaches the strip.
+static void ConvexStripInterval(const cubewg::FootprintPoint* vertices, int count, double min_x, double max_x, std::vector<cubewg::FootprintPoint>& intervals) {
+	double low = INFINITY;
+	double high = -INFINITY;
+
+	for (int i = 0; i < count; i++) {
+		const cubewg::FootprintPoint& a = vertices[i];
+		const cubewg::FootprintPoint& b = vertices[(i + 1) % count];
+
+		// vertices inside the strip
+		if (a.x >= min_x && a.x <= max_x) {
+			low = std::min(low, a.y);
+			high = std::max(high, a.y);
+		}
+
+		// edges crossing the sides of the strip
+		for (double side : { min_x, max_x }) {
+			if ((a.x < side) != (b.x < side)) {
+				const double y = a.y + (b.y - a.y) * (side - a.x) / (b.x - a.x);
+				low = std::min(low, y);
+				high = std::max(high, y);
+			}
+		}
+	}
+
+	if (low <= high) {
+		intervals.push_back(cubewg::FootprintPoint(low, high));
+	}
+}
+
+cubewg::Footprint cubewg::Footprint::Circle(double centre_x, double centre_y, double radius) {
+	Footprint footprint(Shape::CIRCLE, { FootprintPoint(centre_x, centre_y) });
+	footprint.outer_radius = radius;
+	return footprint;
+}
+
+cubewg::Footprint cubewg::Footprint::Annulus(double centre_x, double centre_y, double inner_radius, double outer_radius) {
+	Footprint footprint(Shape::ANNULUS, { FootprintPoint(centre_x, centre_y) });
+	footprint.inner_radius = inner_radius;
+	footprint.outer_radius = outer_radius;
+	return footprint;
+}
+
+cubewg::Footprint cubewg::Footprint::ConvexPolygon(std::vector<FootprintPoint> vertices) {
+	return Footprint(Shape::CONVEX_POLYGON, std::move(vertices));
+}
+
+cubewg::Footprint cubewg::Footprint::Polyline(std::vector<FootprintPoint> points, double half_width) {
+	Footprint footprint(Shape::POLYLINE, std::move(points));
+	footprint.half_width = half_width;
+	return footprint;
+}
+
+void cubewg::Footprint::Bounds(double& min_x, double& min_y, double& max_x, double& max_y) const {
+	min_x = min_y = INFINITY;
+	max_x = max_y = -INFINITY;
+
+	for (const FootprintPoint& point : points) {
+		min_x = std::min(min_x, point.x);
+		min_y = std::min(min_y, point.y);
+		max_x = std::max(max_x, point.x);
+		max_y = std::max(max_y, point.y);
+	}
+
+	// circles grow from their centre, lines by their width
+	const double grow = shape == Shape::POLYLINE ? half_width : outer_radius;
+	min_x -= grow;
+	min_y -= grow;
+	max_x += grow;
+	max_y += grow;
+}
+
+void cubewg::Footprint::RowIntervals(double x, double expand, std::vector<FootprintPoint>& intervals) const {
+	switch (shape) {
+	case Shape::CIRCLE:
+		CircleInterval(x, points[0].x, points[0].y, outer_radius + expand, intervals);
+		break;
+	case Shape::ANNULUS: {
+		std::vector<FootprintPoint> outer;
+		std::vector<FootprintPoint> inner;
+		CircleInterval(x, points[0].x, points[0].y, outer_radius + expand, outer);
+		// strictly inside the inner circle is outside the ring
+		CircleInterval(x, points[0].x, points[0].y, inner_radius - expand, inner);
+
+		if (outer.empty()) break;
+
+		if (inner.empty()) {
+			intervals.push_back(outer[0]);
+		} else {
+			// the hole splits the row in two, touching the hole's edges
+			intervals.push_back(FootprintPoint(outer[0].x, inner[0].x));
+			intervals.push_back(FootprintPoint(inner[0].y, outer[0].y));
+		}
+
+		break;
+	}
+	case Shape::CONVEX_POLYGON: {
+		// Growing a polygon by expand is covered by taking the strip either side of x, then growing the range by expand.
+		const size_t start = intervals.size();
+		ConvexStripInterval(points.data(), (int)points.size(), x - expand, x + expand, intervals);
+
+		for (size_t i = start; i < intervals.size(); i++) {
+			intervals[i].x -= expand;
+			intervals[i].y += expand;
+		}
+
+		break;
+	}
+	case Shape::POLYLINE: {
+		const double radius = half_width + expand;
+
+		// each segment is a capsule: a rectangle along it with a disc at each end. Capsules are convex, so their pieces cover one range per row.
+		for (size_t i = 0; i < points.size(); i++) {
+			const FootprintPoint& a = points[i];
+			FootprintPoint capsule(INFINITY, -INFINITY);
+			std::vector<FootprintPoint> pieces;
+
+			CircleInterval(x, a.x, a.y, radius, pieces);
+
+			if (i + 1 < points.size()) {
+				const FootprintPoint& b = points[i + 1];
+				const double length = std::sqrt((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+				CircleInterval(x, b.x, b.y, radius, pieces);
+
+				if (length > 0) {
+					// offset perpendicular to the segment
+					const double offset_x = -(b.y - a.y) / length * half_width;
+					const double offset_y = (b.x - a.x) / length * half_width;
+					const FootprintPoint rectangle[4] = {
+						FootprintPoint(a.x + offset_x, a.y + offset_y),
+						FootprintPoint(b.x + offset_x, b.y + offset_y),
+						FootprintPoint(b.x - offset_x, b.y - offset_y),
+						FootprintPoint(a.x - offset_x, a.y - offset_y)
+					};
+
+					const size_t start = pieces.size();
+					ConvexStripInterval(rectangle, 4, x - expand, x + expand, pieces);
+
+					for (size_t j = start; j < pieces.size(); j++) {
+						pieces[j].x -= expand;
+						pieces[j].y += expand;
+					}
+				}
+			}
+
+			for (const FootprintPoint& piece : pieces) {
+				capsule.x = std::min(capsule.x, piece.x);
+				capsule.y = std::max(capsule.y, piece.y);
+			}
+
+			if (capsule.x <= capsule.y) {
+				intervals.push_back(capsule);
+			}
+		}
+
+		break;
+	}
+	}
+}
+
+void cubewg::Footprint::Rasterise(int min_x, int min_y, int max_x, int max_y, double expand, std::vector<FootprintSpan>& spans) const {
+	if (points.empty()) return;
+
+	// only the rows the shape reaches
+	double shape_min_x, shape_min_y, shape_max_x, shape_max_y;
+	this->Bounds(shape_min_x, shape_min_y, shape_max_x, shape_max_y);
+
+	const int first_x = (int)std::max((double)min_x, std::ceil(shape_min_x - expand));
+	const int last_x = (int)std::min((double)max_x, std::floor(shape_max_x + expand));
+
+	std::vector<FootprintPoint> intervals;
+
+	for (int x = first_x; x <= last_x; x++) {
+		intervals.clear();
+		this->RowIntervals(x, expand, intervals);
+
+		// merge the ranges, clipped to the box, into spans of whole columns
+		std::sort(intervals.begin(), intervals.end(), [](const FootprintPoint& a, const FootprintPoint& b) { return a.x < b.x; });
+		int span_min_y = 0;
+		int span_max_y = min_y - 1;
+		bool open = false;
+
+		for (const FootprintPoint& interval : intervals) {
+			const int low = (int)std::max((double)min_y, std::ceil(interval.x));
+			const int high = (int)std::min((double)max_y, std::floor(interval.y));
+
+			if (low > high) continue;
+
+			if (open && low <= span_max_y + 1) {
+				span_max_y = std::max(span_max_y, high);
+			} else {
+				if (open) spans.push_back(FootprintSpan(x, span_min_y, span_max_y));
+				span_min_y = low;
+				span_max_y = high;
+				open = true;
+			}
+		}
+
+		if (open) spans.push_back(FootprintSpan(x, span_min_y, span_max_y));
+	}
+}
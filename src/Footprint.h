@@ -0,0 +1,73 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+namespace cubewg {
+	/* A run of columns at one x, from min_y to max_y inclusive. Runs along y to match the layout of zone->fields (x * 64 + y).
+	*/
+	struct FootprintSpan {
+		int x;
+		int min_y;
+		int max_y;
+
+		FootprintSpan(int x, int min_y, int max_y) : x(x), min_y(min_y), max_y(max_y) {
+		}
+	};
+
+	struct FootprintPoint {
+		double x;
+		double y;
+
+		FootprintPoint(double x, double y) : x(x), y(y) {
+		}
+	};
+
+	/* The shape a structure covers on the ground, in block coordinates. Rasterised into spans of the columns it covers, found analytically per row,
+	 * so structures can visit only the columns they cover rather than test every column in a zone.
+	 */
+	class Footprint {
+	public:
+		enum class Shape {
+			CIRCLE,
+			ANNULUS,
+			CONVEX_POLYGON,
+			// a line through the points, half_width either side. For streets.
+			POLYLINE
+		};
+
+	private:
+		Shape shape;
+		// the centre (circle, annulus) or vertices (polygon, polyline)
+		std::vector<FootprintPoint> points;
+		double inner_radius;
+		double outer_radius;
+		double half_width;
+
+		Footprint(Shape shape, std::vector<FootprintPoint> points) : shape(shape), points(std::move(points)), inner_radius(0), outer_radius(0), half_width(0) {
+		}
+
+		/* Appends the ranges of y (unsorted, possibly overlapping) at which the shape, grown by expand, crosses the line at x.
+		*/
+		void RowIntervals(double x, double expand, std::vector<FootprintPoint>& intervals) const;
+
+		// Bounds of the shape, not including expand.
+		void Bounds(double& min_x, double& min_y, double& max_x, double& max_y) const;
+	public:
+		static Footprint Circle(double centre_x, double centre_y, double radius);
+		/* The ring between the two radii, inclusive of both.
+		*/
+		static Footprint Annulus(double centre_x, double centre_y, double inner_radius, double outer_radius);
+		/* The vertices may go either way round.
+		*/
+		static Footprint ConvexPolygon(std::vector<FootprintPoint> vertices);
+		static Footprint Polyline(std::vector<FootprintPoint> points, double half_width);
+
+		/* Appends the spans of the integer positions in the box [min_x, min_y] to [max_x, max_y] (inclusive) which are inside the shape, one x at a time from min_x.
+		 * Positions on the edge count as inside. Spans at the same x never overlap.
+		 *
+		 * @param expand: grows the shape by at least this many blocks first. The spans are found in floating point, so callers which then test each column exactly can expand by a block to be sure no column is missed.
+		 */
+		void Rasterise(int min_x, int min_y, int max_x, int max_y, double expand, std::vector<FootprintSpan>& spans) const;
+	};
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+#include "Kernels.h"
+
+using std::int64_t;
+using std::uint32_t;
+using std::uint64_t;
+
+namespace cubewg {
+	/* The hash a jittered grid uses to place its points.
+	*/
+	enum class GridHash {
+		// The original chained multiply hash. Keeps the points of existing worlds where they are.
+		LEGACY,
+		// Counter-based hash. Each cell is hashed independently, so rows of cells are hashed in SIMD lanes. Places points differently to LEGACY.
+		COUNTER
+	};
+
+	/* Hash policies. Each provides:
+	 * - Random(seed, x, y): a 64 bit random number for the cell.
+	 * - RandomDouble(seed, x, y): a random number in [-1, 1] for the cell.
+	 * - RandomDoubles(seed, x, y, count, out): RandomDouble for the cells [x, y] to [x, y + count - 1].
+	 */
+
+	struct LegacyHash {
+		static int64_t Random(int64_t seed, int64_t x, int64_t y) {
+			// constants from MMIX, however the exact rng implementation differs
+			// computed unsigned as signed overflow is undefined behaviour, which optimisers are free to exploit
+			uint64_t state = (uint64_t)seed;
+			state *= state * 6364136223846793005ULL + 1442695040888963407ULL;
+			state += (uint64_t)x;
+			state *= state * 6364136223846793005ULL + 1442695040888963407ULL;
+			state += (uint64_t)y;
+			state *= state * 6364136223846793005ULL + 1442695040888963407ULL;
+			state += (uint64_t)x;
+			state *= state * 6364136223846793005ULL + 1442695040888963407ULL;
+			state += (uint64_t)y;
+			return (int64_t)state;
+		}
+
+		static double RandomDouble(int64_t seed, int64_t x, int64_t y) {
+			return (double)Random(seed, x, y) / (double)std::numeric_limits<int64_t>::max();
+		}
+
+		static void RandomDoubles(int64_t seed, int64_t x, int64_t y, int count, double* out) {
+			// every round depends on the last, so there is nothing to gain by batching
+			for (int i = 0; i < count; i++) {
+				out[i] = RandomDouble(seed, x, y + i);
+			}
+		}
+	};
+
+	struct CounterHash {
+		// How many cells are hashed together. 8 fills an AVX2 register of 32 bit lanes, or two SSE registers.
+		static const int kLanes = 8;
+
+		// Bijective 32 bit integer mix (lowbias32 by Chris Wellons).
+		static uint32_t Mix(uint32_t h) {
+			h ^= h >> 16;
+			h *= 0x7FEB352DU;
+			h ^= h >> 15;
+			h *= 0x846CA68BU;
+			h ^= h >> 16;
+			return h;
+		}
+
+		static uint32_t Key(int64_t seed) {
+			return Mix(Mix((uint32_t)seed) ^ (uint32_t)((uint64_t)seed >> 32));
+		}
+
+		// The hash of cell [x, y] is Mix(row + y * golden ratio) where the row is the hash of x, so a row of cells shares all work but one mix.
+		static uint32_t Row(uint32_t key, int64_t x) {
+			return Mix(key ^ (uint32_t)x);
+		}
+
+		static uint32_t Cell(uint32_t row, int64_t y) {
+			return Mix(row + (uint32_t)y * 0x9E3779B9U);
+		}
+
+		static double ToDouble(uint32_t hash) {
+			// multiply rather than divide, and a 32 bit conversion which SSE2 can do 2 (AVX 4) at a time
+			return (double)(int32_t)hash * (1.0 / 2147483648.0);
+		}
+
+		static int64_t Random(int64_t seed, int64_t x, int64_t y) {
+			uint64_t high = Cell(Row(Key(seed), x), y);
+			uint64_t low = Cell(Row(Key(~seed), x), y);
+			return (int64_t)(high << 32 | low);
+		}
+
+		static double RandomDouble(int64_t seed, int64_t x, int64_t y) {
+			return ToDouble(Cell(Row(Key(seed), x), y));
+		}
+
+		static void RandomDoubles(int64_t seed, int64_t x, int64_t y, int count, double* out) {
+			const uint32_t row = Row(Key(seed), x);
+			int i = 0;
+
+			// fixed width blocks with no dependencies between lanes, which compilers turn into SIMD
+			for (; i + kLanes <= count; i += kLanes) {
+				for (int lane = 0; lane < kLanes; lane++) {
+					out[i + lane] = ToDouble(Cell(row, y + i + lane));
+				}
+			}
+
+			for (; i < count; i++) {
+				out[i] = ToDouble(Cell(row, y + i));
+			}
+		}
+	};
+
+	// Dispatch to the policy a grid was created with. Rows go through the kernels for the CPU, see Kernels.h.
+
+	inline int64_t Random(GridHash hash, int64_t seed, int64_t x, int64_t y) {
+		return hash == GridHash::COUNTER ? CounterHash::Random(seed, x, y) : LegacyHash::Random(seed, x, y);
+	}
+
+	inline double RandomDouble(GridHash hash, int64_t seed, int64_t x, int64_t y) {
+		return hash == GridHash::COUNTER ? CounterHash::RandomDouble(seed, x, y) : LegacyHash::RandomDouble(seed, x, y);
+	}
+
+	inline void RandomDoubles(GridHash hash, int64_t seed, int64_t x, int64_t y, int count, double* out) {
+		if (hash == GridHash::COUNTER) {
+			GetKernels().counter_doubles(seed, x, y, count, out);
+		} else {
+			GetKernels().legacy_doubles(seed, x, y, count, out);
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#include "GridHashBenchmark.h"
+
+#include <chrono>
+#include <vector>
+
+#include "GridHash.h"
+
+// grid hash benchmark: cells are hashed in rows, as the tile sampler does
+const int kHashRowLength = 64;
+const int kHashRows = 1 << 16;
+const int kHashBuckets = 64;
+
+template <typename Hash>
+static std::wstring BenchmarkGridHash(const wchar_t* name) {
+	std::vector<double> values((size_t)kHashRows * kHashRowLength);
+	std::vector<double> next_stream(values.size());
+
+	// time hashing into a single row, so memory bandwidth doesn't hide the cost of the hash
+	double row[kHashRowLength];
+	double sink = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int x = 0; x < kHashRows; x++) {
+		Hash::RandomDoubles(0, x, 0, kHashRowLength, row);
+		sink += row[x % kHashRowLength];
+	}
+
+	auto end = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(end - start).count();
+
+	for (int x = 0; x < kHashRows; x++) {
+		Hash::RandomDoubles(0, x, 0, kHashRowLength, &values[(size_t)x * kHashRowLength]);
+	}
+
+	// the grid takes x and y offsets from the seed and seed + 1 streams, so they should not correlate either
+	for (int x = 0; x < kHashRows; x++) {
+		Hash::RandomDoubles(1, x, 0, kHashRowLength, &next_stream[(size_t)x * kHashRowLength]);
+	}
+
+	// uniform on [-1, 1] has mean 0 and variance 1/3
+	double sum = 0;
+	double sqr_sum = 0;
+	double neighbour_product_sum = 0;
+	double stream_product_sum = 0;
+	std::vector<long> buckets(kHashBuckets, 0);
+
+	for (size_t i = 0; i < values.size(); i++) {
+		double value = values[i];
+		sum += value;
+		sqr_sum += value * value;
+		stream_product_sum += value * next_stream[i];
+
+		if (i % kHashRowLength != 0) {
+			neighbour_product_sum += value * values[i - 1];
+		}
+
+		int bucket = (int)((value + 1.0) * 0.5 * kHashBuckets);
+		buckets[bucket < 0 ? 0 : (bucket >= kHashBuckets ? kHashBuckets - 1 : bucket)]++;
+	}
+
+	const double count = (double)values.size();
+	const double mean = sum / count;
+	const double variance = sqr_sum / count - mean * mean;
+	// correlation of values with their neighbour in the row, and with the same cell in the next stream
+	const double neighbour_correlation = (neighbour_product_sum / (count - kHashRows) - mean * mean) / variance;
+	const double stream_correlation = (stream_product_sum / count - mean * mean) / variance;
+
+	// chi-squared against uniform buckets. Should be near the degrees of freedom (buckets - 1).
+	const double expected = count / kHashBuckets;
+	double chi_squared = 0;
+
+	for (long observed : buckets) {
+		chi_squared += (observed - expected) * (observed - expected) / expected;
+	}
+
+	// the sink is printed so the timed loop can't be optimised out
+	return std::wstring(name) + L": " + std::to_wstring((long long)(count / seconds)) + L" cells/s (sink " + std::to_wstring(sink) + L")"
+		+ L", mean " + std::to_wstring(mean)
+		+ L", variance " + std::to_wstring(variance) + L" (1/3)"
+		+ L", chi2(" + std::to_wstring(kHashBuckets - 1) + L") " + std::to_wstring(chi_squared)
+		+ L", neighbour corr " + std::to_wstring(neighbour_correlation)
+		+ L", stream corr " + std::to_wstring(stream_correlation) + L"\n";
+}
+
+std::wstring cubewg::BenchmarkGridHashes() {
+	return BenchmarkGridHash<LegacyHash>(L"legacy") + BenchmarkGridHash<CounterHash>(L"counter");
+}
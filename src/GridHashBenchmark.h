@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+namespace cubewg {
+	/* Measures the throughput (cells per second) and basic statistical quality of each jittered grid hash policy.
+	 * Needs nothing from the game, so also builds as a program of its own: see benchmarks/.
+	 */
+	std::wstring BenchmarkGridHashes();
+}
@@ -0,0 +1,205 @@
+#include "HeightmapCache.h"
+
+#include <algorithm>
+
+#include "ColumnView.h"
+
+static bool FitsTile(int height) {
+	return height >= INT16_MIN && height <= INT16_MAX;
+}
+
+static uint64_t PackColumn(const int column[cubewg::kHeightmapCount]) {
+	uint64_t word = 0;
+
+	for (int heightmap = 0; heightmap < cubewg::kHeightmapCount; heightmap++) {
+		word |= (uint64_t)(uint16_t)(int16_t)column[heightmap] << (16 * heightmap);
+	}
+
+	return word;
+}
+
+static int UnpackHeight(uint64_t word, cubewg::Heightmap heightmap) {
+	return (int16_t)(uint16_t)(word >> (16 * (int)heightmap));
+}
+
+int cubewg::HeightmapTile::Get(cube::Zone* zone, int x, int y, Heightmap heightmap) {
+	const int field_index = x * cube::BLOCKS_PER_ZONE + y;
+	uint64_t word = columns[field_index].load(std::memory_order_acquire);
+
+	if (!(word & kStale)) {
+		return UnpackHeight(word, heightmap);
+	}
+
+	int column[kHeightmapCount];
+	HeightmapCache::ComputeColumn(zone->fields[field_index], column);
+
+	// Heights which don't fit leave the column stale, so it is computed every time.
+	// Published with the version it was computed at, only if no Invalidate has bumped that since; if one has, the column stays stale.
+	if (FitsTile(column[0]) && FitsTile(column[1]) && FitsTile(column[2])) {
+		const uint64_t fresh = (word & ~(kVersionOne - 1)) | PackColumn(column);
+		columns[field_index].compare_exchange_strong(word, fresh, std::memory_order_release, std::memory_order_relaxed);
+	}
+
+	return column[(int)heightmap];
+}
+
+void cubewg::HeightmapTile::Invalidate(int min_x, int min_y, int max_x, int max_y) {
+	min_x = std::max(min_x, 0);
+	min_y = std::max(min_y, 0);
+	max_x = std::min(max_x, cube::BLOCKS_PER_ZONE - 1);
+	max_y = std::min(max_y, cube::BLOCKS_PER_ZONE - 1);
+
+	for (int x = min_x; x <= max_x; x++) {
+		for (int y = min_y; y <= max_y; y++) {
+			std::atomic<uint64_t>& word = columns[x * cube::BLOCKS_PER_ZONE + y];
+			uint64_t current = word.load(std::memory_order_relaxed);
+
+			// the version wraps off the top
+			while (!word.compare_exchange_weak(current, (current | kStale) + kVersionOne, std::memory_order_release, std::memory_order_relaxed)) {
+			}
+		}
+	}
+}
+
+void cubewg::HeightmapTile::Fill(cube::Zone* zone) {
+	int column[kHeightmapCount];
+
+	for (int i = 0; i < kSize; i++) {
+		HeightmapCache::ComputeColumn(zone->fields[i], column);
+		const bool fits = FitsTile(column[0]) && FitsTile(column[1]) && FitsTile(column[2]);
+		columns[i].store(fits ? PackColumn(column) : kStale, std::memory_order_relaxed);
+	}
+
+	// publishes the heights to threads which get the tile without the cache's lock
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+cubewg::HeightmapCache::HeightmapCache() : tiles_made(0) {
+}
+
+std::shared_ptr<cubewg::HeightmapTile> cubewg::HeightmapCache::Get(cube::Zone* zone) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto tile = tiles.find(zone->position);
+
+		if (tile != tiles.end()) {
+			return tile->second;
+		}
+	}
+
+	// filled outside the lock. If another thread makes the zone's tile meanwhile, theirs is kept.
+	std::shared_ptr<HeightmapTile> tile = std::make_shared<HeightmapTile>();
+	tile->Fill(zone);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto inserted = tiles.emplace(zone->position, tile);
+
+	// counted after it can be found, see GetTilesMade
+	if (inserted.second) {
+		tiles_made++;
+	}
+
+	return inserted.first->second;
+}
+
+std::shared_ptr<cubewg::HeightmapTile> cubewg::HeightmapCache::Find(const IntVector2& zone_position) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto tile = tiles.find(zone_position);
+	return tile == tiles.end() ? nullptr : tile->second;
+}
+
+void cubewg::HeightmapCache::Evict(const IntVector2& zone_position) {
+	std::lock_guard<std::mutex> lock(mutex);
+	tiles.erase(zone_position);
+}
+
+size_t cubewg::HeightmapCache::GetTileCount() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return tiles.size();
+}
+
+long long cubewg::HeightmapCache::GetTilesMade() {
+	return tiles_made.load();
+}
+
+void cubewg::HeightmapCache::ComputeColumn(const cube::Field& field, int heights[kHeightmapCount]) {
+	const ColumnView column(field);
+	const int base_z = column.GetBaseZ();
+	int z;
+
+	// First block with air/plant above it is world surface.
+	// Start at 1 as cannot return below base_z
+	if (column.FindUp(base_z + 1, base_z + 63, [](const cube::Block* block) { return !block || block->type == cube::Block::Air || block->type == cube::Block::Leaves; }, z)) {
+		heights[(int)Heightmap::WORLD_SURFACE] = z - 1;
+	} else {
+		heights[(int)Heightmap::WORLD_SURFACE] = kNoPosition;
+	}
+
+	// Search from top to bottom. If nothing is found, assume heightmap is at the base position.
+	if (column.FindDown(base_z, base_z + 63, [](const cube::Block* block) { return block && block->type != cube::Block::Air; }, z)) {
+		heights[(int)Heightmap::MOTION_BLOCKING] = z;
+
+		// Ocean floor goes through liquids, so carries on down from there.
+		if (!column.FindDown(base_z, z, [](const cube::Block* block) { return block && block->type != cube::Block::Air && block->type != cube::Block::Water && block->type != cube::Block::Lava; }, z)) {
+			z = base_z;
+		}
+
+		heights[(int)Heightmap::OCEAN_FLOOR] = z;
+	} else {
+		heights[(int)Heightmap::MOTION_BLOCKING] = base_z;
+		heights[(int)Heightmap::OCEAN_FLOOR] = base_z;
+	}
+}
+
+int cubewg::HeightmapCache::ScanColumn(cube::Zone* zone, int x, int y, Heightmap heightmap) {
+	int field_index = x * cube::BLOCKS_PER_ZONE + y;
+	cube::Field* field = &zone->fields[field_index];
+	int base_z = field->base_z;
+
+	cube::Block* blocc;
+
+	switch (heightmap) {
+	case Heightmap::WORLD_SURFACE:
+		// First block with air/plant above it is world surface.
+		// Start at 1 as cannot return below base_z
+		for (int zo = 1; zo < 64; zo++) {
+			blocc = zone->GetBlock(IntVector3(x, y, base_z + zo));
+
+			if (!blocc || blocc->type == cube::Block::Air || blocc->type == cube::Block::Leaves) {
+				return base_z + zo - 1;
+			}
+		}
+
+		// No block found
+		// Assume no position.
+		return cubewg::kNoPosition;
+	case Heightmap::MOTION_BLOCKING:
+	case Heightmap::OCEAN_FLOOR:
+		// Search from top to bottom.
+		for (int zo = 63; zo >= 0; zo--) {
+			blocc = zone->GetBlock(IntVector3(x, y, base_z + zo));
+
+			if (blocc) {
+				if (blocc->type != cube::Block::Air) {
+					switch (heightmap) {
+					case Heightmap::MOTION_BLOCKING:
+						return base_z + zo;
+					case Heightmap::OCEAN_FLOOR:
+						// Ocean floor goes through liquids.
+						if (blocc->type != cube::Block::Water && blocc->type != cube::Block::Lava) {
+							return base_z + zo;
+						}
+
+						break;
+					}
+				}
+			}
+		}
+
+		// No block found
+		// Assume heightmap is at the base position.
+		return base_z;
+	default:
+		return cubewg::kNoPosition;
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cwsdk.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "WorldRegion.h"
+
+namespace cubewg {
+	const int kHeightmapCount = 3;
+
+	/* The heights of every column of a zone, for every heightmap, as GetHeight would return them.
+	 * Columns changed since they were computed are marked stale, and recomputed the next time they are asked for.
+	 * The heights are atomic only so neighbouring zones' generation can mark columns stale while this zone reads them; they are as consistent as the fields they come from.
+	 */
+	struct HeightmapTile {
+		static const int kSize = cube::BLOCKS_PER_ZONE * cube::BLOCKS_PER_ZONE;
+
+		// A column's word: its three heights as int16s from bit 0 in Heightmap order, then a bit marking it stale, then a version Invalidate bumps.
+		static const uint64_t kStale = (uint64_t)1 << 48;
+		static const uint64_t kVersionOne = (uint64_t)1 << 49;
+
+		/* Indexed the same as zone->fields. Each column is one word, so a column computed before an Invalidate can't be published after it:
+		 * Get only publishes by swapping in the word it started from, which the Invalidate has changed. Heights which don't fit leave the column stale.
+		 */
+		std::atomic<uint64_t> columns[kSize];
+
+		/* Gets the height of the column, recomputing it from the zone's fields if stale.
+		*/
+		int Get(cube::Zone* zone, int x, int y, Heightmap heightmap);
+
+		/* Marks the columns in the box [min_x, min_y] to [max_x, max_y] (inclusive) stale.
+		*/
+		void Invalidate(int min_x, int min_y, int max_x, int max_y);
+
+		/* Computes every column from the zone's fields, in one pass.
+		*/
+		void Fill(cube::Zone* zone);
+	};
+
+	/* Heightmap tiles by zone, made when a zone's heights are first asked for and dropped when the zone unloads.
+	*/
+	class HeightmapCache {
+	private:
+		std::mutex mutex;
+		std::unordered_map<IntVector2, std::shared_ptr<HeightmapTile>> tiles;
+		std::atomic<long long> tiles_made;
+	public:
+		HeightmapCache();
+
+		/* Gets the zone's tile, making and filling it if there isn't one.
+		*/
+		std::shared_ptr<HeightmapTile> Get(cube::Zone* zone);
+
+		/* Gets the tile of the zone at the given position, or nullptr if there isn't one.
+		*/
+		std::shared_ptr<HeightmapTile> Find(const IntVector2& zone_position);
+
+		void Evict(const IntVector2& zone_position);
+
+		size_t GetTileCount();
+
+		/* How many tiles have ever been made. Lets holders of a missing tile tell whether it might exist now without searching.
+		*/
+		long long GetTilesMade();
+
+		/* Computes the heights of a column from its field directly, through a ColumnView.
+		 * Writes the heights (as ints) for each heightmap into heights.
+		 */
+		static void ComputeColumn(const cube::Field& field, int heights[kHeightmapCount]);
+
+		/* Computes the height of a column by asking the zone for each block in turn, as GetHeight did before heights were cached. For benchmarks and checks.
+		*/
+		static int ScanColumn(cube::Zone* zone, int x, int y, Heightmap heightmap);
+	};
+}
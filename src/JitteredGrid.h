@@ -1,39 +1,233 @@
 #pragma once
 
 #include <cstdint>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <ratio>
+#include <type_traits>
+
+#include "GridHash.h"
+#include "FixedPoint.h"
+#include "JitteredPoint.h"
+#include "JitteredPointCache.h"
 
 using std::int64_t;
 
 namespace cubewg {
-	struct JitteredPoint {
-		// the x position of this point
-		double x;
-		// this y position of this point
-		double y;
-		// an additional random number associated with this point
-		int64_t data;
-
-		JitteredPoint(double x, double y, int64_t data) {
-			this->x = x;
-			this->y = y;
-			this->data = data;
+	// Marks a grid parameter as chosen at runtime (through the constructor) rather than at compile time.
+	struct DynamicParameter {};
+
+	// Search radius which searches the same grid areas as the original JitteredGrid: 3x3 for FindNearestPoint, 5x5 without corners for SqrDist2Nearest and 5x5 for Worley2.
+	const int kLegacySearchRadius = -1;
+	// Search radius which is derived at compile time from the relaxation. Needs a compile time relaxation.
+	const int kDerivedSearchRadius = 0;
+
+	// The different searches a grid does, which may cover different grid areas.
+	enum class GridSearch {
+		NEAREST_POINT,
+		NEAREST_DISTANCE,
+		WORLEY
+	};
+
+	/* Per axis, a point with relaxation r lies within [area + 1.5r - 1, area + 1 - 0.5r], so it is within 2 - 1.5r of anywhere in its own area.
+	 * A grid area k areas away from the search centre is at least k + 1.5r - 2 away from anywhere in the centre area.
+	 */
+	constexpr double AxisGap(int offset, double relaxation) {
+		return (offset < 0 ? -offset : offset) + 1.5 * relaxation - 2 > 0 ? (offset < 0 ? -offset : offset) + 1.5 * relaxation - 2 : 0;
+	}
+
+	/* The furthest (squared) the nearest point can be: its own area's point. For the second nearest, the furthest of that and an adjacent area's point.
+	*/
+	constexpr double SqrSearchBound(double relaxation, bool second) {
+		return second
+			? (3 - 1.5 * relaxation) * (3 - 1.5 * relaxation) + (2 - 1.5 * relaxation) * (2 - 1.5 * relaxation)
+			: 2 * (2 - 1.5 * relaxation) * (2 - 1.5 * relaxation);
+	}
+
+	/* Whether the grid area [xo, yo] from the search centre may hold the nearest point (or second nearest, if second is set) to some position in the centre area.
+	*/
+	constexpr bool MayHoldNearest(int xo, int yo, double relaxation, bool second) {
+		return AxisGap(xo, relaxation) * AxisGap(xo, relaxation) + AxisGap(yo, relaxation) * AxisGap(yo, relaxation) <= SqrSearchBound(relaxation, second);
+	}
+
+	constexpr int DerivedSearchRadius(double relaxation, bool second) {
+		int radius = 0;
+
+		while (MayHoldNearest(radius + 1, 0, relaxation, second)) {
+			radius++;
+		}
+
+		return radius;
+	}
+
+	/* A grid parameter. Either a std::ratio known at compile time, or DynamicParameter for a value set at runtime.
+	*/
+	template <typename Ratio>
+	struct GridParameter {
+		static constexpr double kValue = (double)Ratio::num / (double)Ratio::den;
+
+		double Get() const {
+			return kValue;
+		}
+
+		void Set(double /*value*/) {
+			// fixed at compile time
+		}
+	};
+
+	template <>
+	struct GridParameter<DynamicParameter> {
+		double value = 0;
+
+		double Get() const {
+			return value;
+		}
+
+		void Set(double value) {
+			this->value = value;
 		}
 	};
 
-	class JitteredGrid {
+	/* The grid areas covered by each search, given the grid's relaxation and search radius parameters.
+	*/
+	template <typename Relaxation, int SearchRadius>
+	struct GridSearchArea {
+		// explicit radius: a full square for every search
+		static constexpr int Radius(GridSearch /*search*/) {
+			return SearchRadius;
+		}
+
+		static constexpr bool Contains(int /*xo*/, int /*yo*/, GridSearch /*search*/) {
+			return true;
+		}
+	};
+
+	template <typename Relaxation>
+	struct GridSearchArea<Relaxation, kLegacySearchRadius> {
+		static constexpr int Radius(GridSearch search) {
+			return search == GridSearch::NEAREST_POINT ? 1 : 2;
+		}
+
+		static constexpr bool Contains(int xo, int yo, GridSearch search) {
+			return search != GridSearch::NEAREST_DISTANCE || !((xo == 2 || xo == -2) && (yo == 2 || yo == -2));
+		}
+	};
+
+	template <typename Relaxation>
+	struct GridSearchArea<Relaxation, kDerivedSearchRadius> {
+		static_assert(!std::is_same<Relaxation, DynamicParameter>::value, "The search radius can only be derived from a compile time relaxation.");
+
+		static constexpr int Radius(GridSearch search) {
+			return DerivedSearchRadius(GridParameter<Relaxation>::kValue, search == GridSearch::WORLEY);
+		}
+
+		static constexpr bool Contains(int xo, int yo, GridSearch search) {
+			return MayHoldNearest(xo, yo, GridParameter<Relaxation>::kValue, search == GridSearch::WORLEY);
+		}
+	};
+
+	// Conversions between grid precisions and double.
+
+	inline int64_t FloorToInt(double value) {
+		return (int64_t)std::floor(value);
+	}
+
+	inline int64_t FloorToInt(float value) {
+		return (int64_t)std::floor(value);
+	}
+
+	inline int64_t FloorToInt(FixedPoint value) {
+		return value.Floor();
+	}
+
+	inline double ToDouble(double value) {
+		return value;
+	}
+
+	inline double ToDouble(float value) {
+		return value;
+	}
+
+	inline double ToDouble(FixedPoint value) {
+		return value.ToDouble();
+	}
+
+	/* Inner loops of tile sampling. For each of the count positions [x, ys[i]] with dx = point_x - x, lowers dists[i] to the squared distance to the point if it is nearer.
+	 * Double precision goes through the kernels for the CPU (see Kernels.h), which give identical results.
+	 */
+	template <typename Real>
+	void NearestRun(Real dx, Real point_y, const Real* ys, int count, Real* dists) {
+		for (int i = 0; i < count; i++) {
+			const Real dy = point_y - ys[i];
+			const Real point_dist = dx * dx + dy * dy;
+
+			dists[i] = point_dist < dists[i] ? point_dist : dists[i];
+		}
+	}
+
+	inline void NearestRun(double dx, double point_y, const double* ys, int count, double* dists) {
+		GetKernels().nearest_run(dx, point_y, ys, count, dists);
+	}
+
+	/* As NearestRun, but keeps the nearest distance in dists and the second nearest in dists_2.
+	*/
+	template <typename Real>
+	void WorleyRun(Real dx, Real point_y, const Real* ys, int count, Real* dists, Real* dists_2) {
+		for (int i = 0; i < count; i++) {
+			const Real dy = point_y - ys[i];
+			const Real point_dist = dx * dx + dy * dy;
+
+			// branchless form of the insertion in Worley2. min/max return one of their inputs, so the values are identical.
+			dists_2[i] = std::min(dists_2[i], std::max(dists[i], point_dist));
+			dists[i] = std::min(dists[i], point_dist);
+		}
+	}
+
+	inline void WorleyRun(double dx, double point_y, const double* ys, int count, double* dists, double* dists_2) {
+		GetKernels().worley_run(dx, point_y, ys, count, dists, dists_2);
+	}
+
+	/* Jittered grid with its precision and parameters chosen at compile time. Inputs and outputs are always doubles; Real is the precision of the search in between.
+	 *
+	 * @param Real: double, float or FixedPoint.
+	 * @param Relaxation: std::ratio of how much to move points on the grid towards the average, or DynamicParameter.
+	 * @param Scale: std::ratio of how much to scale input/output, or DynamicParameter.
+	 * @param SearchRadius: how many grid areas to search around the input. kDerivedSearchRadius searches only the areas that can hold the result, so relaxed grids search fewer areas.
+	 */
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius = kDerivedSearchRadius>
+	class BasicJitteredGrid {
 	private:
+		typedef GridSearchArea<Relaxation, SearchRadius> SearchArea;
+
 		int64_t seed;
 		// How much to move points on the grid towards the average.
-		double relaxation;
+		GridParameter<Relaxation> relaxation;
 		// Scale of the grid. That is, how much to scale input/output.
 		// Inputs are scaled DOWN by this amount and outputs are then scaled UP.
-		double scale;
+		GridParameter<Scale> scale;
+		// The hash used to place points.
+		GridHash hash;
+		// Optional cache of points. Shared between copies of this grid.
+		std::shared_ptr<JitteredPointCache> cache;
 	public:
-		JitteredGrid(const int64_t seed);
-		JitteredGrid(const int64_t seed, const double relaxation);
-		JitteredGrid(const int64_t seed, const double relaxation, const double scale);
+		BasicJitteredGrid(const int64_t seed, const GridHash hash = GridHash::LEGACY) {
+			this->seed = seed;
+			this->relaxation.Set(0);
+			this->scale.Set(1);
+			this->hash = hash;
+		}
+
+		template <typename R = Relaxation, typename S = Scale, typename = typename std::enable_if<std::is_same<R, DynamicParameter>::value && std::is_same<S, DynamicParameter>::value>::type>
+		BasicJitteredGrid(const int64_t seed, const double relaxation, const double scale = 1, const GridHash hash = GridHash::LEGACY) {
+			this->seed = seed;
+			this->relaxation.Set(relaxation);
+			this->scale.Set(scale);
+			this->hash = hash;
+		}
 
-		/* Samples the point on the jittered grid at the given coordinates. The jittered point is guaranteed to fall within this grid space.
+		/* Samples the point on the jittered grid at the given coordinates, relative to the grid area.
 		*/
 		JitteredPoint SampleGrid(int64_t grid_x, int64_t grid_y);
 
@@ -41,12 +235,475 @@ namespace cubewg {
 		*/
 		JitteredPoint FindNearestPoint(double x, double y);
 
+		/* Samples the nearest jittered point to the given coordinates, also giving the grid area it is in, which identifies the point.
+		*/
+		JitteredPoint FindNearestPoint(double x, double y, int64_t& grid_x, int64_t& grid_y);
+
 		/* Get the euclidean square distance to the nearest point on this jittered grid.
 		*/
 		double SqrDist2Nearest(double x, double y);
 
+		/* Get the euclidean square distance to the point in the given grid area. Calculated the same way as SqrDist2Nearest, so the results compare exactly.
+		*/
+		double SqrDist2Cell(int64_t grid_x, int64_t grid_y, double x, double y);
+
 		/* Samples 'd2-d1' type cellular noise using the points on this jittered grid. Uses euclidean squared distance.
 		*/
 		double Worley2(double x, double y);
+
+		/* Computes SqrDist2Nearest for every integer position in the width x height tile starting at [origin_x, origin_y].
+		 * The jittered points are only sampled once for the whole tile. Results are identical to calling SqrDist2Nearest per position.
+		 *
+		 * @param out: at least width * height doubles. The result for [origin_x + x, origin_y + y] is written to out[x * height + y].
+		 */
+		void SqrDist2NearestTile(double origin_x, double origin_y, int width, int height, double* out);
+
+		/* Computes Worley2 for every integer position in the width x height tile starting at [origin_x, origin_y].
+		 * The jittered points are only sampled once for the whole tile. Results are identical to calling Worley2 per position.
+		 *
+		 * @param out: at least width * height doubles. The result for [origin_x + x, origin_y + y] is written to out[x * height + y].
+		 */
+		void Worley2Tile(double origin_x, double origin_y, int width, int height, double* out);
+
+		/* Lists every jittered point within margin of the box [min_x, min_y] to [max_x, max_y], i.e. whose circle of radius margin overlaps the box.
+		 * Only visits the grid areas whose points could land that close, so a box far from any point costs a few hashes.
+		 *
+		 * @param callback: called with each point found (scaled up, as FindNearestPoint returns) and the grid area it is in: callback(point, grid_x, grid_y).
+		 * @return the number of points found.
+		 */
+		template <typename Callback>
+		int PointsInRect(double min_x, double min_y, double max_x, double max_y, double margin, Callback callback);
+
+		/* Enables caching of this grid's points by grid area, with the given number of cache slots. Copies of this grid made afterwards share the cache.
+		*/
+		void EnableCache(const int capacity);
+
+		/* Gets the point cache of this grid, or nullptr if caching is not enabled.
+		*/
+		JitteredPointCache* GetCache() const;
+
+		// Lower level access, for noise built on top of the grid. Positions here are unscaled, i.e. in grid areas.
+
+		typedef Real RealType;
+
+		double GetRelaxation() const {
+			return this->relaxation.Get();
+		}
+
+		double GetScale() const {
+			return this->scale.Get();
+		}
+
+		/* Gets the unscaled jittered point in the given grid area, through the cache if enabled.
+		*/
+		void CellPoint(int64_t grid_x, int64_t grid_y, Real& point_x, Real& point_y);
+
+		/* Gets the unscaled jittered points in the grid areas [grid_x, grid_y] to [grid_x, grid_y + count - 1]. Hashes the whole row at once when not caching.
+		*/
+		void CellRow(int64_t grid_x, int64_t grid_y, int count, Real* xs, Real* ys);
+
+		/* Gets the data of the jittered point in the given grid area, through the cache if enabled.
+		*/
+		int64_t CellData(int64_t grid_x, int64_t grid_y);
+
+	private:
+		/* Shared implementation of the tile methods.
+		*/
+		void SampleTile(double origin_x, double origin_y, int width, int height, double* out, bool worley);
 	};
+
+	/* The original jittered grid, with all parameters chosen at runtime and searching the same grid areas as always.
+	*/
+	typedef BasicJitteredGrid<double, DynamicParameter, DynamicParameter, kLegacySearchRadius> JitteredGrid;
+
+	// instantiated once in JitteredGrid.cpp
+	extern template class BasicJitteredGrid<double, DynamicParameter, DynamicParameter, kLegacySearchRadius>;
+
+	// methods
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	void BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::EnableCache(const int capacity) {
+		this->cache = std::make_shared<JitteredPointCache>(capacity);
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	JitteredPointCache* BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::GetCache() const {
+		return this->cache.get();
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	void BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::CellPoint(int64_t grid_x, int64_t grid_y, Real& point_x, Real& point_y) {
+		// the cache holds the random jitter of each point rather than its position, so it is exact for every precision
+		JitteredPoint jitter(0, 0, 0);
+
+		if (!this->cache || !this->cache->Get(grid_x, grid_y, jitter)) {
+			jitter.x = RandomDouble(this->hash, this->seed, grid_x, grid_y);
+			jitter.y = RandomDouble(this->hash, this->seed + 1, grid_x, grid_y);
+
+			if (this->cache) {
+				jitter.data = Random(this->hash, this->seed + 2, grid_x, grid_y);
+				this->cache->Put(grid_x, grid_y, jitter);
+			}
+		}
+
+		const Real relaxation_offset = Real(this->relaxation.Get() * 0.5);
+		const Real unrelaxation = Real(1.0 - this->relaxation.Get()); // the "opposite" of the relaxation in weighting the values
+		point_x = Real(grid_x) + relaxation_offset + unrelaxation * Real(jitter.x);
+		point_y = Real(grid_y) + relaxation_offset + unrelaxation * Real(jitter.y);
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	void BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::CellRow(int64_t grid_x, int64_t grid_y, int count, Real* xs, Real* ys) {
+		if (this->cache) {
+			for (int i = 0; i < count; i++) {
+				this->CellPoint(grid_x, grid_y + i, xs[i], ys[i]);
+			}
+
+			return;
+		}
+
+		const Real relaxation_offset = Real(this->relaxation.Get() * 0.5);
+		const Real unrelaxation = Real(1.0 - this->relaxation.Get());
+
+		// hash in chunks so the hashes can be made in doubles whatever the precision
+		const int kChunk = 64;
+		double jitter_xs[kChunk];
+		double jitter_ys[kChunk];
+
+		for (int start = 0; start < count; start += kChunk) {
+			const int chunk = std::min(kChunk, count - start);
+
+			RandomDoubles(this->hash, this->seed, grid_x, grid_y + start, chunk, jitter_xs);
+			RandomDoubles(this->hash, this->seed + 1, grid_x, grid_y + start, chunk, jitter_ys);
+
+			for (int i = 0; i < chunk; i++) {
+				xs[start + i] = Real(grid_x) + relaxation_offset + unrelaxation * Real(jitter_xs[i]);
+				ys[start + i] = Real(grid_y + start + i) + relaxation_offset + unrelaxation * Real(jitter_ys[i]);
+			}
+		}
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	int64_t BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::CellData(int64_t grid_x, int64_t grid_y) {
+		JitteredPoint jitter(0, 0, 0);
+
+		if (this->cache && this->cache->Get(grid_x, grid_y, jitter)) {
+			return jitter.data;
+		}
+
+		return Random(this->hash, this->seed + 2, grid_x, grid_y);
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	JitteredPoint BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::SampleGrid(int64_t grid_x, int64_t grid_y) {
+		double unrelaxation = 1.0 - this->relaxation.Get(); // the "opposite" of the relaxation in weighting the values
+		return JitteredPoint(
+			this->relaxation.Get() * 0.5 + unrelaxation * RandomDouble(this->hash, this->seed, grid_x, grid_y),
+			this->relaxation.Get() * 0.5 + unrelaxation * RandomDouble(this->hash, this->seed + 1, grid_x, grid_y),
+			Random(this->hash, this->seed + 2, grid_x, grid_y));
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	JitteredPoint BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::FindNearestPoint(double x, double y) {
+		int64_t grid_x, grid_y;
+		return this->FindNearestPoint(x, y, grid_x, grid_y);
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	JitteredPoint BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::FindNearestPoint(double x, double y, int64_t& grid_x, int64_t& grid_y) {
+		// Scale down inputs
+		const Real scaled_x = Real(x / this->scale.Get());
+		const Real scaled_y = Real(y / this->scale.Get());
+
+		// coordinates of the grid area in the centre of the search. I.e. the grid area the point is actually in.
+		const int64_t cgrid_x = FloorToInt(scaled_x);
+		const int64_t cgrid_y = FloorToInt(scaled_y);
+
+		Real result_x = Real(0.0);
+		Real result_y = Real(0.0);
+		int64_t result_grid_x = 0;
+		int64_t result_grid_y = 0;
+		Real result_dist = Real(1000.0); // 1000 is an insanely high value we can't possibly get, so it's used as a placeholder
+
+		const int radius = SearchArea::Radius(GridSearch::NEAREST_POINT);
+
+		for (int xo = -radius; xo <= radius; xo++) {
+			const int64_t grid_x = cgrid_x + xo;
+
+			for (int yo = -radius; yo <= radius; yo++) {
+				if (!SearchArea::Contains(xo, yo, GridSearch::NEAREST_POINT)) continue;
+
+				const int64_t grid_y = cgrid_y + yo;
+
+				Real point_x, point_y;
+				this->CellPoint(grid_x, grid_y, point_x, point_y);
+
+				const Real dx = point_x - scaled_x;
+				const Real dy = point_y - scaled_y;
+				const Real point_dist = dx * dx + dy * dy;
+
+				if (point_dist < result_dist) {
+					result_x = point_x;
+					result_y = point_y;
+					result_grid_x = grid_x;
+					result_grid_y = grid_y;
+					result_dist = point_dist;
+				}
+			}
+		}
+
+		grid_x = result_grid_x;
+		grid_y = result_grid_y;
+
+		// Scale up output position
+		return JitteredPoint(ToDouble(result_x) * this->scale.Get(), ToDouble(result_y) * this->scale.Get(), this->CellData(result_grid_x, result_grid_y));
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	double BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::SqrDist2Nearest(double x, double y) {
+		// Scale down inputs
+		const Real scaled_x = Real(x / this->scale.Get());
+		const Real scaled_y = Real(y / this->scale.Get());
+
+		// coordinates of the grid area in the centre of the search. I.e. the grid area the point is actually in.
+		const int64_t cgrid_x = FloorToInt(scaled_x);
+		const int64_t cgrid_y = FloorToInt(scaled_y);
+
+		Real result_dist = Real(1000.0); // 1000 is an insanely high value we can't possibly get, so it's used as a placeholder
+
+		const int radius = SearchArea::Radius(GridSearch::NEAREST_DISTANCE);
+
+		for (int xo = -radius; xo <= radius; xo++) {
+			const int64_t grid_x = cgrid_x + xo;
+
+			for (int yo = -radius; yo <= radius; yo++) {
+				if (!SearchArea::Contains(xo, yo, GridSearch::NEAREST_DISTANCE)) continue;
+
+				const int64_t grid_y = cgrid_y + yo;
+
+				Real point_x, point_y;
+				this->CellPoint(grid_x, grid_y, point_x, point_y);
+
+				const Real dx = point_x - scaled_x;
+				const Real dy = point_y - scaled_y;
+				const Real point_dist = dx * dx + dy * dy;
+
+				if (point_dist < result_dist) {
+					result_dist = point_dist;
+				}
+			}
+		}
+
+		// Scale up output
+		// Uses squared distance so to scale up value a by factor k for expression a^2, we must multiply by square
+		// (a * k) ^2 = a^2 * k^2
+		return ToDouble(result_dist) * (this->scale.Get() * this->scale.Get());
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	double BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::SqrDist2Cell(int64_t grid_x, int64_t grid_y, double x, double y) {
+		// Scale down inputs
+		const Real scaled_x = Real(x / this->scale.Get());
+		const Real scaled_y = Real(y / this->scale.Get());
+
+		Real point_x, point_y;
+		this->CellPoint(grid_x, grid_y, point_x, point_y);
+
+		const Real dx = point_x - scaled_x;
+		const Real dy = point_y - scaled_y;
+
+		// Scale up output, see SqrDist2Nearest
+		return ToDouble(dx * dx + dy * dy) * (this->scale.Get() * this->scale.Get());
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	double BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::Worley2(double x, double y) {
+		// Scale down inputs
+		const Real scaled_x = Real(x / this->scale.Get());
+		const Real scaled_y = Real(y / this->scale.Get());
+
+		// coordinates of the grid area in the centre of the search. I.e. the grid area the point is actually in.
+		const int64_t cgrid_x = FloorToInt(scaled_x);
+		const int64_t cgrid_y = FloorToInt(scaled_y);
+
+		Real result_dist = Real(1000.0); // 1000 is an insanely high value we can't possibly get, so it's used as a placeholder
+		Real result_dist_2 = Real(1000.0); // Again, a placeholder high value. This will be the second closest distance.
+
+		const int radius = SearchArea::Radius(GridSearch::WORLEY);
+
+		for (int xo = -radius; xo <= radius; xo++) {
+			const int64_t grid_x = cgrid_x + xo;
+
+			for (int yo = -radius; yo <= radius; yo++) {
+				if (!SearchArea::Contains(xo, yo, GridSearch::WORLEY)) continue;
+
+				const int64_t grid_y = cgrid_y + yo;
+
+				Real point_x, point_y;
+				this->CellPoint(grid_x, grid_y, point_x, point_y);
+
+				const Real dx = point_x - scaled_x;
+				const Real dy = point_y - scaled_y;
+				const Real point_dist = dx * dx + dy * dy;
+
+				if (point_dist <= result_dist) {
+					result_dist_2 = result_dist;
+					result_dist = point_dist;
+				} else if (point_dist < result_dist_2) {
+					result_dist_2 = point_dist;
+				}
+			}
+		}
+
+		Real result = result_dist_2 - result_dist;
+
+		// Scale up output
+		// Uses squared distance so to scale up value a by factor k for expression a^2, we must multiply by square
+		// (a * k) ^2 = a^2 * k^2
+		return ToDouble(result) * (this->scale.Get() * this->scale.Get());
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	template <typename Callback>
+	int BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::PointsInRect(double min_x, double min_y, double max_x, double max_y, double margin, Callback callback) {
+		const double scale = this->scale.Get();
+		const double relaxation = this->relaxation.Get();
+
+		// A point lies within [area + 1.5r - 1, area + 1 - 0.5r] on each axis (see AxisGap), so only areas whose range meets the box grown by the margin can hold a match.
+		const double jitter_min = 1.5 * relaxation - 1;
+		const double jitter_max = 1 - 0.5 * relaxation;
+
+		const int64_t min_grid_x = (int64_t)std::floor((min_x - margin) / scale - jitter_max);
+		const int64_t min_grid_y = (int64_t)std::floor((min_y - margin) / scale - jitter_max);
+		const int64_t max_grid_x = (int64_t)std::floor((max_x + margin) / scale - jitter_min);
+		const int64_t max_grid_y = (int64_t)std::floor((max_y + margin) / scale - jitter_min);
+
+		int found = 0;
+
+		for (int64_t grid_x = min_grid_x; grid_x <= max_grid_x; grid_x++) {
+			for (int64_t grid_y = min_grid_y; grid_y <= max_grid_y; grid_y++) {
+				Real point_x, point_y;
+				this->CellPoint(grid_x, grid_y, point_x, point_y);
+
+				// Scale up to compare against the box
+				const double x = ToDouble(point_x) * scale;
+				const double y = ToDouble(point_y) * scale;
+
+				// distance from the point to the nearest position in the box, per axis
+				const double dx = std::max(0.0, std::max(min_x - x, x - max_x));
+				const double dy = std::max(0.0, std::max(min_y - y, y - max_y));
+
+				if (dx * dx + dy * dy <= margin * margin) {
+					found++;
+					callback(JitteredPoint(x, y, this->CellData(grid_x, grid_y)), grid_x, grid_y);
+				}
+			}
+		}
+
+		return found;
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	void BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::SqrDist2NearestTile(double origin_x, double origin_y, int width, int height, double* out) {
+		this->SampleTile(origin_x, origin_y, width, height, out, false);
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	void BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::Worley2Tile(double origin_x, double origin_y, int width, int height, double* out) {
+		this->SampleTile(origin_x, origin_y, width, height, out, true);
+	}
+
+	template <typename Real, typename Relaxation, typename Scale, int SearchRadius>
+	void BasicJitteredGrid<Real, Relaxation, Scale, SearchRadius>::SampleTile(double origin_x, double origin_y, int width, int height, double* out, bool worley) {
+		if (width <= 0 || height <= 0) return;
+
+		const GridSearch search = worley ? GridSearch::WORLEY : GridSearch::NEAREST_DISTANCE;
+		const int radius = SearchArea::Radius(search);
+
+		// Scale down inputs, once per column and row rather than once per position.
+		std::vector<Real> xs(width);
+		std::vector<int64_t> cgrid_xs(width);
+		std::vector<Real> ys(height);
+		std::vector<int64_t> cgrid_ys(height);
+
+		for (int x = 0; x < width; x++) {
+			xs[x] = Real((origin_x + x) / this->scale.Get());
+			cgrid_xs[x] = FloorToInt(xs[x]);
+		}
+
+		for (int y = 0; y < height; y++) {
+			ys[y] = Real((origin_y + y) / this->scale.Get());
+			cgrid_ys[y] = FloorToInt(ys[y]);
+		}
+
+		// Sample every point within the search area of any position in the tile. Stored as separate x and y arrays so the loops below vectorise.
+		const int64_t min_grid_x = *std::min_element(cgrid_xs.begin(), cgrid_xs.end()) - radius;
+		const int64_t min_grid_y = *std::min_element(cgrid_ys.begin(), cgrid_ys.end()) - radius;
+		const int points_width = (int)(*std::max_element(cgrid_xs.begin(), cgrid_xs.end()) + radius - min_grid_x) + 1;
+		const int points_height = (int)(*std::max_element(cgrid_ys.begin(), cgrid_ys.end()) + radius - min_grid_y) + 1;
+
+		std::vector<Real> point_xs(points_width * points_height);
+		std::vector<Real> point_ys(points_width * points_height);
+
+		for (int i = 0; i < points_width; i++) {
+			this->CellRow(min_grid_x + i, min_grid_y, points_height, &point_xs[i * points_height], &point_ys[i * points_height]);
+		}
+
+		// Same placeholder values as the per-position methods. The second array holds the second closest distance for worley.
+		std::vector<Real> result_dists(width * height, Real(1000.0));
+		std::vector<Real> result_dists_2(worley ? width * height : 0, Real(1000.0));
+
+		// Positions sharing a grid area share the same search area, so walk the tile in runs of equal grid x and grid y.
+		for (int x_start = 0; x_start < width;) {
+			const int64_t cgrid_x = cgrid_xs[x_start];
+			int x_end = x_start;
+			while (x_end < width && cgrid_xs[x_end] == cgrid_x) x_end++;
+
+			for (int y_start = 0; y_start < height;) {
+				const int64_t cgrid_y = cgrid_ys[y_start];
+				int y_end = y_start;
+				while (y_end < height && cgrid_ys[y_end] == cgrid_y) y_end++;
+
+				for (int xo = -radius; xo <= radius; xo++) {
+					for (int yo = -radius; yo <= radius; yo++) {
+						if (!SearchArea::Contains(xo, yo, search)) continue;
+
+						const int point_index = (int)(cgrid_x + xo - min_grid_x) * points_height + (int)(cgrid_y + yo - min_grid_y);
+						const Real point_x = point_xs[point_index];
+						const Real point_y = point_ys[point_index];
+
+						for (int x = x_start; x < x_end; x++) {
+							const Real dx = point_x - xs[x];
+							Real* result_dist = result_dists.data() + x * height;
+
+							if (worley) {
+								Real* result_dist_2 = result_dists_2.data() + x * height;
+
+								WorleyRun(dx, point_y, &ys[y_start], y_end - y_start, result_dist + y_start, result_dist_2 + y_start);
+							} else {
+								NearestRun(dx, point_y, &ys[y_start], y_end - y_start, result_dist + y_start);
+							}
+						}
+					}
+				}
+
+				y_start = y_end;
+			}
+
+			x_start = x_end;
+		}
+
+		// Scale up output, see SqrDist2Nearest
+		const double sqr_scale = this->scale.Get() * this->scale.Get();
+
+		if (worley) {
+			for (int i = 0; i < width * height; i++) {
+				out[i] = ToDouble(result_dists_2[i] - result_dists[i]) * sqr_scale;
+			}
+		} else {
+			for (int i = 0; i < width * height; i++) {
+				out[i] = ToDouble(result_dists[i]) * sqr_scale;
+			}
+		}
+	}
 }
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+using std::int64_t;
+
+namespace cubewg {
+	struct JitteredPoint {
+		// the x position of this point
+		double x;
+		// this y position of this point
+		double y;
+		// an additional random number associated with this point
+		int64_t data;
+
+		JitteredPoint(double x, double y, int64_t data) {
+			this->x = x;
+			this->y = y;
+			this->data = data;
+		}
+	};
+}
@@ -0,0 +1,87 @@
+#include "JitteredPointCache.h"
+
+cubewg::JitteredPointCache::JitteredPointCache(const int capacity) : hits(0), misses(0) {
+	uint64_t slot_count = 1;
+
+	while (slot_count < (uint64_t)capacity) {
+		slot_count <<= 1;
+	}
+
+	this->mask = slot_count - 1;
+	this->slots = std::unique_ptr<Slot[]>(new Slot[slot_count]);
+
+	for (uint64_t i = 0; i < slot_count; i++) {
+		this->slots[i].version.store(0, std::memory_order_relaxed);
+	}
+}
+
+cubewg::JitteredPointCache::Slot& cubewg::JitteredPointCache::SlotFor(int64_t grid_x, int64_t grid_y) const {
+	// mix both coordinates into the high bits, then fold them down so neighbouring areas land in different slots
+	uint64_t hash = (uint64_t)grid_x * 0x9E3779B97F4A7C15ULL ^ (uint64_t)grid_y * 0xC2B2AE3D27D4EB4FULL;
+	hash ^= hash >> 32;
+	return this->slots[hash & this->mask];
+}
+
+bool cubewg::JitteredPointCache::Get(int64_t grid_x, int64_t grid_y, JitteredPoint& point) {
+	Slot& slot = this->SlotFor(grid_x, grid_y);
+
+	uint64_t version = slot.version.load(std::memory_order_acquire);
+
+	if (version != 0 && (version & 1) == 0) {
+		int64_t slot_grid_x = slot.grid_x.load(std::memory_order_relaxed);
+		int64_t slot_grid_y = slot.grid_y.load(std::memory_order_relaxed);
+		double x = slot.x.load(std::memory_order_relaxed);
+		double y = slot.y.load(std::memory_order_relaxed);
+		int64_t data = slot.data.load(std::memory_order_relaxed);
+
+		// if the version is unchanged, nothing was written while reading
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (slot.version.load(std::memory_order_relaxed) == version && slot_grid_x == grid_x && slot_grid_y == grid_y) {
+			this->hits.fetch_add(1, std::memory_order_relaxed);
+			point = JitteredPoint(x, y, data);
+			return true;
+		}
+	}
+
+	this->misses.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+void cubewg::JitteredPointCache::Put(int64_t grid_x, int64_t grid_y, const JitteredPoint& point) {
+	Slot& slot = this->SlotFor(grid_x, grid_y);
+
+	uint64_t version = slot.version.load(std::memory_order_relaxed);
+
+	// mark the slot as being written. Someone else is already writing it if odd, or if the exchange fails.
+	if ((version & 1) != 0 || !slot.version.compare_exchange_strong(version, version + 1, std::memory_order_acquire)) {
+		return;
+	}
+
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.grid_x.store(grid_x, std::memory_order_relaxed);
+	slot.grid_y.store(grid_y, std::memory_order_relaxed);
+	slot.x.store(point.x, std::memory_order_relaxed);
+	slot.y.store(point.y, std::memory_order_relaxed);
+	slot.data.store(point.data, std::memory_order_relaxed);
+
+	slot.version.store(version + 2, std::memory_order_release);
+}
+
+int cubewg::JitteredPointCache::GetCapacity() const {
+	return (int)(this->mask + 1);
+}
+
+uint64_t cubewg::JitteredPointCache::GetHits() const {
+	return this->hits.load(std::memory_order_relaxed);
+}
+
+uint64_t cubewg::JitteredPointCache::GetMisses() const {
+	return this->misses.load(std::memory_order_relaxed);
+}
+
+void cubewg::JitteredPointCache::ResetCounters() {
+	this->hits.store(0, std::memory_order_relaxed);
+	this->misses.store(0, std::memory_order_relaxed);
+}
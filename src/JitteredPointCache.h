@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+#include "JitteredPoint.h"
+
+namespace cubewg {
+	/* Bounded, direct-mapped cache of the jittered points of a grid, keyed by grid area. Each grid area maps to one slot, and a new point simply replaces whatever was in its slot.
+	 * Grids store the random jitter of each point in [-1, 1] (before relaxation) as its x and y, so cached points are exact for every grid precision.
+	 * Safe to share between threads. Reads never lock: each slot is a seqlock, and a read that races a write is treated as a miss.
+	 */
+	class JitteredPointCache {
+	private:
+		struct Slot {
+			// even when stable, odd while a write is in progress. 0 means the slot has never been written.
+			std::atomic<uint64_t> version;
+			std::atomic<int64_t> grid_x;
+			std::atomic<int64_t> grid_y;
+			std::atomic<double> x;
+			std::atomic<double> y;
+			std::atomic<int64_t> data;
+		};
+
+		std::unique_ptr<Slot[]> slots;
+		// slot count - 1. The slot count is always a power of two.
+		uint64_t mask;
+
+		std::atomic<uint64_t> hits;
+		std::atomic<uint64_t> misses;
+
+		Slot& SlotFor(int64_t grid_x, int64_t grid_y) const;
+	public:
+		/* Creates a cache with at least the given number of slots. The capacity is rounded up to a power of two.
+		*/
+		JitteredPointCache(const int capacity);
+
+		/* Looks up the point for the given grid area. Returns whether it was found, in which case it is written to point.
+		*/
+		bool Get(int64_t grid_x, int64_t grid_y, JitteredPoint& point);
+
+		/* Stores the point for the given grid area. If another thread is writing the same slot, the point is dropped instead of waiting.
+		*/
+		void Put(int64_t grid_x, int64_t grid_y, const JitteredPoint& point);
+
+		int GetCapacity() const;
+		uint64_t GetHits() const;
+		uint64_t GetMisses() const;
+		void ResetCounters();
+	};
+}
@@ -0,0 +1,307 @@
+#include "Kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <cwctype>
+#include <random>
+#include <vector>
+
+#include "GridHash.h"
+
+// The same kernel bodies are compiled for each instruction set through target attributes, rather than separate files built with /arch flags:
+// inline functions the bodies call (such as the hashes) would otherwise be compiled with AVX in those files, and the linker may keep that copy for everyone.
+// MSVC has no target attributes, so builds with it only have the SSE2 kernels.
+#if (defined(__clang__) || defined(__GNUC__)) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define CUBEWG_MULTI_ISA 1
+#define CUBEWG_ALWAYS_INLINE inline __attribute__((always_inline))
+#define CUBEWG_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CUBEWG_MULTI_ISA 0
+#define CUBEWG_ALWAYS_INLINE inline
+#endif
+
+// Results must be identical on every instruction set, so a * b + c must never become a fused multiply-add (which AVX-512 implies).
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+using namespace cubewg;
+
+// Kernel bodies. Written as plain loops for the compiler to vectorise with whichever instruction set the function it is inlined into targets.
+
+static CUBEWG_ALWAYS_INLINE void NearestRunBody(double dx, double point_y, const double* ys, int count, double* dists) {
+	for (int i = 0; i < count; i++) {
+		const double dy = point_y - ys[i];
+		const double point_dist = dx * dx + dy * dy;
+
+		dists[i] = point_dist < dists[i] ? point_dist : dists[i];
+	}
+}
+
+static CUBEWG_ALWAYS_INLINE void WorleyRunBody(double dx, double point_y, const double* ys, int count, double* dists, double* dists_2) {
+	for (int i = 0; i < count; i++) {
+		const double dy = point_y - ys[i];
+		const double point_dist = dx * dx + dy * dy;
+
+		// min/max return one of their inputs, so every instruction set gives the same values
+		dists_2[i] = std::min(dists_2[i], std::max(dists[i], point_dist));
+		dists[i] = std::min(dists[i], point_dist);
+	}
+}
+
+static CUBEWG_ALWAYS_INLINE void LegacyDoublesBody(int64_t seed, int64_t x, int64_t y, int count, double* out) {
+	for (int i = 0; i < count; i++) {
+		out[i] = LegacyHash::RandomDouble(seed, x, y + i);
+	}
+}
+
+static CUBEWG_ALWAYS_INLINE void CounterDoublesBody(int64_t seed, int64_t x, int64_t y, int count, double* out) {
+	const uint32_t row = CounterHash::Row(CounterHash::Key(seed), x);
+
+	for (int i = 0; i < count; i++) {
+		out[i] = CounterHash::ToDouble(CounterHash::Cell(row, y + i));
+	}
+}
+
+// One set of entry points per instruction set. The target may be empty, for the baseline.
+#define CUBEWG_DEFINE_KERNELS(name, isa, target) \
+	target static void name##NearestRun(double dx, double point_y, const double* ys, int count, double* dists) { \
+		NearestRunBody(dx, point_y, ys, count, dists); \
+	} \
+	target static void name##WorleyRun(double dx, double point_y, const double* ys, int count, double* dists, double* dists_2) { \
+		WorleyRunBody(dx, point_y, ys, count, dists, dists_2); \
+	} \
+	target static void name##LegacyDoubles(int64_t seed, int64_t x, int64_t y, int count, double* out) { \
+		LegacyDoublesBody(seed, x, y, count, out); \
+	} \
+	target static void name##CounterDoubles(int64_t seed, int64_t x, int64_t y, int count, double* out) { \
+		CounterDoublesBody(seed, x, y, count, out); \
+	} \
+	static const KernelTable k##name##Kernels = { isa, name##NearestRun, name##WorleyRun, name##LegacyDoubles, name##CounterDoubles };
+
+CUBEWG_DEFINE_KERNELS(Sse2, KernelIsa::SSE2, )
+
+#if CUBEWG_MULTI_ISA
+CUBEWG_DEFINE_KERNELS(Avx2, KernelIsa::AVX2, CUBEWG_TARGET("avx2"))
+CUBEWG_DEFINE_KERNELS(Avx512, KernelIsa::AVX512, CUBEWG_TARGET("avx512f,avx512dq,avx512vl"))
+#endif
+
+// CPU feature detection
+
+#if CUBEWG_MULTI_ISA
+static void Cpuid(uint32_t leaf, uint32_t subleaf, uint32_t registers[4]) {
+	__asm__ __volatile__("cpuid" : "=a"(registers[0]), "=b"(registers[1]), "=c"(registers[2]), "=d"(registers[3]) : "a"(leaf), "c"(subleaf));
+}
+
+// Which register states the OS saves on a context switch. Without that, instructions using those registers can't be used even if the CPU has them.
+static uint64_t XGetBv() {
+	uint32_t low, high;
+	__asm__ __volatile__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+	return (uint64_t)high << 32 | low;
+}
+
+static bool CpuSupports(KernelIsa isa) {
+	if (isa == KernelIsa::SSE2) return true;
+
+	uint32_t registers[4];
+	Cpuid(0, 0, registers);
+	if (registers[0] < 7) return false;
+
+	Cpuid(1, 0, registers);
+	const bool osxsave = (registers[2] >> 27) & 1;
+	const bool avx = (registers[2] >> 28) & 1;
+	if (!osxsave || !avx) return false;
+
+	const uint64_t os_state = XGetBv();
+	// XMM and YMM state
+	if ((os_state & 0x6) != 0x6) return false;
+
+	Cpuid(7, 0, registers);
+	const bool avx2 = (registers[1] >> 5) & 1;
+	if (isa == KernelIsa::AVX2) return avx2;
+
+	const bool avx512f = (registers[1] >> 16) & 1;
+	const bool avx512dq = (registers[1] >> 17) & 1;
+	const bool avx512vl = (registers[1] >> 31) & 1;
+	// opmask and ZMM state
+	return avx2 && avx512f && avx512dq && avx512vl && (os_state & 0xE0) == 0xE0;
+}
+#else
+static bool CpuSupports(KernelIsa isa) {
+	return isa == KernelIsa::SSE2;
+}
+#endif
+
+// Binding
+
+static std::atomic<const KernelTable*> current_kernels(&kSse2Kernels);
+// results of the self-check in InitKernels
+static bool passed_self_check[kKernelIsaCount] = { false, false, false };
+static bool forced = false;
+
+const KernelTable& cubewg::GetKernels() {
+	return *current_kernels.load(std::memory_order_acquire);
+}
+
+const KernelTable* cubewg::GetKernelTable(KernelIsa isa) {
+	if (!CpuSupports(isa)) return nullptr;
+
+	switch (isa) {
+	case KernelIsa::SSE2:
+		return &kSse2Kernels;
+#if CUBEWG_MULTI_ISA
+	case KernelIsa::AVX2:
+		return &kAvx2Kernels;
+	case KernelIsa::AVX512:
+		return &kAvx512Kernels;
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+bool cubewg::CheckKernels(KernelIsa isa) {
+	const KernelTable* kernels = GetKernelTable(isa);
+	if (!kernels) return false;
+
+	// fixed seed so a failure can be reproduced
+	std::mt19937_64 random(1);
+	std::uniform_real_distribution<double> coordinate(-4.0, 4.0);
+	std::uniform_int_distribution<int64_t> cell(-((int64_t)1 << 40), (int64_t)1 << 40);
+
+	// lengths either side of every vector width, up to the row length a tile uses
+	const int kMaxCount = 67;
+	std::vector<double> ys(kMaxCount), dists(kMaxCount), dists_2(kMaxCount), expected(kMaxCount), expected_2(kMaxCount);
+
+	for (int count = 0; count <= kMaxCount; count++) {
+		for (int trial = 0; trial < 16; trial++) {
+			const double dx = coordinate(random);
+			const double point_y = coordinate(random);
+
+			for (int i = 0; i < count; i++) {
+				ys[i] = coordinate(random);
+				// some ties with the point's distance, and the placeholder distance the grid starts with
+				dists[i] = i % 5 == 0 ? 1000.0 : (i % 7 == 0 ? dx * dx + (point_y - ys[i]) * (point_y - ys[i]) : coordinate(random) * coordinate(random));
+				dists_2[i] = std::max(dists[i], i % 3 == 0 ? 1000.0 : dists[i] + coordinate(random) * coordinate(random));
+			}
+
+			// scalar reference: the same calculation as the per-position methods of JitteredGrid
+			for (int i = 0; i < count; i++) {
+				const double dy = point_y - ys[i];
+				const double point_dist = dx * dx + dy * dy;
+
+				expected_2[i] = dists_2[i];
+				expected[i] = dists[i];
+
+				if (point_dist < expected[i]) {
+					expected_2[i] = expected[i];
+					expected[i] = point_dist;
+				} else if (point_dist < expected_2[i]) {
+					expected_2[i] = point_dist;
+				}
+			}
+
+			std::vector<double> nearest(dists);
+			kernels->nearest_run(dx, point_y, ys.data(), count, nearest.data());
+			kernels->worley_run(dx, point_y, ys.data(), count, dists.data(), dists_2.data());
+
+			if (std::memcmp(nearest.data(), expected.data(), count * sizeof(double)) != 0
+				|| std::memcmp(dists.data(), expected.data(), count * sizeof(double)) != 0
+				|| std::memcmp(dists_2.data(), expected_2.data(), count * sizeof(double)) != 0) {
+				return false;
+			}
+
+			const int64_t seed = cell(random);
+			const int64_t x = cell(random);
+			const int64_t y = cell(random);
+
+			for (int i = 0; i < count; i++) {
+				expected[i] = LegacyHash::RandomDouble(seed, x, y + i);
+				expected_2[i] = CounterHash::RandomDouble(seed, x, y + i);
+			}
+
+			kernels->legacy_doubles(seed, x, y, count, dists.data());
+			kernels->counter_doubles(seed, x, y, count, dists_2.data());
+
+			if (std::memcmp(dists.data(), expected.data(), count * sizeof(double)) != 0
+				|| std::memcmp(dists_2.data(), expected_2.data(), count * sizeof(double)) != 0) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool cubewg::ForceKernels(KernelIsa isa) {
+	const KernelTable* kernels = GetKernelTable(isa);
+	if (!kernels || !passed_self_check[(int)isa]) return false;
+
+	current_kernels.store(kernels, std::memory_order_release);
+	forced = true;
+	return true;
+}
+
+void cubewg::InitKernels() {
+	const KernelTable* best = &kSse2Kernels;
+
+	for (int i = 0; i < kKernelIsaCount; i++) {
+		passed_self_check[i] = CheckKernels((KernelIsa)i);
+
+		if (passed_self_check[i]) {
+			best = GetKernelTable((KernelIsa)i);
+		}
+	}
+
+	current_kernels.store(best, std::memory_order_release);
+	forced = false;
+
+	const char* force = std::getenv("CUBEWG_KERNEL_ISA");
+	KernelIsa isa;
+
+	if (force && ParseKernelIsa(std::wstring(force, force + std::strlen(force)), isa)) {
+		ForceKernels(isa);
+	}
+}
+
+const wchar_t* cubewg::GetKernelIsaName(KernelIsa isa) {
+	switch (isa) {
+	case KernelIsa::AVX2:
+		return L"AVX2";
+	case KernelIsa::AVX512:
+		return L"AVX512";
+	default:
+		return L"SSE2";
+	}
+}
+
+bool cubewg::ParseKernelIsa(const std::wstring& name, KernelIsa& isa) {
+	for (int i = 0; i < kKernelIsaCount; i++) {
+		const wchar_t* isa_name = GetKernelIsaName((KernelIsa)i);
+
+		if (name.size() == std::wcslen(isa_name) && std::equal(name.begin(), name.end(), isa_name, [](wchar_t a, wchar_t b) { return std::towupper((wint_t)a) == (wint_t)b; })) {
+			isa = (KernelIsa)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+std::wstring cubewg::DescribeKernels() {
+	std::wstring description;
+
+	for (int i = 0; i < kKernelIsaCount; i++) {
+		const KernelIsa isa = (KernelIsa)i;
+
+		description += std::wstring(GetKernelIsaName(isa)) + L": "
+			+ (GetKernelTable(isa) ? (passed_self_check[i] ? L"supported, self-check passed" : L"supported, self-check FAILED") : L"not supported")
+			+ L"\n";
+	}
+
+	return description + L"In use: " + GetKernelIsaName(GetKernels().isa) + (forced ? L" (forced)\n" : L"\n");
+}
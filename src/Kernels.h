@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+using std::int64_t;
+
+namespace cubewg {
+	/* Instruction sets the kernels are compiled for. Every x64 CPU has SSE2, so it is the baseline.
+	*/
+	enum class KernelIsa {
+		SSE2,
+		AVX2,
+		AVX512
+	};
+
+	const int kKernelIsaCount = 3;
+
+	/* The hot inner loops of jittered grids, compiled once per instruction set. Which set is used is chosen at load time by InitKernels.
+	 * Every variant gives bit-identical results to the SSE2 one (no fused multiply-add), so the chosen set never changes the world.
+	 */
+	struct KernelTable {
+		KernelIsa isa;
+
+		// Tile distance. For each of the count positions [x, ys[i]] with dx = point_x - x, lowers dists[i] to the squared distance to the point if it is nearer.
+		void (*nearest_run)(double dx, double point_y, const double* ys, int count, double* dists);
+		// Worley. As nearest_run, but keeps the nearest distance in dists and the second nearest in dists_2.
+		void (*worley_run)(double dx, double point_y, const double* ys, int count, double* dists, double* dists_2);
+		// RNG. RandomDoubles of each hash policy, see GridHash.h.
+		void (*legacy_doubles)(int64_t seed, int64_t x, int64_t y, int count, double* out);
+		void (*counter_doubles)(int64_t seed, int64_t x, int64_t y, int count, double* out);
+	};
+
+	/* The kernels currently in use. Until InitKernels is called, these are the SSE2 kernels.
+	*/
+	const KernelTable& GetKernels();
+
+	/* Detects the best instruction set the CPU (and OS) supports, self-checks every supported variant against the scalar reference and binds the best one that passes.
+	 * Called once from WorldGenMod::Initialize. If the CUBEWG_KERNEL_ISA environment variable names an instruction set (sse2, avx2, avx512), that is forced instead, for testing.
+	 */
+	void InitKernels();
+
+	/* Binds the kernels for the given instruction set. Fails, keeping the current kernels, if the CPU doesn't support it or its variant failed the self-check.
+	*/
+	bool ForceKernels(KernelIsa isa);
+
+	/* The kernels for the given instruction set, whether or not they are in use. Null if this build has none for it or the CPU doesn't support it.
+	*/
+	const KernelTable* GetKernelTable(KernelIsa isa);
+
+	/* Self-checks the given variant against the scalar reference on random inputs. Returns false if any result differs in any bit, or the set isn't supported.
+	*/
+	bool CheckKernels(KernelIsa isa);
+
+	const wchar_t* GetKernelIsaName(KernelIsa isa);
+
+	/* Parses an instruction set name as printed by GetKernelIsaName (any case). Returns false if it isn't one.
+	*/
+	bool ParseKernelIsa(const std::wstring& name, KernelIsa& isa);
+
+	/* One line per instruction set: whether it is supported, whether it passed the self-check and which is in use. For the .kernels chat command.
+	*/
+	std::wstring DescribeKernels();
+}
@@ -0,0 +1,137 @@
+#include "LockProfiler.h"
+
+#include <atomic>
+#include <cstdio>
+
+namespace {
+	struct SiteStats {
+		std::atomic<long long> acquisitions;
+		std::atomic<long long> contended;
+		cubewg::LatencyHistogram waits;
+		cubewg::LatencyHistogram holds;
+
+		SiteStats() : acquisitions(0), contended(0) {
+		}
+	};
+
+	SiteStats sites[cubewg::kLockSites];
+
+	const wchar_t* const kSiteNames[cubewg::kLockSites] = { L"MarkForRemesh", L"SetBlock", L"FillBox", L"Commit", L"RemeshAdd", L"RemeshDrain" };
+
+	// Contended waits also go to the Profiler's trace, to line them up with the phases which waited.
+	int GetWaitPhase(cubewg::LockSite site) {
+		static const struct WaitPhases {
+			int phases[cubewg::kLockSites];
+
+			WaitPhases() {
+				for (int i = 0; i < cubewg::kLockSites; i++) {
+					std::string name = "Wait for zones lock in ";
+					for (const wchar_t* c = kSiteNames[i]; *c; c++) name += (char)*c;
+					phases[i] = cubewg::Profiler::GetPhase(name);
+				}
+			}
+		} wait_phases;
+
+		return wait_phases.phases[(int)site];
+	}
+
+	std::wstring FormatLatencies(const cubewg::LatencyHistogram& histogram) {
+		return L"p50 " + cubewg::Profiler::FormatNanos(histogram.GetPercentile(0.5)) + L", p99 " + cubewg::Profiler::FormatNanos(histogram.GetPercentile(0.99))
+			+ L", max " + cubewg::Profiler::FormatNanos(histogram.GetLongest());
+	}
+
+	void AppendRows(std::string& csv, const char* site, const char* measure, const cubewg::LatencyHistogram& histogram) {
+		char row[128];
+
+		for (int bucket = 0; bucket < cubewg::LatencyHistogram::kBuckets; bucket++) {
+			const unsigned long long count = histogram.GetCount(bucket);
+
+			if (count > 0) {
+				std::snprintf(row, sizeof(row), "%s,%s,%lld,%llu\n", site, measure, cubewg::LatencyHistogram::GetBucketTop(bucket), count);
+				csv += row;
+			}
+		}
+	}
+}
+
+void cubewg::LockProfiler::RecordWait(LockSite site, long long start, long long acquired, bool contended) {
+	SiteStats& stats = sites[(int)site];
+	stats.acquisitions.fetch_add(1, std::memory_order_relaxed);
+	stats.waits.Add(acquired - start);
+
+	if (contended) {
+		stats.contended.fetch_add(1, std::memory_order_relaxed);
+
+		const int phase = GetWaitPhase(site);
+		if (phase >= 0) Profiler::Record(phase, start, acquired);
+	}
+}
+
+void cubewg::LockProfiler::RecordHold(LockSite site, long long acquired, long long released) {
+	sites[(int)site].holds.Add(released - acquired);
+}
+
+const wchar_t* cubewg::LockProfiler::GetSiteName(LockSite site) {
+	return kSiteNames[(int)site];
+}
+
+long long cubewg::LockProfiler::GetAcquisitions(LockSite site) {
+	return sites[(int)site].acquisitions.load(std::memory_order_relaxed);
+}
+
+long long cubewg::LockProfiler::GetContended(LockSite site) {
+	return sites[(int)site].contended.load(std::memory_order_relaxed);
+}
+
+const cubewg::LatencyHistogram& cubewg::LockProfiler::GetWaits(LockSite site) {
+	return sites[(int)site].waits;
+}
+
+const cubewg::LatencyHistogram& cubewg::LockProfiler::GetHolds(LockSite site) {
+	return sites[(int)site].holds;
+}
+
+std::wstring cubewg::LockProfiler::Summarise(long long zones_generated) {
+	std::wstring summary;
+
+	for (int i = 0; i < kLockSites; i++) {
+		const LockSite site = (LockSite)i;
+		const long long acquisitions = GetAcquisitions(site);
+
+		if (acquisitions == 0) continue;
+
+		summary += std::wstring(GetSiteName(site)) + L": " + std::to_wstring(acquisitions) + L" times";
+
+		if (zones_generated > 0) {
+			summary += L" (" + std::to_wstring(acquisitions / zones_generated) + L"." + std::to_wstring(acquisitions * 10 / zones_generated % 10) + L" per zone)";
+		}
+
+		summary += L", " + std::to_wstring(GetContended(site)) + L" contended; wait " + FormatLatencies(GetWaits(site))
+			+ L"; hold " + FormatLatencies(GetHolds(site)) + L"\n";
+	}
+
+	return summary;
+}
+
+bool cubewg::LockProfiler::WriteHistograms(const std::wstring& path) {
+	std::string csv = "site,measure,bucket_top_ns,count\n";
+
+	for (int i = 0; i < kLockSites; i++) {
+		std::string site;
+		for (const wchar_t* c = kSiteNames[i]; *c; c++) site += (char)*c;
+
+		AppendRows(csv, site.c_str(), "wait", sites[i].waits);
+		AppendRows(csv, site.c_str(), "hold", sites[i].holds);
+	}
+
+	return Profiler::WriteExport(path, csv);
+}
+
+void cubewg::LockProfiler::Reset() {
+	for (SiteStats& stats : sites) {
+		stats.acquisitions.store(0, std::memory_order_relaxed);
+		stats.contended.store(0, std::memory_order_relaxed);
+		stats.waits.Reset();
+		stats.holds.Reset();
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+
+#include "Profiler.h"
+
+namespace cubewg {
+	/* Where the mod takes the game's zones lock, world->zones_critical_section.
+	*/
+	enum class LockSite {
+		// finding the zones next to a pasted region to remesh
+		MARK_FOR_REMESH,
+		// writes from a zone region to a neighbour or its buffer
+		SET_BLOCK,
+		FILL_BOX,
+		COMMIT,
+		// finding the zones to queue for remeshing, and each zone to remesh, in RemeshQueue
+		REMESH_ADD,
+		REMESH_DRAIN
+	};
+
+	const int kLockSites = 6;
+
+	/* Measures how long each site waits for a lock, and how long it holds it once it has it.
+	 * Takes any lock with lock, try_lock and unlock: the zones lock through CriticalSectionLock in game, or a std::recursive_mutex standing in for it in the lock harness (benchmarks/LockHarness.cpp).
+	 * Measures nothing when the Profiler is compiled out or off. Thread safe.
+	 */
+	class LockProfiler {
+	public:
+		/* Locks the lock for the site, recording how long that took. Returns when it was acquired, for Release.
+		*/
+		template <typename Lock>
+		static long long Acquire(Lock& lock, LockSite site);
+
+		/* Unlocks the lock for the site, recording how long it was held since acquired.
+		*/
+		template <typename Lock>
+		static void Release(Lock& lock, LockSite site, long long acquired);
+
+		static void RecordWait(LockSite site, long long start, long long acquired, bool contended);
+		static void RecordHold(LockSite site, long long acquired, long long released);
+
+		static const wchar_t* GetSiteName(LockSite site);
+
+		/* Times the site has taken the lock, and how many of those found it held by another thread.
+		*/
+		static long long GetAcquisitions(LockSite site);
+		static long long GetContended(LockSite site);
+		static const LatencyHistogram& GetWaits(LockSite site);
+		static const LatencyHistogram& GetHolds(LockSite site);
+
+		/* One line per site which has taken the lock: acquisitions per zone generated, how often it was contended, and the waits and holds.
+		*/
+		static std::wstring Summarise(long long zones_generated);
+
+		/* Writes every site's wait and hold histograms to the path as CSV, a row per non-empty bucket. Returns false if the file couldn't be written.
+		*/
+		static bool WriteHistograms(const std::wstring& path);
+
+		static void Reset();
+	};
+
+	/* Holds a lock for the rest of the enclosing scope, as std::lock_guard, measured by LockProfiler for the site.
+	*/
+	template <typename Lock>
+	class ProfiledLock {
+	private:
+		Lock& lock;
+		LockSite site;
+		long long acquired;
+	public:
+		ProfiledLock(Lock& lock, LockSite site) : lock(lock), site(site) {
+			acquired = LockProfiler::Acquire(lock, site);
+		}
+
+		~ProfiledLock() {
+			LockProfiler::Release(lock, site, acquired);
+		}
+
+		ProfiledLock(const ProfiledLock&) = delete;
+		ProfiledLock& operator=(const ProfiledLock&) = delete;
+	};
+
+	template <typename Lock>
+	long long LockProfiler::Acquire(Lock& lock, LockSite site) {
+#if CUBEWG_PROFILE
+		if (Profiler::IsEnabled()) {
+			const long long start = Profiler::Now();
+
+			// taken straight away unless another thread holds it
+			if (lock.try_lock()) {
+				RecordWait(site, start, Profiler::Now(), false);
+			} else {
+				lock.lock();
+				RecordWait(site, start, Profiler::Now(), true);
+			}
+
+			return Profiler::Now();
+		}
+#endif
+
+		lock.lock();
+		return -1;
+	}
+
+	template <typename Lock>
+	void LockProfiler::Release(Lock& lock, LockSite site, long long acquired) {
+		if (acquired < 0) {
+			lock.unlock();
+			return;
+		}
+
+		// recorded after unlocking, so recording isn't held against the site
+		const long long released = Profiler::Now();
+		lock.unlock();
+		RecordHold(site, acquired, released);
+	}
+}
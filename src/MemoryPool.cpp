@@ -0,0 +1,180 @@
+#include "MemoryPool.h"
+
+#include <algorithm>
+
+cubewg::MemoryPool::MemoryPool() : allocations(0), heap_allocations(0) {
+}
+
+cubewg::MemoryPool::~MemoryPool() {
+}
+
+size_t cubewg::MemoryPool::GetAllocationSize(size_t bytes) const {
+	return bytes;
+}
+
+long long cubewg::MemoryPool::GetAllocations() const {
+	return allocations.load();
+}
+
+long long cubewg::MemoryPool::GetHeapAllocations() const {
+	return heap_allocations.load();
+}
+
+// Arena
+
+// everything handed out is aligned to this, as it would be from the heap
+const size_t kArenaAlignment = alignof(std::max_align_t);
+
+cubewg::Arena::Arena() : chunk(0), offset(0), bytes_used(0) {
+}
+
+void* cubewg::Arena::Allocate(size_t bytes) {
+	bytes = (bytes + kArenaAlignment - 1) & ~(kArenaAlignment - 1);
+	allocations++;
+	bytes_used += bytes;
+
+	// the rest of this chunk, then any chunks kept from before the last reset
+	while (chunk < chunks.size()) {
+		if (chunks[chunk].size - offset >= bytes) {
+			void* result = chunks[chunk].memory.get() + offset;
+			offset += bytes;
+			return result;
+		}
+
+		chunk++;
+		offset = 0;
+	}
+
+	// chunks are as large as the allocation, if it's larger
+	const size_t size = std::max(bytes, kChunkSize);
+	chunks.push_back(Chunk{ std::unique_ptr<char[]>(new char[size]), size });
+	heap_allocations++;
+	chunk = chunks.size() - 1;
+	offset = bytes;
+	return chunks[chunk].memory.get();
+}
+
+void cubewg::Arena::Free(void* /*pointer*/, size_t /*bytes*/) {
+	// freed all at once by Reset
+}
+
+void cubewg::Arena::Reset() {
+	if (chunks.size() > 1) {
+		const size_t size = this->GetBytesReserved();
+		chunks.clear();
+		chunks.push_back(Chunk{ std::unique_ptr<char[]>(new char[size]), size });
+	}
+
+	chunk = 0;
+	offset = 0;
+	bytes_used = 0;
+	allocations = 0;
+	heap_allocations = 0;
+}
+
+size_t cubewg::Arena::GetBytesUsed() const {
+	return bytes_used;
+}
+
+size_t cubewg::Arena::GetBytesReserved() const {
+	size_t size = 0;
+
+	for (const Chunk& chunk : chunks) {
+		size += chunk.size;
+	}
+
+	return size;
+}
+
+// BlockPool
+
+cubewg::BlockPool::BlockPool() : free_bytes(0) {
+	std::fill(std::begin(free_lists), std::end(free_lists), nullptr);
+}
+
+cubewg::BlockPool::~BlockPool() {
+	this->Trim();
+}
+
+int cubewg::BlockPool::SizeClass(size_t bytes) {
+	int shift = kMinSizeShift;
+
+	while (shift <= kMaxSizeShift && ((size_t)1 << shift) < bytes) {
+		shift++;
+	}
+
+	return shift - kMinSizeShift;
+}
+
+void* cubewg::BlockPool::Allocate(size_t bytes) {
+	const int size_class = SizeClass(bytes);
+	allocations++;
+
+	if (size_class <= kMaxSizeShift - kMinSizeShift) {
+		std::lock_guard<std::mutex> lock(mutex);
+		FreeBlock* block = free_lists[size_class];
+
+		if (block) {
+			free_lists[size_class] = block->next;
+			free_bytes -= (size_t)1 << (size_class + kMinSizeShift);
+			return block;
+		}
+	}
+
+	heap_allocations++;
+
+	if (size_class > kMaxSizeShift - kMinSizeShift) {
+		return ::operator new(bytes);
+	}
+
+	return ::operator new((size_t)1 << (size_class + kMinSizeShift));
+}
+
+void cubewg::BlockPool::Free(void* pointer, size_t bytes) {
+	const int size_class = SizeClass(bytes);
+
+	if (size_class > kMaxSizeShift - kMinSizeShift) {
+		::operator delete(pointer);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	FreeBlock* block = static_cast<FreeBlock*>(pointer);
+	block->next = free_lists[size_class];
+	free_lists[size_class] = block;
+	free_bytes += (size_t)1 << (size_class + kMinSizeShift);
+}
+
+size_t cubewg::BlockPool::GetAllocationSize(size_t bytes) const {
+	const int size_class = SizeClass(bytes);
+	return size_class > kMaxSizeShift - kMinSizeShift ? bytes : (size_t)1 << (size_class + kMinSizeShift);
+}
+
+size_t cubewg::BlockPool::GetBytesFree() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return free_bytes;
+}
+
+size_t cubewg::BlockPool::Trim() {
+	FreeBlock* lists[kMaxSizeShift - kMinSizeShift + 1];
+	size_t trimmed;
+
+	{
+		// taken off under the lock and freed after it
+		std::lock_guard<std::mutex> lock(mutex);
+		std::copy(std::begin(free_lists), std::end(free_lists), std::begin(lists));
+		std::fill(std::begin(free_lists), std::end(free_lists), nullptr);
+		trimmed = free_bytes;
+		free_bytes = 0;
+	}
+
+	for (FreeBlock* block : lists) {
+		while (block) {
+			FreeBlock* next = block->next;
+			::operator delete(block);
+			block = next;
+		}
+	}
+
+	return trimmed;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace cubewg {
+	/* Somewhere generation gets memory from other than the heap. Counts how many allocations it has served, and how many of those needed the heap.
+	*/
+	class MemoryPool {
+	protected:
+		std::atomic<long long> allocations;
+		std::atomic<long long> heap_allocations;
+	public:
+		MemoryPool();
+		virtual ~MemoryPool();
+
+		virtual void* Allocate(size_t bytes) = 0;
+		virtual void Free(void* pointer, size_t bytes) = 0;
+
+		/* The bytes an allocation of the size takes from the pool, for counting the memory held. The size itself unless the pool rounds it up.
+		*/
+		virtual size_t GetAllocationSize(size_t bytes) const;
+
+		long long GetAllocations() const;
+		long long GetHeapAllocations() const;
+	};
+
+	/* Monotonic pool for the temporaries of one zone's generation. Allocating bumps a pointer through large chunks, freeing does nothing,
+	 * and Reset frees everything at once, keeping the memory for the next zone. Not thread safe: each generating thread has its own.
+	 */
+	class Arena : public MemoryPool {
+	private:
+		struct Chunk {
+			std::unique_ptr<char[]> memory;
+			size_t size;
+		};
+
+		std::vector<Chunk> chunks;
+		size_t chunk;
+		size_t offset;
+		size_t bytes_used;
+	public:
+		static const size_t kChunkSize = 64 * 1024;
+
+		Arena();
+
+		void* Allocate(size_t bytes) override;
+		void Free(void* pointer, size_t bytes) override;
+
+		/* Frees everything allocated, and resets the counts. If more than one chunk was needed, they are replaced by one chunk as large as all of them, so the next zone like this one needs no more.
+		*/
+		void Reset();
+
+		/* Bytes allocated since the last reset, and bytes held.
+		*/
+		size_t GetBytesUsed() const;
+		size_t GetBytesReserved() const;
+	};
+
+	/* Pool for memory which outlives a zone's generation, such as buffers waiting for a neighbour to load. Sizes are rounded up to powers of two,
+	 * and freed memory is kept on a list for each size rather than returned to the heap. Large allocations go straight to the heap. Thread safe.
+	 */
+	class BlockPool : public MemoryPool {
+	private:
+		static const int kMinSizeShift = 4;
+		static const int kMaxSizeShift = 16;
+
+		struct FreeBlock {
+			FreeBlock* next;
+		};
+
+		mutable std::mutex mutex;
+		FreeBlock* free_lists[kMaxSizeShift - kMinSizeShift + 1];
+		// bytes of the blocks on the free lists
+		size_t free_bytes;
+
+		static int SizeClass(size_t bytes);
+	public:
+		BlockPool();
+		~BlockPool();
+
+		void* Allocate(size_t bytes) override;
+		void Free(void* pointer, size_t bytes) override;
+		size_t GetAllocationSize(size_t bytes) const override;
+
+		/* Bytes held on the free lists, freed but not returned to the heap.
+		*/
+		size_t GetBytesFree() const;
+
+		/* Returns everything on the free lists to the heap, as when the memory is wanted back. Returns the bytes returned.
+		*/
+		size_t Trim();
+	};
+
+	/* Standard allocator taking its memory from a MemoryPool, or from the heap if the pool is nullptr. Containers of pooled memory must be emptied before their pool is reset or destroyed.
+	*/
+	template <typename T>
+	struct PoolAllocator {
+		typedef T value_type;
+
+		MemoryPool* pool;
+
+		PoolAllocator(MemoryPool* pool = nullptr) : pool(pool) {
+		}
+
+		template <typename U>
+		PoolAllocator(const PoolAllocator<U>& other) : pool(other.pool) {
+		}
+
+		T* allocate(size_t n) {
+			if (pool) {
+				return static_cast<T*>(pool->Allocate(n * sizeof(T)));
+			}
+
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		}
+
+		void deallocate(T* p, size_t n) {
+			if (pool) {
+				pool->Free(p, n * sizeof(T));
+			} else {
+				::operator delete(p);
+			}
+		}
+
+		template <typename U>
+		bool operator==(const PoolAllocator<U>& other) const {
+			return pool == other.pool;
+		}
+
+		template <typename U>
+		bool operator!=(const PoolAllocator<U>& other) const {
+			return pool != other.pool;
+		}
+	};
+}
@@ -0,0 +1,323 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace {
+	struct Event {
+		std::atomic<int> phase;
+		std::atomic<long long> start;
+		std::atomic<long long> duration;
+	};
+
+	/* One thread's events and histograms. Only that thread writes them, so the ring needs no locks, and the histograms' lines are never shared.
+	 * Never freed, so events from threads which have ended can still be exported.
+	 */
+	struct ThreadTrace {
+		int thread;
+		// events ever recorded; the latest kRingSize are in the ring
+		std::atomic<unsigned long long> written;
+		Event events[cubewg::Profiler::kRingSize];
+
+		cubewg::LatencyHistogram histograms[cubewg::Profiler::kMaxPhases];
+
+		explicit ThreadTrace(int thread) : thread(thread), written(0) {
+		}
+	};
+
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	std::atomic<bool> enabled(true);
+	// events starting before this were recorded before the last reset
+	std::atomic<long long> reset_at(0);
+
+	// guards the phase names and the list of threads
+	std::mutex mutex;
+	std::vector<std::string> phases;
+	std::vector<ThreadTrace*> traces;
+
+	thread_local ThreadTrace* thread_trace = nullptr;
+
+	ThreadTrace* GetThreadTrace() {
+		if (!thread_trace) {
+			std::lock_guard<std::mutex> lock(mutex);
+			thread_trace = new ThreadTrace((int)traces.size() + 1);
+			traces.push_back(thread_trace);
+		}
+
+		return thread_trace;
+	}
+
+	void AppendJsonString(std::string& json, const std::string& text) {
+		json += '"';
+
+		for (char c : text) {
+			if (c == '"' || c == '\\') {
+				json += '\\';
+				json += c;
+			} else if ((unsigned char)c >= 0x20) {
+				json += c;
+			}
+		}
+
+		json += '"';
+	}
+}
+
+cubewg::LatencyHistogram::LatencyHistogram() {
+	this->Reset();
+}
+
+int cubewg::LatencyHistogram::GetBucket(long long nanos) {
+	if (nanos < 4) return nanos < 0 ? 0 : (int)nanos;
+
+	int octave = 0;
+
+	while ((nanos >> (octave + 1)) != 0) {
+		octave++;
+	}
+
+	// the two bits after the highest pick the quarter of the octave
+	const int bucket = 4 * (octave - 1) + (int)((nanos >> (octave - 2)) & 3);
+	return bucket < kBuckets ? bucket : kBuckets - 1;
+}
+
+long long cubewg::LatencyHistogram::GetBucketTop(int bucket) {
+	if (bucket < 4) return bucket;
+
+	const int octave = bucket / 4 + 1;
+	return ((long long)(5 + bucket % 4) << (octave - 2)) - 1;
+}
+
+void cubewg::LatencyHistogram::Add(long long nanos) {
+	counts[GetBucket(nanos)].fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(nanos, std::memory_order_relaxed);
+
+	long long current = longest.load(std::memory_order_relaxed);
+
+	while (nanos > current && !longest.compare_exchange_weak(current, nanos, std::memory_order_relaxed)) {
+	}
+}
+
+void cubewg::LatencyHistogram::Merge(const LatencyHistogram& other) {
+	for (int bucket = 0; bucket < kBuckets; bucket++) {
+		counts[bucket].fetch_add(other.counts[bucket].load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+
+	total.fetch_add(other.GetTotal(), std::memory_order_relaxed);
+
+	const long long other_longest = other.GetLongest();
+	long long current = longest.load(std::memory_order_relaxed);
+
+	while (other_longest > current && !longest.compare_exchange_weak(current, other_longest, std::memory_order_relaxed)) {
+	}
+}
+
+void cubewg::LatencyHistogram::Reset() {
+	// Durations added meanwhile may be partly kept. That doesn't matter for a summary.
+	for (int bucket = 0; bucket < kBuckets; bucket++) {
+		counts[bucket].store(0, std::memory_order_relaxed);
+	}
+
+	total.store(0, std::memory_order_relaxed);
+	longest.store(0, std::memory_order_relaxed);
+}
+
+unsigned long long cubewg::LatencyHistogram::GetCount() const {
+	unsigned long long count = 0;
+
+	for (int bucket = 0; bucket < kBuckets; bucket++) {
+		count += counts[bucket].load(std::memory_order_relaxed);
+	}
+
+	return count;
+}
+
+unsigned long long cubewg::LatencyHistogram::GetCount(int bucket) const {
+	return counts[bucket].load(std::memory_order_relaxed);
+}
+
+long long cubewg::LatencyHistogram::GetTotal() const {
+	return total.load(std::memory_order_relaxed);
+}
+
+long long cubewg::LatencyHistogram::GetLongest() const {
+	return longest.load(std::memory_order_relaxed);
+}
+
+long long cubewg::LatencyHistogram::GetPercentile(double fraction) const {
+	const unsigned long long count = this->GetCount();
+	const long long longest = this->GetLongest();
+
+	if (count == 0) return 0;
+
+	// the rank of the duration wanted, from 1
+	unsigned long long rank = (unsigned long long)(fraction * count + 0.5);
+	if (rank < 1) rank = 1;
+	if (rank > count) rank = count;
+
+	unsigned long long seen = 0;
+
+	for (int bucket = 0; bucket < kBuckets; bucket++) {
+		seen += counts[bucket].load(std::memory_order_relaxed);
+
+		if (seen >= rank) {
+			// no more than the longest, in case the bucket is far wider than what's in it
+			return std::min(GetBucketTop(bucket), longest);
+		}
+	}
+
+	return longest;
+}
+
+int cubewg::Profiler::GetPhase(const std::string& name) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (size_t phase = 0; phase < phases.size(); phase++) {
+		if (phases[phase] == name) return (int)phase;
+	}
+
+	if (phases.size() >= kMaxPhases) return -1;
+
+	phases.push_back(name);
+	return (int)phases.size() - 1;
+}
+
+long long cubewg::Profiler::Now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void cubewg::Profiler::Record(int phase, long long start, long long end) {
+	ThreadTrace* trace = GetThreadTrace();
+	const long long duration = end - start;
+
+	const unsigned long long index = trace->written.load(std::memory_order_relaxed);
+	Event& event = trace->events[index % kRingSize];
+	event.phase.store(phase, std::memory_order_relaxed);
+	event.start.store(start, std::memory_order_relaxed);
+	event.duration.store(duration, std::memory_order_relaxed);
+	// publishes the event to WriteChromeTrace
+	trace->written.store(index + 1, std::memory_order_release);
+
+	trace->histograms[phase].Add(duration);
+}
+
+bool cubewg::Profiler::IsEnabled() {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void cubewg::Profiler::SetEnabled(bool enabled) {
+	::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+std::wstring cubewg::Profiler::Summarise() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::wstring summary;
+
+	for (size_t phase = 0; phase < phases.size(); phase++) {
+		LatencyHistogram histogram;
+
+		for (const ThreadTrace* trace : traces) {
+			histogram.Merge(trace->histograms[phase]);
+		}
+
+		if (histogram.GetCount() == 0) continue;
+
+		summary += std::wstring(phases[phase].begin(), phases[phase].end()) + L": " + std::to_wstring(histogram.GetCount()) + L" times, "
+			+ FormatNanos(histogram.GetTotal()) + L" total, p50 " + FormatNanos(histogram.GetPercentile(0.5)) + L", p99 " + FormatNanos(histogram.GetPercentile(0.99))
+			+ L", max " + FormatNanos(histogram.GetLongest()) + L"\n";
+	}
+
+	return summary;
+}
+
+bool cubewg::Profiler::WriteChromeTrace(const std::wstring& path) {
+	std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	char number[64];
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const long long since = reset_at.load(std::memory_order_relaxed);
+
+		for (const ThreadTrace* trace : traces) {
+			std::snprintf(number, sizeof(number), "%d", trace->thread);
+			const std::string tid = number;
+
+			json += first ? "" : ",";
+			first = false;
+			json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\"generation thread " + tid + "\"}}";
+
+			// The thread may record more while this reads, overwriting the oldest events read. Read what the ring held, then drop any overwritten since.
+			const unsigned long long written = trace->written.load(std::memory_order_acquire);
+			const unsigned long long oldest = written > kRingSize ? written - kRingSize : 0;
+			std::vector<long long> starts, durations;
+			std::vector<int> event_phases;
+
+			for (unsigned long long index = oldest; index < written; index++) {
+				const Event& event = trace->events[index % kRingSize];
+				event_phases.push_back(event.phase.load(std::memory_order_relaxed));
+				starts.push_back(event.start.load(std::memory_order_relaxed));
+				durations.push_back(event.duration.load(std::memory_order_relaxed));
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			const unsigned long long written_after = trace->written.load(std::memory_order_relaxed);
+			const unsigned long long intact = written_after > kRingSize ? written_after - kRingSize : 0;
+
+			for (unsigned long long index = oldest > intact ? oldest : intact; index < written; index++) {
+				const size_t i = (size_t)(index - oldest);
+				const int phase = event_phases[i];
+
+				if (starts[i] < since || phase < 0 || phase >= (int)phases.size()) continue;
+
+				json += ",{\"name\":";
+				AppendJsonString(json, phases[phase]);
+				// microseconds, as the format wants
+				std::snprintf(number, sizeof(number), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f", starts[i] / 1000.0, durations[i] / 1000.0);
+				json += number;
+				json += ",\"pid\":1,\"tid\":" + tid + "}";
+			}
+		}
+	}
+
+	json += "]}";
+
+	return WriteExport(path, json);
+}
+
+bool cubewg::Profiler::WriteExport(const std::wstring& path, const std::string& text) {
+#ifdef _WIN32
+	// MSVC's streams open wide paths, as the temp directory may need
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+#else
+	std::ofstream file(std::string(path.begin(), path.end()), std::ios::binary | std::ios::trunc);
+#endif
+
+	if (!file) return false;
+
+	file.write(text.data(), (std::streamsize)text.size());
+	file.close();
+	return !file.fail();
+}
+
+void cubewg::Profiler::Reset() {
+	std::lock_guard<std::mutex> lock(mutex);
+	reset_at.store(Now(), std::memory_order_relaxed);
+
+	for (ThreadTrace* trace : traces) {
+		for (int phase = 0; phase < kMaxPhases; phase++) {
+			trace->histograms[phase].Reset();
+		}
+	}
+}
+
+std::wstring cubewg::Profiler::FormatNanos(long long nanos) {
+	if (nanos < 10000) return std::to_wstring(nanos) + L" ns";
+	if (nanos < 10000000) return std::to_wstring(nanos / 1000) + L" us";
+	return std::to_wstring(nanos / 1000000) + L" ms";
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+// Set to 0 (for example with /DCUBEWG_PROFILE=0) to compile every profiling scope out. The Profiler itself stays, with nothing recorded.
+#ifndef CUBEWG_PROFILE
+#define CUBEWG_PROFILE 1
+#endif
+
+#define CUBEWG_PROFILE_CONCAT_INNER(a, b) a##b
+#define CUBEWG_PROFILE_CONCAT(a, b) CUBEWG_PROFILE_CONCAT_INNER(a, b)
+
+#if CUBEWG_PROFILE
+// Times the rest of the enclosing scope as the named phase. The name is looked up once, the first time the scope is entered.
+#define CUBEWG_PROFILE_SCOPE(name) \
+	static const int CUBEWG_PROFILE_CONCAT(profile_phase_, __LINE__) = cubewg::Profiler::GetPhase(name); \
+	cubewg::ProfileScope CUBEWG_PROFILE_CONCAT(profile_scope_, __LINE__)(CUBEWG_PROFILE_CONCAT(profile_phase_, __LINE__))
+// Times the rest of the enclosing scope as a phase got from Profiler::GetPhase.
+#define CUBEWG_PROFILE_PHASE(phase) cubewg::ProfileScope CUBEWG_PROFILE_CONCAT(profile_scope_, __LINE__)(phase)
+#else
+#define CUBEWG_PROFILE_SCOPE(name) ((void)0)
+#define CUBEWG_PROFILE_PHASE(phase) ((void)0)
+#endif
+
+namespace cubewg {
+	/* Counts of durations in quarter octaves of nanoseconds, so percentiles read from it are the top of the bucket they fall in, within 25%. Thread safe.
+	*/
+	class LatencyHistogram {
+	public:
+		// up to 2^41 ns (about 36 minutes) in the last
+		static const int kBuckets = 160;
+	private:
+		std::atomic<unsigned int> counts[kBuckets];
+		std::atomic<long long> total;
+		std::atomic<long long> longest;
+	public:
+		LatencyHistogram();
+
+		static int GetBucket(long long nanos);
+		// the longest time in the bucket
+		static long long GetBucketTop(int bucket);
+
+		void Add(long long nanos);
+		// adds another's counts to these, as when totalling threads' histograms
+		void Merge(const LatencyHistogram& other);
+		void Reset();
+
+		unsigned long long GetCount() const;
+		unsigned long long GetCount(int bucket) const;
+		long long GetTotal() const;
+		long long GetLongest() const;
+
+		/* The time the fraction of durations are no longer than, to within a bucket. 0 if there are none.
+		*/
+		long long GetPercentile(double fraction) const;
+	};
+
+	/* Times phases of generation, such as pasting buffers, each structure's Generate, and the stages of a city.
+	 * Each thread records into its own ring of recent events and its own latency histograms, so recording takes no locks.
+	 * The rings are exported as a Chrome trace (chrome://tracing or Perfetto), and the histograms summarised with each phase's percentiles.
+	 */
+	class Profiler {
+	public:
+		static const int kMaxPhases = 64;
+		// events kept per thread, the oldest overwritten first
+		static const int kRingSize = 16384;
+
+		/* Gets the id of the phase with the name, adding it if there isn't one. Returns -1 once there are kMaxPhases phases, which records nothing.
+		*/
+		static int GetPhase(const std::string& name);
+
+		/* Nanoseconds since the profiler started, on the clock events are recorded with.
+		*/
+		static long long Now();
+
+		static void Record(int phase, long long start, long long end);
+
+		/* Whether scopes record anything. On by default; off, a scope costs one load.
+		*/
+		static bool IsEnabled();
+		static void SetEnabled(bool enabled);
+
+		/* Each phase's count, total, 50th and 99th percentile and longest time, one line per phase with any events. Percentiles are within 25%, see LatencyHistogram.
+		*/
+		static std::wstring Summarise();
+
+		/* Writes every thread's recent events to the path as Chrome trace_event JSON. Returns false if the file couldn't be written.
+		*/
+		static bool WriteChromeTrace(const std::wstring& path);
+
+		/* Writes the text to the path, replacing any file there, as the exports do. Returns false if it couldn't be written.
+		*/
+		static bool WriteExport(const std::wstring& path, const std::string& text);
+
+		/* Forgets every event and histogram so far.
+		*/
+		static void Reset();
+
+		/* The time in ns, us or ms as suits its size, for chat.
+		*/
+		static std::wstring FormatNanos(long long nanos);
+	};
+
+	/* Records the time from its construction to its destruction as the phase. See CUBEWG_PROFILE_SCOPE.
+	*/
+	class ProfileScope {
+	private:
+		int phase;
+		long long start;
+	public:
+		explicit ProfileScope(int phase) : phase(phase), start(Profiler::IsEnabled() && phase >= 0 ? Profiler::Now() : -1) {
+		}
+
+		~ProfileScope() {
+			if (start >= 0) {
+				Profiler::Record(phase, start, Profiler::Now());
+			}
+		}
+
+		ProfileScope(const ProfileScope&) = delete;
+		ProfileScope& operator=(const ProfileScope&) = delete;
+	};
+}
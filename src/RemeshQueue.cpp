@@ -0,0 +1,140 @@
+#include "RemeshQueue.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "CriticalSectionLock.h"
+#include "LockProfiler.h"
+#include "Profiler.h"
+
+cubewg::RemeshQueue::RemeshQueue() : pinned(false), queued(0), remeshed(0) {
+}
+
+void cubewg::RemeshQueue::Add(const IntVector2& zone_position) {
+	std::lock_guard<std::mutex> lock(mutex);
+	pending.insert(zone_position);
+	queued++;
+}
+
+void cubewg::RemeshQueue::Add(cube::World* world, const IntVector2& centre_zone, int radius, const std::set<cube::Zone*>& zones) {
+	if (zones.empty()) return;
+
+	// Matched by pointer against the zones loaded now. A zone found is live, while the lock is held, so its position can be read.
+	std::vector<IntVector2> positions;
+
+	{
+		CriticalSectionLock zones_lock(&world->zones_critical_section);
+		ProfiledLock<CriticalSectionLock> lock(zones_lock, LockSite::REMESH_ADD);
+
+		for (int dx = -radius; dx <= radius; dx++) {
+			for (int dy = -radius; dy <= radius; dy++) {
+				cube::Zone* zone = world->GetZone(IntVector2(centre_zone.x + dx, centre_zone.y + dy));
+
+				if (zone && zones.count(zone)) {
+					positions.push_back(zone->position);
+				}
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (const IntVector2& position : positions) {
+		pending.insert(position);
+		queued++;
+	}
+}
+
+void cubewg::RemeshQueue::Remove(const IntVector2& zone_position) {
+	std::unique_lock<std::mutex> lock(mutex);
+	pending.erase(zone_position);
+
+	unpinned.wait(lock, [this, &zone_position] { return !pinned || !(pinned_position == zone_position); });
+}
+
+int cubewg::RemeshQueue::Drain(cube::World* world, const IntVector2& centre_zone, std::chrono::microseconds budget) {
+	auto start = std::chrono::steady_clock::now();
+
+	// order a snapshot of the queue by distance, then take zones from it while they are still queued
+	std::vector<std::pair<long long, IntVector2>> order;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (pending.empty()) return 0;
+
+		order.reserve(pending.size());
+
+		for (const IntVector2& position : pending) {
+			const long long dx = (long long)position.x - centre_zone.x;
+			const long long dy = (long long)position.y - centre_zone.y;
+			order.push_back(std::make_pair(dx * dx + dy * dy, position));
+		}
+	}
+
+	std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+	int count = 0;
+
+	for (const auto& entry : order) {
+		if (count > 0 && std::chrono::steady_clock::now() - start >= budget) {
+			break;
+		}
+
+		// zones removed or remeshed since the snapshot are skipped
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (!pending.erase(entry.second)) continue;
+		}
+
+		// Looked up under the zones lock, and pinned before letting it go. Destroying the zone waits in Remove until it's unpinned.
+		cube::Zone* zone;
+
+		{
+			CriticalSectionLock zones_lock(&world->zones_critical_section);
+			ProfiledLock<CriticalSectionLock> lock(zones_lock, LockSite::REMESH_DRAIN);
+			zone = world->GetZone(entry.second);
+
+			if (zone) {
+				std::lock_guard<std::mutex> pin_lock(mutex);
+				pinned = true;
+				pinned_position = entry.second;
+			}
+		}
+
+		if (!zone) continue;
+
+		{
+			CUBEWG_PROFILE_SCOPE("Remesh zone");
+			zone->chunk.Remesh();
+		}
+
+		count++;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pinned = false;
+			remeshed++;
+		}
+
+		unpinned.notify_all();
+	}
+
+	return count;
+}
+
+size_t cubewg::RemeshQueue::GetPending() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return pending.size();
+}
+
+long long cubewg::RemeshQueue::GetQueued() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return queued;
+}
+
+long long cubewg::RemeshQueue::GetRemeshed() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return remeshed;
+}
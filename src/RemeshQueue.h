@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cwsdk.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <unordered_set>
+
+namespace cubewg {
+	// how long each game tick may spend remeshing queued zones
+	const int kRemeshTickBudgetMicros = 2000;
+	// how many zones around the player .generate looks for the zones a structure placed there changed. Wider than a city.
+	const int kRemeshCommandRadius = 8;
+
+	/* Zones waiting to be remeshed after generation changed them. Zones are queued from any thread, and duplicates are merged,
+	 * so a zone changed by several structures (or several times by its neighbours) is remeshed once.
+	 * Drained from the game tick, nearest the player first, a little each tick so large structures don't remesh dozens of chunks in one frame.
+	 * Holds zone positions rather than zones, which may be destroyed while queued: each is looked up again in the world when it is remeshed,
+	 * and pinned while it is, so it isn't destroyed part way through, without the world's zones lock held across the remesh.
+	 */
+	class RemeshQueue {
+	private:
+		std::mutex mutex;
+		std::unordered_set<IntVector2> pending;
+		// the zone Drain is remeshing, which Remove waits for
+		bool pinned;
+		IntVector2 pinned_position;
+		std::condition_variable unpinned;
+
+		long long queued;
+		long long remeshed;
+	public:
+		RemeshQueue();
+
+		void Add(const IntVector2& zone_position);
+
+		/* Queues the positions of the zones, found by looking up the zones within radius of the centre zone under the world's zones lock.
+		 * The zones may have been destroyed since they were collected, so are never read: zones no longer in the world, and any outside the radius, are left out.
+		 */
+		void Add(cube::World* world, const IntVector2& centre_zone, int radius, const std::set<cube::Zone*>& zones);
+
+		/* Forgets the zone, if it is queued. Call it as the zone is destroyed: if Drain is remeshing the zone, it waits for that to finish, so the zone outlives its remesh.
+		*/
+		void Remove(const IntVector2& zone_position);
+
+		/* Remeshes queued zones, nearest the given zone first, until the budget is spent. Always remeshes at least one zone if any are queued, so the queue keeps moving.
+		 * Each zone is looked up under the world's zones lock, then pinned (see Remove) and remeshed with no lock held, so the game's loaders and generation threads aren't held up
+		 * by the remesh, and can keep queueing meanwhile. Zones since unloaded are dropped.
+		 * Returns how many zones were remeshed.
+		 */
+		int Drain(cube::World* world, const IntVector2& centre_zone, std::chrono::microseconds budget);
+
+		/* How many zones are waiting, how many times zones have been queued (counting duplicates), and how many have been remeshed.
+		*/
+		size_t GetPending();
+		long long GetQueued();
+		long long GetRemeshed();
+	};
+}
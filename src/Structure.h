@@ -14,5 +14,15 @@ namespace cubewg {
 		/* This calls for the structure to place itself within a zone. Returns whether a major structure was generated within the zone.
 		*/
 		virtual bool Generate(WorldRegion& region, const IntVector2& zone_position, std::set<cube::Zone*>& to_remesh) = 0;
+		/* Cheap broad-phase test of whether the structure may place anything in the zone. If it returns false, Generate is not called for the zone.
+		 * Must never return false for a zone the structure would place blocks in. The default can't rule out any zone.
+		 */
+		virtual bool MayIntersectZone(const IntVector2& zone_position) {
+			return true;
+		}
+		/* Called when a zone is unloaded, so structures can drop anything they keep for it.
+		*/
+		virtual void OnZoneUnloaded(const IntVector2& zone_position) {
+		}
 	};
 }
\ No newline at end of file
@@ -1,33 +1,31 @@
 #include "WorldRegion.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <list>
+#include <mutex>
 #include <cwsdk.h>
 
-#define NULLABLE
-
-namespace std {
-	template <>
-	struct hash<Vector3<int>> {
-		std::size_t operator()(const Vector3<int>& k) const {
-			uint64_t x = (uint32_t)k.x;
-			uint64_t y = (uint32_t)k.y;
-			uint64_t vec2key = x | (y << 32);
-
-			uint64_t z = (uint32_t)k.z;
-			vec2key = vec2key * 31L + z;
+#include "BufferJournal.h"
+#include "CriticalSectionLock.h"
+#include "CubeBuffer.h"
+#include "HeightmapCache.h"
+#include "LockProfiler.h"
+#include "Profiler.h"
+#include "ZoneDeltaCache.h"
 
-			// Call into the MSVC-STL FNV-1a std::hash function.
-			return std::hash<uint64_t>()(vec2key);
-		}
-	};
-}
+#define NULLABLE
 
 namespace cubewg {
-	typedef std::unordered_map<IntVector3, cube::Block> CubeBuffer;
-
 	// structs
 	struct NeighbourBuffers {
 		std::unique_ptr<CubeBuffer> neighbours[8] = { nullptr };
+		// the memory counted for this owner, see Recount
+		size_t bytes = 0;
+		// when it was last written to, by buffer_writes
+		long long last_write = 0;
 
 		static int BufferArrLoc(int x_dif, int y_dif)
 		{
@@ -47,18 +45,43 @@ namespace cubewg {
 		* @param x_dif the x offset.
 		* @param y_dif the y offset.
 		* @param create whether to create a new buffer if it doesn't exist.
+		* @param pool where a new buffer gets its memory from.
 		*/
-		NULLABLE std::unique_ptr<CubeBuffer> & GetBuffer(int x_dif, int y_dif, bool create)
+		NULLABLE std::unique_ptr<CubeBuffer> & GetBuffer(int x_dif, int y_dif, bool create, MemoryPool* pool = nullptr)
 		{
 			int const arrLoc = BufferArrLoc(x_dif, y_dif);
 
 			if (create && !neighbours[arrLoc]) {
-				neighbours[arrLoc] = std::make_unique<CubeBuffer>();
+				neighbours[arrLoc] = std::make_unique<CubeBuffer>(pool);
 			}
 
 			return neighbours[arrLoc];
 		}
 
+		/* Takes ownership of the buffer for the x_dif and y_dif away from this, leaving nullptr in its place.
+		*/
+		NULLABLE std::unique_ptr<CubeBuffer> Detach(int x_dif, int y_dif) {
+			return std::move(neighbours[BufferArrLoc(x_dif, y_dif)]);
+		}
+
+		bool IsEmpty() const {
+			for (const std::unique_ptr<CubeBuffer>& neighbour : neighbours) {
+				if (neighbour) return false;
+			}
+
+			return true;
+		}
+
+		int GetBufferCount() const {
+			int count = 0;
+
+			for (const std::unique_ptr<CubeBuffer>& neighbour : neighbours) {
+				if (neighbour) count++;
+			}
+
+			return count;
+		}
+
 		void Delete(int x_dif, int y_dif) {
 			int const arrLoc = BufferArrLoc(x_dif, y_dif);
 
@@ -71,18 +94,125 @@ namespace cubewg {
 	// the list of stuff to generate! We use a linked list rather than std::vector to ensure fast addition and iteration. And we don't need random access.
 	std::list<Structure*> *structures;
 	std::unordered_map<std::wstring, Structure*> *named_structures;
+	// each structure's profiler phase, for its Generate
+	std::unordered_map<Structure*, int> *structure_phases;
+
+	// broad-phase counters, see GetStructuresCulled
+	std::atomic<long long> structure_checks(0);
+	std::atomic<long long> structures_culled(0);
+
+	// allocation counters, see GetAllocations
+	std::atomic<long long> zones_generated(0);
+	std::atomic<long long> arena_allocations(0);
+	std::atomic<long long> arena_heap_allocations(0);
+
+	// delta checks, see SetVerifyDeltas
+	std::atomic<bool> verify_deltas(false);
+	std::atomic<long long> deltas_verified(0);
+	std::atomic<long long> delta_mismatches(0);
+
+	// One stripe of zoneBuffers. Each has its own lock, so zones in different stripes never wait on each other, and none wait on the game's zones lock.
+	struct ZoneBufferShard {
+		std::mutex mutex;
+		std::unordered_map<IntVector2, NeighbourBuffers> buffers;
+		// The buffers' memory. They outlive the zone which wrote them, so can't use its arena.
+		BlockPool pool;
+		// what the pool's free lists held when last counted in buffer_bytes, see RecountFree
+		size_t free_bytes = 0;
+	};
+
+	// a power of two
+	const int kZoneBufferShards = 64;
 
-	// Map from the owner zone to buffers to paste in neighbouring regions
-	std::unordered_map<IntVector2, NeighbourBuffers>* zoneBuffers;
+	// Map from the owner zone to buffers to paste in neighbouring regions, striped by owner zone
+	ZoneBufferShard* zoneBuffers;
+
+	static ZoneBufferShard& ShardOf(const IntVector2& zone_pos) {
+		// neighbouring zones land in different stripes
+		const uint32_t hash = (uint32_t)zone_pos.x * 73856093u ^ (uint32_t)zone_pos.y * 19349663u;
+		return zoneBuffers[(hash ^ (hash >> 16)) & (kZoneBufferShards - 1)];
+	}
+
+	// buffers left by zones which unloaded before the zones they were for loaded
+	BufferJournal* journal;
+
+	// The world being generated in. What's kept for zones is only for that world, see ForgetWorld.
+	struct GeneratedWorld {
+		std::mutex mutex;
+		cube::World* world = nullptr;
+		// counts the worlds generated in, so deltas are keyed by the one they were recorded in
+		uint64_t id = 0;
+	};
+
+	GeneratedWorld* generated_world;
+
+	// Buffer accounting, see GetBufferMemory. Kept under the stripes' locks as the buffers change.
+	std::atomic<size_t> buffer_bytes(0);
+	std::atomic<size_t> buffer_owners(0);
+	std::atomic<size_t> buffer_count(0);
+	std::atomic<size_t> peak_buffer_bytes(0);
+	std::atomic<size_t> peak_buffer_owners(0);
+	std::atomic<size_t> peak_buffer_count(0);
+
+	// an owner's map entry, as the map allocates it: the key and buffers, and the node's link and cached hash
+	const size_t kOwnerBytes = sizeof(std::pair<const IntVector2, NeighbourBuffers>) + 2 * sizeof(void*);
+
+	// Buffer eviction, see SetBufferBudget
+	const size_t kDefaultBufferBudget = 64 * 1024 * 1024;
+	std::atomic<size_t> buffer_budget(kDefaultBufferBudget);
+	std::atomic<int> buffer_eviction((int)BufferEviction::OLDEST);
+	std::atomic<long long> owners_evicted(0);
+	std::atomic<long long> bytes_evicted(0);
+	std::atomic<long long> owners_dropped(0);
+	// counts writes to buffers, as a clock for NeighbourBuffers::last_write
+	std::atomic<long long> buffer_writes(0);
+	std::atomic<int> player_zone_x(0);
+	std::atomic<int> player_zone_y(0);
+	// only one thread evicts at once; others carry on over budget until it's done
+	std::atomic<bool> evicting(false);
+	// Set by writes which took buffers over budget. They may hold the game's zones lock, so eviction waits for GenerateInZone to finish, see EvictIfOverBudget.
+	std::atomic<bool> over_budget(false);
+
+	// heights of loaded zones, see GetHeight
+	HeightmapCache* heightmaps;
+
+	// what generation did to zones which have been generated, see GenerateInZone
+	ZoneDeltaCache* deltas;
+
+	// Bump when generation changes, so deltas recorded by the old generation aren't replayed. Mixed with the ids of the structures added, see AddStructure.
+	const uint32_t kGeneratorVersion = 1;
+	uint32_t generator_version = kGeneratorVersion;
 
 	// internal header stuff
 	void SetBlockInZone(cube::Zone *zone, IntVector3 local_block_pos, cube::Block block, std::set<cube::Zone*> &to_remesh);
+	static void MarkForRemesh(cube::Zone* zone, const IntVector3& local_min, const IntVector3& local_max, std::set<cube::Zone*>& to_remesh);
+	template <typename Blocks>
+	static bool SetBlocksInZone(cube::Zone* zone, const Blocks& blocks, IntVector2& min, IntVector2& max);
+	template <typename Blocks>
+	static void PasteInZone(cube::Zone* zone, HeightmapTile* heights, const Blocks& blocks, std::set<cube::Zone*>& to_remesh);
+	static void InvalidateHeightsIn(const IntVector2& zone_pos, const IntVector2& local_min, const IntVector2& local_max);
+	static void EvictBuffers();
+	static void EvictIfOverBudget();
 	
 	void WorldRegion::Initialise() {
 		// iirc there were runtime crashes if I didn't delay initialisation. Hence, pointers.
-		zoneBuffers = new std::unordered_map<IntVector2, NeighbourBuffers>;
+		zoneBuffers = new ZoneBufferShard[kZoneBufferShards];
+		journal = new BufferJournal;
+		generated_world = new GeneratedWorld;
+		heightmaps = new HeightmapCache;
+		deltas = new ZoneDeltaCache;
 		structures = new std::list<Structure*>;
 		named_structures = new std::unordered_map<std::wstring, Structure*>;
+		structure_phases = new std::unordered_map<Structure*, int>;
+
+		// One file per game process, in the temp folder. If it can't be made, buffers are dropped when their zone unloads.
+		wchar_t temp_path[MAX_PATH + 1];
+		const DWORD length = GetTempPathW(MAX_PATH + 1, temp_path);
+
+		if (length > 0 && length <= MAX_PATH) {
+			journal->Open(std::wstring(temp_path) + L"cubewg-buffers-" + std::to_wstring(GetCurrentProcessId()) + L".journal");
+			deltas->Open(std::wstring(temp_path) + L"cubewg-deltas-" + std::to_wstring(GetCurrentProcessId()) + L".cache");
+		}
 	}
 
 	// Cleans up the memory here
@@ -92,32 +222,202 @@ namespace cubewg {
 	void WorldRegion::AddStructure(std::wstring id, cubewg::Structure* structure) {
 		(*named_structures)[id] = structure;
 		structures->push_back(structure);
+
+		// phase names are ASCII, as are ids
+		std::string phase = "Generate ";
+		for (wchar_t c : id) phase += (char)c;
+		(*structure_phases)[structure] = Profiler::GetPhase(phase);
+
+		generator_version = generator_version * 31 + (uint32_t)std::hash<std::wstring>()(id);
+	}
+
+	// Buffer accounting
+
+	static void RaisePeak(std::atomic<size_t>& peak, size_t value) {
+		size_t current = peak.load();
+
+		while (value > current && !peak.compare_exchange_weak(current, value)) {
+		}
+	}
+
+	// Counts the bytes the owner holds again after its buffers have changed, and adds the difference to the total. Its stripe must be locked.
+	static void Recount(NeighbourBuffers& owner) {
+		const size_t before = owner.bytes;
+		owner.bytes = kOwnerBytes;
+
+		for (const std::unique_ptr<CubeBuffer>& neighbour : owner.neighbours) {
+			if (neighbour) owner.bytes += neighbour->GetMemoryUsage();
+		}
+
+		// wraps around if it went down, which unsigned addition undoes
+		buffer_bytes += owner.bytes - before;
+	}
+
+	// Counts what the stripe's pool keeps on its free lists again, and adds the difference to the total. Buffers are freed after the lock is let go,
+	// so this lags until the stripe is next written to or counted. Its stripe must be locked.
+	static void RecountFree(ZoneBufferShard& shard) {
+		const size_t before = shard.free_bytes;
+		shard.free_bytes = shard.pool.GetBytesFree();
+		buffer_bytes += shard.free_bytes - before;
+	}
+
+	// Returns what the stripe's pool keeps on its free lists to the heap, and takes it off the total. Its stripe must not be locked, as what it frees may still be being freed.
+	static void TrimPool(ZoneBufferShard& shard) {
+		shard.pool.Trim();
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		RecountFree(shard);
+	}
+
+	// Takes the owner off the totals, as it leaves its stripe. Its stripe must be locked.
+	static void Uncount(const NeighbourBuffers& owner) {
+		buffer_bytes -= owner.bytes;
+		buffer_owners--;
+		buffer_count -= owner.GetBufferCount();
+	}
+
+	// Writes the owner's buffers to the journal, for the neighbours they're for. Its stripe must be locked, so a neighbour loading meanwhile finds them in one place or the other.
+	// Returns false if the journal couldn't take them, in which case they're lost once the owner is removed.
+	static bool JournalBuffers(const IntVector2& zone_pos, const NeighbourBuffers& owner) {
+		bool journalled = true;
+
+		for (int dx = -1; dx <= 1; dx++) {
+			for (int dy = -1; dy <= 1; dy++) {
+				if (dx == 0 && dy == 0) continue;
+
+				const std::unique_ptr<CubeBuffer>& buffer = owner.neighbours[NeighbourBuffers::BufferArrLoc(dx, dy)];
+
+				if (buffer && !buffer->IsEmpty()) {
+					journalled = journal->Write(IntVector2(zone_pos.x + dx, zone_pos.y + dy), *buffer) && journalled;
+				}
+			}
+		}
+
+		return journalled;
+	}
+
+	// Drops everything kept for the zones of the world generated in so far: their buffers for neighbours, the journal and their deltas. Another world may have zones at the same positions,
+	// which must not be given them. Called when zones of another world are generated. Not when every zone has unloaded, as that happens on travelling far within a world,
+	// whose zones still want what their neighbours left them. Deltas are keyed by world too, so dropping them only frees what they held. generated_world's mutex must be held.
+	static void ForgetWorld() {
+		for (int i = 0; i < kZoneBufferShards; i++) {
+			{
+				// freed after the lock
+				std::unordered_map<IntVector2, NeighbourBuffers> removed;
+				std::lock_guard<std::mutex> lock(zoneBuffers[i].mutex);
+
+				for (const auto& owner : zoneBuffers[i].buffers) {
+					Uncount(owner.second);
+				}
+
+				removed.swap(zoneBuffers[i].buffers);
+			}
+
+			// nothing the old world's buffers held is wanted again
+			TrimPool(zoneBuffers[i]);
+		}
+
+		journal->Clear();
+		deltas->Clear();
 	}
 
 	void WorldRegion::CleanUpBuffers(IntVector2 zone_pos) {
 		if (!zoneBuffers) return;
 
-		// Lock mutex
-		EnterCriticalSection(&cube::GetGame()->world->zones_critical_section);
+		// Moved out under the lock and freed after it, so the lock is only held for the lookup and journalling.
+		NeighbourBuffers removed;
 
-		std::unordered_map<IntVector2, NeighbourBuffers>::iterator bufs = zoneBuffers->find(zone_pos);
-		
-		if (bufs != zoneBuffers->end()) {
-			zoneBuffers->erase(zone_pos);  // The unique_ptrs in NeighbourBuffers will be automatically cleaned up when erased
+		{
+			ZoneBufferShard& shard = ShardOf(zone_pos);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto bufs = shard.buffers.find(zone_pos);
+
+			if (bufs != shard.buffers.end()) {
+				// If the journal can't take them, they're lost, as before there was one.
+				JournalBuffers(zone_pos, bufs->second);
+				Uncount(bufs->second);
+				removed = std::move(bufs->second);
+				shard.buffers.erase(bufs);
+			}
 		}
 
-		// Unlock Mutex
-		LeaveCriticalSection(&cube::GetGame()->world->zones_critical_section);
+		heightmaps->Evict(zone_pos);
+
+		for (Structure* structure : *structures) {
+			structure->OnZoneUnloaded(zone_pos);
+		}
+	}
+
+	// Every block the batch writes, as [zone offset x, y, position in the zone x, y, z], in order.
+	static std::vector<std::pair<std::array<int, 5>, cube::Block>> BlocksWritten(const EditBatch& batch) {
+		std::vector<std::pair<std::array<int, 5>, cube::Block>> blocks;
+
+		batch.ForEachZone([&blocks](const IntVector2& zone_offset, const CubeBuffer& writes) {
+			writes.ForEach([&blocks, &zone_offset](const IntVector3& local_block_pos, const cube::Block& block) {
+				blocks.push_back(std::make_pair(std::array<int, 5>{ { zone_offset.x, zone_offset.y, local_block_pos.x, local_block_pos.y, local_block_pos.z } }, block));
+			});
+		});
+
+		std::sort(blocks.begin(), blocks.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		return blocks;
+	}
+
+	// Replays the delta onto the zone as it was before generating, and compares that with what generating did: the zone's fields and the writes to its neighbours.
+	// The zone is left as generating left it either way.
+	static bool ReplaysAsGenerated(cube::Zone* zone, const ZoneSnapshot& before, const ZoneDelta& delta, const EditBatch& neighbour_writes, Arena* arena) {
+		ZoneSnapshot generated(arena);
+		generated.Take(zone);
+		before.Restore(zone);
+
+		EditBatch replayed_writes(arena);
+		IntVector2 min, max;
+		delta.Apply(zone, replayed_writes, min, max);
+
+		bool same = true;
+
+		for (int i = 0; i < cube::BLOCKS_PER_ZONE * cube::BLOCKS_PER_ZONE && same; i++) {
+			same = !generated.HasChanged(zone->fields[i], i);
+		}
+
+		if (!same) {
+			generated.Restore(zone);
+			return false;
+		}
+
+		const auto generated_blocks = BlocksWritten(neighbour_writes);
+		const auto replayed_blocks = BlocksWritten(replayed_writes);
+
+		return generated_blocks.size() == replayed_blocks.size() && std::equal(generated_blocks.begin(), generated_blocks.end(), replayed_blocks.begin(), [](const auto& a, const auto& b) {
+			return a.first == b.first && std::memcmp(&a.second, &b.second, sizeof(cube::Block)) == 0;
+		});
 	}
 
 	void WorldRegion::GenerateInZone(cube::Zone* zone, std::set<cube::Zone*>& to_remesh) {
 		if (!zoneBuffers) return;
 
-		// Lock mutex
-		EnterCriticalSection(&cube::GetGame()->world->zones_critical_section);
+		CUBEWG_PROFILE_SCOPE("GenerateInZone");
+
+		// the world the zone is in, for its delta
+		uint64_t world_id;
+
+		{
+			std::lock_guard<std::mutex> lock(generated_world->mutex);
+
+			// nothing kept for the last world's zones applies to this one's
+			if (generated_world->world != zone->world) {
+				if (generated_world->world) {
+					ForgetWorld();
+				}
+
+				generated_world->world = zone->world;
+				generated_world->id++;
+			}
+
+			world_id = generated_world->id;
+		}
 
 		int base_x = zone->position.x;
 		int base_y = zone->position.y;
+		std::unique_ptr<CubeBuffer> to_paste[3][3];
 
 		// search around it in a square for buffers situated in this zone
 		for (int dx = -1; dx <= 1; dx++) {
@@ -126,36 +426,239 @@ namespace cubewg {
 
 				IntVector2 search_location(base_x + dx, base_y + dy);
 
-				std::unordered_map<IntVector2, NeighbourBuffers>::iterator bufs = zoneBuffers->find(search_location);
-
-				if (bufs != zoneBuffers->end()) {
-					NeighbourBuffers& buffer_collection = bufs->second;
+				// Detach the buffer under its stripe's lock, then paste it with no lock held. Writers only buffer for a zone while it isn't loaded, so nothing is added once it's detached.
+				ZoneBufferShard& shard = ShardOf(search_location);
+				std::lock_guard<std::mutex> lock(shard.mutex);
+				auto bufs = shard.buffers.find(search_location);
 
+				if (bufs != shard.buffers.end()) {
 					// reverse of dx and dy to get the relative coords of this zone from the buffer's parent zone
-					std::unique_ptr<CubeBuffer>& to_paste = buffer_collection.GetBuffer(-dx, -dy, false);
-
-					if (to_paste) {
-						//cube::GetGame()->PrintMessage(L"Placing ");
-						//cube::GetGame()->PrintMessage(std::to_wstring(to_paste->size()).c_str());
-						//cube::GetGame()->PrintMessage(L" Blocks.\n");
-						for (auto it = to_paste->begin(); it != to_paste->end(); it++) {
-							SetBlockInZone(zone, it->first, it->second, to_remesh);
+					to_paste[dx + 1][dy + 1] = bufs->second.Detach(-dx, -dy);
+
+					if (to_paste[dx + 1][dy + 1]) {
+						buffer_count--;
+						Recount(bufs->second);
+					}
+
+					if (bufs->second.IsEmpty()) {
+						Uncount(bufs->second);
+						shard.buffers.erase(bufs);
+					}
+				}
+			}
+		}
+
+		// Each generating thread reuses its arena from zone to zone, so once it has grown to fit a zone, generating allocates nothing from the heap.
+		static thread_local Arena arena;
+
+		{
+			// the structures which may place anything here. If none do, there's nothing to replay or record.
+			std::vector<Structure*, PoolAllocator<Structure*>> intersecting{ PoolAllocator<Structure*>(&arena) };
+
+			for (Structure* structure : *structures) {
+				structure_checks++;
+
+				if (!structure->MayIntersectZone(zone->position)) {
+					structures_culled++;
+					continue;
+				}
+
+				intersecting.push_back(structure);
+			}
+
+			std::shared_ptr<const ZoneDelta> delta = intersecting.empty() ? nullptr : deltas->Get(zone->position, world_id, generator_version);
+			std::shared_ptr<HeightmapTile> heights = heightmaps->Find(zone->position);
+			EditBatch neighbour_writes(&arena);
+			ZoneSnapshot before(&arena);
+
+			if (delta) {
+				// Generated before, so the columns generation changed are set as they were, rather than generated again. Buffers go on top, as they would have then.
+				CUBEWG_PROFILE_SCOPE("Replay delta");
+				IntVector2 min, max;
+
+				if (delta->Apply(zone, neighbour_writes, min, max)) {
+					if (heights) {
+						heights->Invalidate(min.x, min.y, max.x, max.y);
+					}
+
+					MarkForRemesh(zone, IntVector3(min.x, min.y, 0), IntVector3(max.x, max.y, 0), to_remesh);
+				}
+			} else if (!intersecting.empty()) {
+				// taken before pasting, so the delta holds everything generating here did
+				CUBEWG_PROFILE_SCOPE("Snapshot zone");
+				before.Take(zone);
+			}
+
+			{
+				CUBEWG_PROFILE_SCOPE("Paste buffers");
+
+				// Journalled buffers come from neighbours which have since unloaded, so are older than any held now, and go first.
+				// Checked after the stripes, as unloading neighbours journal their buffers before taking them from the stripes.
+				// Only the blocks are set while the journal is locked; the zones to remesh are found after, as that takes the game's lock, which writers to the journal may hold.
+				IntVector2 journal_min(cube::BLOCKS_PER_ZONE, cube::BLOCKS_PER_ZONE);
+				IntVector2 journal_max(-1, -1);
+
+				journal->Replay(zone->position, [&](const JournalEntry& entry) {
+					IntVector2 min, max;
+
+					if (SetBlocksInZone(zone, entry, min, max)) {
+						journal_min = IntVector2(std::min(journal_min.x, min.x), std::min(journal_min.y, min.y));
+						journal_max = IntVector2(std::max(journal_max.x, max.x), std::max(journal_max.y, max.y));
+					}
+				});
+
+				if (journal_max.x >= 0) {
+					if (heights) {
+						heights->Invalidate(journal_min.x, journal_min.y, journal_max.x, journal_max.y);
+					}
+
+					MarkForRemesh(zone, IntVector3(journal_min.x, journal_min.y, 0), IntVector3(journal_max.x, journal_max.y, 0), to_remesh);
+				}
+
+				for (int dx = -1; dx <= 1; dx++) {
+					for (int dy = -1; dy <= 1; dy++) {
+						if (to_paste[dx + 1][dy + 1]) {
+							PasteInZone(zone, heights.get(), *to_paste[dx + 1][dy + 1], to_remesh);
 						}
+					}
+				}
+			}
+
+			WorldRegion region(zone, &arena);
+
+			if (delta) {
+				// what it wrote to its neighbours goes to them (or their buffers) again, as generating would
+				region.Commit(neighbour_writes, to_remesh);
+			} else if (!intersecting.empty()) {
+				region.neighbour_writes = &neighbour_writes;
 
-						buffer_collection.Delete(-dx, -dy);
+				for (Structure* structure : intersecting) {
+					CUBEWG_PROFILE_PHASE(structure_phases->at(structure));
+					structure->Generate(region, zone->position, to_remesh);
+				}
+
+				region.neighbour_writes = nullptr;
+				CUBEWG_PROFILE_SCOPE("Record delta");
+				ZoneDelta recorded = ZoneDelta::Record(before, zone, neighbour_writes);
+
+				if (verify_deltas.load(std::memory_order_relaxed)) {
+					if (!ReplaysAsGenerated(zone, before, recorded, neighbour_writes, &arena)) {
+						delta_mismatches++;
+					}
+
+					deltas_verified++;
+
+					// other threads may have read the zone's heights while it was replayed
+					if (heights) {
+						heights->Invalidate(0, 0, cube::BLOCKS_PER_ZONE - 1, cube::BLOCKS_PER_ZONE - 1);
 					}
 				}
+
+				deltas->Put(zone->position, world_id, generator_version, std::move(recorded));
 			}
 		}
 
-		// Unlock Mutex
-		LeaveCriticalSection(&cube::GetGame()->world->zones_critical_section);
+		zones_generated++;
+		arena_allocations += arena.GetAllocations();
+		arena_heap_allocations += arena.GetHeapAllocations();
+		arena.Reset();
 
-		WorldRegion region(zone);
+		// every region of the zone is gone, so this thread holds no zones lock
+		EvictIfOverBudget();
+	}
 
-		for (Structure* structure : *structures) {
-			structure->Generate(region, zone->position, to_remesh);
+	long long WorldRegion::GetStructureChecks() {
+		return structure_checks.load();
+	}
+
+	long long WorldRegion::GetStructuresCulled() {
+		return structures_culled.load();
+	}
+
+	BufferJournal* WorldRegion::GetBufferJournal() {
+		return journal;
+	}
+
+	BufferMemory WorldRegion::GetBufferMemory() {
+		BufferMemory memory = {};
+
+		if (zoneBuffers) {
+			for (int i = 0; i < kZoneBufferShards; i++) {
+				std::lock_guard<std::mutex> lock(zoneBuffers[i].mutex);
+
+				for (auto& owner : zoneBuffers[i].buffers) {
+					for (const std::unique_ptr<CubeBuffer>& neighbour : owner.second.neighbours) {
+						if (neighbour) memory.blocks += neighbour->GetBlockCount();
+					}
+
+					// counting compacts the buffers, which may change what they hold
+					Recount(owner.second);
+				}
+
+				RecountFree(zoneBuffers[i]);
+				memory.free_bytes += zoneBuffers[i].free_bytes;
+			}
+		}
+
+		memory.bytes = buffer_bytes.load();
+		memory.owners = buffer_owners.load();
+		memory.buffers = buffer_count.load();
+		memory.peak_bytes = peak_buffer_bytes.load();
+		memory.peak_owners = peak_buffer_owners.load();
+		memory.peak_buffers = peak_buffer_count.load();
+		memory.budget = buffer_budget.load();
+		memory.eviction = (BufferEviction)buffer_eviction.load();
+		memory.owners_evicted = owners_evicted.load();
+		memory.bytes_evicted = bytes_evicted.load();
+		memory.owners_dropped = owners_dropped.load();
+		return memory;
+	}
+
+	void WorldRegion::SetBufferBudget(size_t bytes, BufferEviction eviction) {
+		buffer_budget = bytes;
+		buffer_eviction = (int)eviction;
+
+		if (zoneBuffers && buffer_bytes.load() > bytes) {
+			EvictBuffers();
+		}
+	}
+
+	void WorldRegion::SetPlayerZone(IntVector2 zone_pos) {
+		player_zone_x = zone_pos.x;
+		player_zone_y = zone_pos.y;
+	}
+
+	ZoneDeltaCache* WorldRegion::GetDeltaCache() {
+		return deltas;
+	}
+
+	void WorldRegion::SetVerifyDeltas(bool verify) {
+		verify_deltas.store(verify);
+	}
+
+	bool WorldRegion::IsVerifyingDeltas() {
+		return verify_deltas.load();
+	}
+
+	long long WorldRegion::GetDeltasVerified() {
+		return deltas_verified.load();
+	}
+
+	long long WorldRegion::GetDeltaMismatches() {
+		return delta_mismatches.load();
+	}
+
+	GenerationAllocations WorldRegion::GetAllocations() {
+		GenerationAllocations allocations = { zones_generated.load(), arena_allocations.load(), arena_heap_allocations.load(), 0, 0 };
+
+		if (zoneBuffers) {
+			for (int i = 0; i < kZoneBufferShards; i++) {
+				allocations.buffers += zoneBuffers[i].pool.GetAllocations();
+				allocations.buffers_heap += zoneBuffers[i].pool.GetHeapAllocations();
+			}
 		}
+
+		return allocations;
 	}
 
 	int WorldRegion::GenerateStructureAt(std::wstring structure, const LongVector3 & position, std::set<cube::Zone*>& to_remesh)
@@ -174,51 +677,233 @@ namespace cubewg {
 
 	// Helper Functions for Buffers
 
-	static void SetBlockInBuffer(cube::Zone* parent, int dx, int dy, IntVector3 local_block_pos, cube::Block block) {
+	// Writes to the buffer of blocks the parent zone has for its neighbour at [dx, dy] through write(CubeBuffer&), creating it if needed, and counts the memory it takes.
+	// Flags buffers over budget afterwards, for EvictIfOverBudget, as the caller may hold the zones lock.
+	template <typename Write>
+	static void WriteInBuffer(cube::Zone* parent, int dx, int dy, Write write) {
 		if (!zoneBuffers) return;
 
-		std::unordered_map<IntVector2, NeighbourBuffers>::iterator bufs = zoneBuffers->find(parent->position);
+		{
+			ZoneBufferShard& shard = ShardOf(parent->position);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+
+			// creates the parent's buffers if it has none yet
+			auto inserted = shard.buffers.emplace(parent->position, NeighbourBuffers());
+			NeighbourBuffers& buffer_collection = inserted.first->second;
 
-		// I still hate memory management
-		if (bufs != zoneBuffers->end()) {
-			NeighbourBuffers& buffer_collection = bufs->second;
+			if (inserted.second) {
+				RaisePeak(peak_buffer_owners, ++buffer_owners);
+			}
 
-			// add the block
-			(*buffer_collection.GetBuffer(dx, dy, true))[local_block_pos] = block;
-		} else {
-			// create value
-			NeighbourBuffers new_val;
-			(*new_val.GetBuffer(dx, dy, true))[local_block_pos] = block;
+			if (!buffer_collection.GetBuffer(dx, dy, false)) {
+				RaisePeak(peak_buffer_count, ++buffer_count);
+			}
+
+			write(*buffer_collection.GetBuffer(dx, dy, true, &shard.pool));
+			buffer_collection.last_write = ++buffer_writes;
+			Recount(buffer_collection);
+			// growing the buffer frees what it had outgrown to the pool
+			RecountFree(shard);
+			RaisePeak(peak_buffer_bytes, buffer_bytes.load());
+		}
 
-			(*zoneBuffers)[parent->position] = std::move(new_val);
+		if (buffer_bytes.load() > buffer_budget.load()) {
+			over_budget = true;
 		}
 	}
 
-	static void SetBlockInZone(cube::Zone* zone, IntVector3 local_block_pos, cube::Block block, std::set<cube::Zone*>& to_remesh) {
-		zone->SetBlock(local_block_pos, block, false);
+	static void SetBlockInBuffer(cube::Zone* parent, int dx, int dy, IntVector3 local_block_pos, cube::Block block) {
+		WriteInBuffer(parent, dx, dy, [&](CubeBuffer& buffer) {
+			buffer.Set(local_block_pos, block);
+		});
+	}
+
+	// Marks the zone for remeshing after changing blocks from local_min to local_max, along with any loaded neighbours whose faces the change touches.
+	static void MarkForRemesh(cube::Zone* zone, const IntVector3& local_min, const IntVector3& local_max, std::set<cube::Zone*>& to_remesh) {
 		to_remesh.insert(zone);
 
-		// make sure neighbouring zones are refreshed if they are loaded
+		const bool on_edge = local_min.x == 0 || local_min.y == 0 || local_max.x == cube::BLOCKS_PER_ZONE - 1 || local_max.y == cube::BLOCKS_PER_ZONE - 1;
+
+		if (!on_edge) return;
+
+		// make sure neighbouring zones are refreshed if they are loaded. Looking them up is the only part which needs the game's lock.
 		cube::World* world = zone->world;
 		IntVector2 zone_pos = zone->position;
 
-		if (local_block_pos.x == 0) {
+		CriticalSectionLock zones_lock(&world->zones_critical_section);
+		const long long acquired = LockProfiler::Acquire(zones_lock, LockSite::MARK_FOR_REMESH);
+
+		if (local_min.x == 0) {
 			cube::Zone* zone = world->GetZone(IntVector2(zone_pos.x - 1, zone_pos.y));
 			if (zone) to_remesh.insert(zone);
 		}
-		else if (local_block_pos.x == cube::BLOCKS_PER_ZONE - 1) {
+
+		if (local_max.x == cube::BLOCKS_PER_ZONE - 1) {
 			cube::Zone* zone = world->GetZone(IntVector2(zone_pos.x + 1, zone_pos.y));
 			if (zone) to_remesh.insert(zone);
 		}
 
-		if (local_block_pos.y == 0) {
+		if (local_min.y == 0) {
 			cube::Zone* zone = world->GetZone(IntVector2(zone_pos.x, zone_pos.y - 1));
 			if (zone) to_remesh.insert(zone);
 		}
-		else if (local_block_pos.y == cube::BLOCKS_PER_ZONE - 1) {
+
+		if (local_max.y == cube::BLOCKS_PER_ZONE - 1) {
 			cube::Zone* zone = world->GetZone(IntVector2(zone_pos.x, zone_pos.y + 1));
 			if (zone) to_remesh.insert(zone);
 		}
+
+		LockProfiler::Release(zones_lock, LockSite::MARK_FOR_REMESH, acquired);
+	}
+
+	// Marks the cached heights of the zone at zone_pos out of date from local_min to local_max, if it has any. They're recomputed when next asked for.
+	static void InvalidateHeightsIn(const IntVector2& zone_pos, const IntVector2& local_min, const IntVector2& local_max) {
+		if (!heightmaps) return;
+
+		std::shared_ptr<HeightmapTile> tile = heightmaps->Find(zone_pos);
+
+		if (tile) {
+			tile->Invalidate(local_min.x, local_min.y, local_max.x, local_max.y);
+		}
+	}
+
+	// The zone setters take the zone's cached heights (nullptr if it has none) to mark out of date.
+
+	static void SetBlockInZone(cube::Zone* zone, HeightmapTile* heights, IntVector3 local_block_pos, cube::Block block, std::set<cube::Zone*>& to_remesh) {
+		zone->SetBlock(local_block_pos, block, false);
+
+		if (heights) {
+			heights->Invalidate(local_block_pos.x, local_block_pos.y, local_block_pos.x, local_block_pos.y);
+		}
+
+		MarkForRemesh(zone, local_block_pos, local_block_pos, to_remesh);
+	}
+
+	// Sets every block in the box from local_min to local_max (inclusive, within the zone) and marks the zones to remesh once for the whole box.
+	static void FillInZone(cube::Zone* zone, HeightmapTile* heights, const IntVector3& local_min, const IntVector3& local_max, cube::Block block, std::set<cube::Zone*>& to_remesh) {
+		for (int x = local_min.x; x <= local_max.x; x++) {
+			for (int y = local_min.y; y <= local_max.y; y++) {
+				for (int z = local_min.z; z <= local_max.z; z++) {
+					zone->SetBlock(IntVector3(x, y, z), block, false);
+				}
+			}
+		}
+
+		if (heights) {
+			heights->Invalidate(local_min.x, local_min.y, local_max.x, local_max.y);
+		}
+
+		MarkForRemesh(zone, local_min, local_max, to_remesh);
+	}
+
+	// Sets every block of the buffer (a CubeBuffer or JournalEntry) in the zone, in field order, and gets the box of columns set. Returns false if there were none.
+	template <typename Blocks>
+	static bool SetBlocksInZone(cube::Zone* zone, const Blocks& blocks, IntVector2& min, IntVector2& max) {
+		blocks.ForEachRun([zone](int x, int y, int min_z, int max_z, const cube::Block& block) {
+			for (int z = min_z; z <= max_z; z++) {
+				zone->SetBlock(IntVector3(x, y, z), block, false);
+			}
+		});
+
+		return blocks.GetBounds(min, max);
+	}
+
+	// Sets every block of the buffer in the zone, then marks the zones to remesh once for everything pasted.
+	template <typename Blocks>
+	static void PasteInZone(cube::Zone* zone, HeightmapTile* heights, const Blocks& blocks, std::set<cube::Zone*>& to_remesh) {
+		IntVector2 min, max;
+
+		if (SetBlocksInZone(zone, blocks, min, max)) {
+			if (heights) {
+				heights->Invalidate(min.x, min.y, max.x, max.y);
+			}
+
+			MarkForRemesh(zone, IntVector3(min.x, min.y, 0), IntVector3(max.x, max.y, 0), to_remesh);
+		}
+	}
+
+	static void MergeInBuffer(cube::Zone* parent, int dx, int dy, const CubeBuffer& blocks) {
+		WriteInBuffer(parent, dx, dy, [&](CubeBuffer& buffer) {
+			buffer.Merge(blocks);
+		});
+	}
+
+	static void FillInBuffer(cube::Zone* parent, int dx, int dy, const IntVector3& local_min, const IntVector3& local_max, cube::Block block) {
+		WriteInBuffer(parent, dx, dy, [&](CubeBuffer& buffer) {
+			for (int x = local_min.x; x <= local_max.x; x++) {
+				for (int y = local_min.y; y <= local_max.y; y++) {
+					buffer.SetColumn(x, y, local_min.z, local_max.z, block);
+				}
+			}
+		});
+	}
+
+	// Evicts if a write to a buffer has gone over budget since. Call it with no zones lock held, as eviction trims every stripe's pool and writes to the journal.
+	static void EvictIfOverBudget() {
+		if (over_budget.exchange(false)) {
+			EvictBuffers();
+		}
+	}
+
+	// Returns the memory the pools keep for reuse to the heap, then evicts whole owners, in the order the eviction policy says, until buffers are back under 90% of the budget.
+	// Each goes to the journal, so its writes are kept unless that can't take them, and what it held is returned to the heap rather than kept by its pool.
+	// Owners are gathered one stripe at a time and evicted one at a time, so no two stripes are ever locked at once. Any still writing just start afresh, after what was journalled.
+	static void EvictBuffers() {
+		bool expected = false;
+
+		if (!evicting.compare_exchange_strong(expected, true)) return;
+
+		const size_t budget = buffer_budget.load();
+		const size_t target = budget - budget / 10;
+		const bool farthest = buffer_eviction.load() == (int)BufferEviction::FARTHEST;
+		const long long player_x = player_zone_x.load();
+		const long long player_y = player_zone_y.load();
+
+		// lowest evicted first
+		std::vector<std::pair<long long, IntVector2>> owners;
+
+		for (int i = 0; i < kZoneBufferShards; i++) {
+			TrimPool(zoneBuffers[i]);
+			std::lock_guard<std::mutex> lock(zoneBuffers[i].mutex);
+
+			for (const auto& owner : zoneBuffers[i].buffers) {
+				const long long dx = owner.first.x - player_x;
+				const long long dy = owner.first.y - player_y;
+				owners.emplace_back(farthest ? -(dx * dx + dy * dy) : owner.second.last_write, owner.first);
+			}
+		}
+
+		std::sort(owners.begin(), owners.end(), [](const std::pair<long long, IntVector2>& a, const std::pair<long long, IntVector2>& b) { return a.first < b.first; });
+
+		for (const auto& owner : owners) {
+			if (buffer_bytes.load() <= target) break;
+
+			ZoneBufferShard& shard = ShardOf(owner.second);
+
+			{
+				// freed after the lock
+				NeighbourBuffers removed;
+				std::lock_guard<std::mutex> lock(shard.mutex);
+				auto bufs = shard.buffers.find(owner.second);
+
+				// removed since it was gathered
+				if (bufs == shard.buffers.end()) continue;
+
+				if (!JournalBuffers(owner.second, bufs->second)) {
+					owners_dropped++;
+				}
+
+				owners_evicted++;
+				bytes_evicted += (long long)bufs->second.bytes;
+				Uncount(bufs->second);
+				removed = std::move(bufs->second);
+				shard.buffers.erase(bufs);
+			}
+
+			TrimPool(shard);
+		}
+
+		evicting = false;
 	}
 
 	// conversions
@@ -255,17 +940,27 @@ namespace cubewg {
 	WorldRegion::WorldRegion(cube::World* world) {
 		this->world = world;
 		this->zone = nullptr;
+		this->arena = nullptr;
+		this->heights_checked = -1;
+		this->neighbour_writes = nullptr;
 	}
 
-	WorldRegion::WorldRegion(cube::Zone* zone) {
+	WorldRegion::WorldRegion(cube::Zone* zone, Arena* arena) {
 		this->world = nullptr;
 		this->zone = zone;
+		this->arena = arena;
+		this->heights_checked = -1;
+		this->neighbour_writes = nullptr;
 	}
 
 	WorldRegion::~WorldRegion() {
 		// NO-OP
 	}
 
+	cube::Zone* WorldRegion::GetNeighbour(int dx, int dy) {
+		return this->zone->world->GetZone(this->zone->position.x + dx, this->zone->position.y + dy);
+	}
+
 	cube::Block* WorldRegion::GetBlock(LongVector3 block_pos) {
 		if (this->world) {
 			return this->world->GetBlock(block_pos);
@@ -297,6 +992,10 @@ namespace cubewg {
 		return field->base_z;
 	}
 
+	Arena* WorldRegion::GetArena() {
+		return this->arena;
+	}
+
 	cube::Zone* WorldRegion::GetZone(LongVector2 block_pos) {
 		if (this->world) {
 			IntVector2 zone_pos = cube::Zone::ZoneCoordsFromBlocks(block_pos.x, block_pos.y);
@@ -324,57 +1023,58 @@ namespace cubewg {
 		if (!zone) {
 			return cubewg::kNoPosition;
 		}
-		
-		int field_index = local_block_pos.x * cube::BLOCKS_PER_ZONE + local_block_pos.y;
-		cube::Field* field = &zone->fields[field_index];
-		int base_z = field->base_z;
-
-		cube::Block* blocc;
 
 		switch (heightmap) {
 		case Heightmap::WORLD_SURFACE:
-			// First block with air/plant above it is world surface.
-			// Start at 1 as cannot return below base_z
-			for (int zo = 1; zo < 64; zo++) {
-				blocc = zone->GetBlock(IntVector3(local_block_pos.x, local_block_pos.y, base_z + zo));
+		case Heightmap::MOTION_BLOCKING:
+		case Heightmap::OCEAN_FLOOR:
+			break;
+		default:
+			return cubewg::kNoPosition;
+		}
 
-				if (!blocc || blocc->type == cube::Block::Air || blocc->type == cube::Block::Leaves) {
-					return base_z + zo - 1;
-				}
+		// Zone regions keep their own zone's tile, so only the first lookup goes through the cache.
+		if (this->zone) {
+			if (!this->heights) {
+				this->heights = heightmaps->Get(zone);
 			}
 
-			// No block found
-			// Assume no position.
-			return cubewg::kNoPosition;
-		case Heightmap::MOTION_BLOCKING:
-		case Heightmap::OCEAN_FLOOR:
-			// Search from top to bottom.
-			for (int zo = 63; zo >= 0; zo--) {
-				blocc = zone->GetBlock(IntVector3(local_block_pos.x, local_block_pos.y, base_z + zo));
-
-				if (blocc) {
-					if (blocc->type != cube::Block::Air) {
-						switch (heightmap) {
-						case Heightmap::MOTION_BLOCKING:
-							return base_z + zo;
-						case Heightmap::OCEAN_FLOOR:
-							// Ocean floor goes through liquids.
-							if (blocc->type != cube::Block::Water && blocc->type != cube::Block::Lava) {
-								return base_z + zo;
-							}
+			return this->heights->Get(zone, local_block_pos.x, local_block_pos.y, heightmap);
+		}
 
-							break;
-						}
-					}
-				}
+		return heightmaps->Get(zone)->Get(zone, local_block_pos.x, local_block_pos.y, heightmap);
+	}
+
+	void WorldRegion::InvalidateHeights(LongVector2 block_pos) {
+		if (this->world) {
+			IntVector2 local_block_pos = ToLocalBlockPos(block_pos);
+			InvalidateHeightsIn(cube::Zone::ZoneCoordsFromBlocks(block_pos.x, block_pos.y), local_block_pos, local_block_pos);
+		} else {
+			IntVector2 local_block_pos = AsLocalBlockPos(block_pos);
+			HeightmapTile* heights = this->HeightsOf(this->zone).get();
+
+			if (heights) {
+				heights->Invalidate(local_block_pos.x, local_block_pos.y, local_block_pos.x, local_block_pos.y);
 			}
+		}
+	}
 
-			// No block found
-			// Assume heightmap is at the base position.
-			return base_z;
-		default:
-			return cubewg::kNoPosition;
+	std::shared_ptr<HeightmapTile> WorldRegion::HeightsOf(cube::Zone* zone) {
+		if (zone != this->zone) {
+			return heightmaps->Find(zone->position);
 		}
+
+		// A zone region's own tile is looked up again only if tiles have been made since it last looked, so writes to a zone without one don't each search the cache.
+		if (!this->heights) {
+			const long long tiles_made = heightmaps->GetTilesMade();
+
+			if (tiles_made != this->heights_checked) {
+				this->heights_checked = tiles_made;
+				this->heights = heightmaps->Find(zone->position);
+			}
+		}
+
+		return this->heights;
 	}
 
 	void WorldRegion::SetBlock(LongVector3 block_pos, cube::Block block, std::set<cube::Zone*>& to_remesh) {
@@ -385,6 +1085,7 @@ namespace cubewg {
 			to_remesh.insert(this->world->GetZone(zone_pos));
 
 			IntVector3 local_block_pos = ToLocalBlockPos(block_pos);
+			InvalidateHeightsIn(zone_pos, IntVector2(local_block_pos.x, local_block_pos.y), IntVector2(local_block_pos.x, local_block_pos.y));
 
 			if (local_block_pos.x == 0) {
 				cube::Zone* zone = this->world->GetZone(IntVector2(zone_pos.x - 1, zone_pos.y));
@@ -422,27 +1123,155 @@ namespace cubewg {
 			}
 
 			if (dx == 0 && dy == 0) { // if they're within our zone just use it
-				SetBlockInZone(this->zone, AsLocalBlockPos(block_pos), block, to_remesh);
+				SetBlockInZone(this->zone, this->HeightsOf(this->zone).get(), AsLocalBlockPos(block_pos), block, to_remesh);
 			}
 			else {
-				IntVector2 zone_pos = this->zone->position;
-				// Lock Mutex
-				EnterCriticalSection(&cube::GetGame()->world->zones_critical_section);
-				cube::Zone* zone = this->zone->world->GetZone(zone_pos.x + dx, zone_pos.y + dy);
+				// Lock Mutex. Held while buffering too, so the neighbour can't load (and paste its buffers) between the lookup and the write.
+				CriticalSectionLock zones_lock(&cube::GetGame()->world->zones_critical_section);
+				ProfiledLock<CriticalSectionLock> lock(zones_lock, LockSite::SET_BLOCK);
+				cube::Zone* zone = this->GetNeighbour(dx, dy);
 
 				if (zone) {
-					SetBlockInZone(zone, ToLocalBlockPos(block_pos), block, to_remesh);
+					SetBlockInZone(zone, this->HeightsOf(zone).get(), ToLocalBlockPos(block_pos), block, to_remesh);
 				}
 				else {
 					SetBlockInBuffer(this->zone, dx, dy, ToLocalBlockPos(block_pos), block);
 				}
 
-				// Unlock Mutex
-				LeaveCriticalSection(&cube::GetGame()->world->zones_critical_section);
+				if (this->neighbour_writes) {
+					this->neighbour_writes->SetBlock(block_pos, block);
+				}
 			}
 		}
 	}
 
+	void WorldRegion::FillColumn(long long x, long long y, long long min_z, long long max_z, cube::Block block, std::set<cube::Zone*>& to_remesh) {
+		this->FillBox(LongVector3(x, y, min_z), LongVector3(x, y, max_z), block, to_remesh);
+	}
+
+	void WorldRegion::FillBox(LongVector3 min, LongVector3 max, cube::Block block, std::set<cube::Zone*>& to_remesh) {
+		if (min.x > max.x || min.y > max.y || min.z > max.z) return;
+
+		// split the box at zone borders, so each zone's part is done at once. In zone regions, these are relative to this zone.
+		const IntVector2 min_zone = cube::Zone::ZoneCoordsFromBlocks(min.x, min.y);
+		const IntVector2 max_zone = cube::Zone::ZoneCoordsFromBlocks(max.x, max.y);
+
+		if (this->zone && (min_zone.x < -1 || min_zone.y < -1 || max_zone.x > 1 || max_zone.y > 1)) {
+			throw std::invalid_argument("Block Positions are outside of the zone and its neighbours.");
+		}
+
+		for (int zone_x = min_zone.x; zone_x <= max_zone.x; zone_x++) {
+			for (int zone_y = min_zone.y; zone_y <= max_zone.y; zone_y++) {
+				const long long zone_min_x = (long long)zone_x * cube::BLOCKS_PER_ZONE;
+				const long long zone_min_y = (long long)zone_y * cube::BLOCKS_PER_ZONE;
+
+				const IntVector3 local_min(
+					(int)(std::max(min.x, zone_min_x) - zone_min_x),
+					(int)(std::max(min.y, zone_min_y) - zone_min_y),
+					(int)min.z);
+				const IntVector3 local_max(
+					(int)(std::min(max.x, zone_min_x + cube::BLOCKS_PER_ZONE - 1) - zone_min_x),
+					(int)(std::min(max.y, zone_min_y + cube::BLOCKS_PER_ZONE - 1) - zone_min_y),
+					(int)max.z);
+
+				if (this->world) {
+					cube::Zone* zone = this->world->GetZone(IntVector2(zone_x, zone_y));
+
+					if (zone) {
+						FillInZone(zone, this->HeightsOf(zone).get(), local_min, local_max, block, to_remesh);
+					}
+					else {
+						// not loaded: leave it to the world, as SetBlock does
+						for (long long x = local_min.x; x <= local_max.x; x++) {
+							for (long long y = local_min.y; y <= local_max.y; y++) {
+								for (long long z = local_min.z; z <= local_max.z; z++) {
+									this->world->SetBlock(LongVector3(zone_min_x + x, zone_min_y + y, z), block, false);
+								}
+							}
+						}
+					}
+				}
+				else if (zone_x == 0 && zone_y == 0) { // if they're within our zone just use it
+					FillInZone(this->zone, this->HeightsOf(this->zone).get(), local_min, local_max, block, to_remesh);
+				}
+				else {
+					// Lock Mutex. Held while buffering too, so the neighbour can't load (and paste its buffers) between the lookup and the write.
+					CriticalSectionLock zones_lock(&cube::GetGame()->world->zones_critical_section);
+					ProfiledLock<CriticalSectionLock> lock(zones_lock, LockSite::FILL_BOX);
+					cube::Zone* zone = this->GetNeighbour(zone_x, zone_y);
+
+					if (zone) {
+						FillInZone(zone, this->HeightsOf(zone).get(), local_min, local_max, block, to_remesh);
+					}
+					else {
+						FillInBuffer(this->zone, zone_x, zone_y, local_min, local_max, block);
+					}
+
+					if (this->neighbour_writes) {
+						this->neighbour_writes->FillBox(LongVector3(zone_min_x + local_min.x, zone_min_y + local_min.y, local_min.z), LongVector3(zone_min_x + local_max.x, zone_min_y + local_max.y, local_max.z), block);
+					}
+				}
+			}
+		}
+	}
+
+	void WorldRegion::Commit(EditBatch& batch, std::set<cube::Zone*>& to_remesh) {
+		if (this->zone) {
+			// check before writing anything, so a bad batch isn't half applied
+			batch.ForEachZone([](const IntVector2& zone_offset, const CubeBuffer& blocks) {
+				if (zone_offset.x < -1 || zone_offset.y < -1 || zone_offset.x > 1 || zone_offset.y > 1) {
+					throw std::invalid_argument("Block Positions are outside of the zone and its neighbours.");
+				}
+			});
+		}
+
+		batch.ForEachZone([this, &to_remesh](const IntVector2& zone_pos, const CubeBuffer& blocks) {
+			if (this->world) {
+				cube::Zone* zone = this->world->GetZone(zone_pos);
+
+				if (zone) {
+					PasteInZone(zone, this->HeightsOf(zone).get(), blocks, to_remesh);
+				}
+				else {
+					// not loaded: leave it to the world, as SetBlock does
+					const long long zone_min_x = (long long)zone_pos.x * cube::BLOCKS_PER_ZONE;
+					const long long zone_min_y = (long long)zone_pos.y * cube::BLOCKS_PER_ZONE;
+
+					blocks.ForEach([this, zone_min_x, zone_min_y](const IntVector3& local_block_pos, const cube::Block& block) {
+						this->world->SetBlock(LongVector3(zone_min_x + local_block_pos.x, zone_min_y + local_block_pos.y, local_block_pos.z), block, false);
+					});
+				}
+			}
+			else if (zone_pos.x == 0 && zone_pos.y == 0) {
+				PasteInZone(this->zone, this->HeightsOf(this->zone).get(), blocks, to_remesh);
+			}
+			else {
+				// Lock Mutex, once for everything going to this neighbour. Held while buffering, as in SetBlock.
+				CriticalSectionLock zones_lock(&cube::GetGame()->world->zones_critical_section);
+				ProfiledLock<CriticalSectionLock> lock(zones_lock, LockSite::COMMIT);
+				cube::Zone* zone = this->GetNeighbour(zone_pos.x, zone_pos.y);
+
+				if (zone) {
+					PasteInZone(zone, this->HeightsOf(zone).get(), blocks, to_remesh);
+				}
+				else {
+					MergeInBuffer(this->zone, zone_pos.x, zone_pos.y, blocks);
+				}
+
+				if (this->neighbour_writes) {
+					const long long zone_min_x = (long long)zone_pos.x * cube::BLOCKS_PER_ZONE;
+					const long long zone_min_y = (long long)zone_pos.y * cube::BLOCKS_PER_ZONE;
+
+					blocks.ForEachRun([this, zone_min_x, zone_min_y](int x, int y, int min_z, int max_z, const cube::Block& block) {
+						this->neighbour_writes->FillColumn(zone_min_x + x, zone_min_y + y, min_z, max_z, block);
+					});
+				}
+			}
+		});
+
+		batch.Clear();
+	}
+
 	cube::Block BlockOf(const int r, const int g, const int b, const cube::Block::Type type, const bool breakable) {
 		cube::Block result;
 		result.red = r;
@@ -2,7 +2,11 @@
 
 #include <cwsdk.h>
 
+#include <memory>
+
 #include "Structure.h"
+#include "EditBatch.h"
+#include "MemoryPool.h"
 
 namespace cubewg {
 	// consts
@@ -11,27 +15,92 @@ namespace cubewg {
 
 	cube::Block BlockOf(const int r, const int g, const int b, const cube::Block::Type type = cube::Block::Solid, const bool breakable = false);
 
+	struct HeightmapTile;
+	class BufferJournal;
+	class ZoneDeltaCache;
+
 	enum class Heightmap {
 		MOTION_BLOCKING,
 		WORLD_SURFACE,
 		OCEAN_FLOOR
 	};
 
+	/* Allocations made while generating zones: from each zone's arena, for temporaries, and from the pools holding buffers for neighbours which haven't loaded.
+	 * Each also counts how many of them needed the heap.
+	 */
+	struct GenerationAllocations {
+		long long zones;
+		long long arena;
+		long long arena_heap;
+		long long buffers;
+		long long buffers_heap;
+	};
+
+	/* Which owner zones' buffers go first when buffers are over their memory budget.
+	*/
+	enum class BufferEviction {
+		// least recently written to
+		OLDEST,
+		// furthest from the player
+		FARTHEST
+	};
+
+	/* Memory held by buffers waiting for neighbours to load, now and at its highest. Bytes count each owner zone's map entry, the memory each buffer holds as its pool rounds it,
+	 * and what the pools keep on their free lists for reuse.
+	 * Over budget, once the zone generating has finished, the free lists are returned to the heap, then whole owners are evicted to the buffer journal (or dropped, if it isn't open) until they are back under 90% of it.
+	 */
+	struct BufferMemory {
+		size_t bytes;
+		// of bytes, freed by buffers and kept by the pools
+		size_t free_bytes;
+		size_t owners;
+		size_t buffers;
+		size_t blocks;
+
+		size_t peak_bytes;
+		size_t peak_owners;
+		size_t peak_buffers;
+
+		size_t budget;
+		BufferEviction eviction;
+		long long owners_evicted;
+		long long bytes_evicted;
+		// evicted when the journal wasn't open, so lost
+		long long owners_dropped;
+	};
+
 	/* Abstraction between zones and worlds with some additional useful utilities. Zonal world generation hooks into zone buffers.
 	*/
 	class WorldRegion {
 	private:
 		cube::World* world;
 		cube::Zone* zone;
+		Arena* arena;
+		// this zone's heights, for zone regions. Got from the cache the first time they're asked for.
+		std::shared_ptr<HeightmapTile> heights;
+		// how many tiles the cache had made when heights was last looked for
+		long long heights_checked;
+
+		// where writes to the neighbours are recorded as well, while generation is being recorded. See GenerateInZone.
+		EditBatch* neighbour_writes;
+
+		/* Gets the zone's cached heights, or nullptr if it has none, to mark out of date when writing to it.
+		*/
+		std::shared_ptr<HeightmapTile> HeightsOf(cube::Zone* zone);
+
+		/* Gets the zone offset by [dx, dy] from this zone. The game's zones lock must be held.
+		*/
+		cube::Zone* GetNeighbour(int dx, int dy);
 
 	public:
 		/* Generation for runtime/tests using world.
 		*/
 		WorldRegion(cube::World* world);
 
-		/* Generation for worldgen using zone/buffers
+		/* Generation for worldgen using zone/buffers. Temporaries of the generation may be allocated from the arena, which is reset once the zone has generated.
 		*/
-		WorldRegion(cube::Zone* zone);
+		WorldRegion(cube::Zone* zone, Arena* arena = nullptr);
+
 		~WorldRegion();
 
 		/* Takes an [x, y] position and returns base z at that position. If the zone hasn't loaded, returns cubewg::kNoPosition.
@@ -39,6 +108,7 @@ namespace cubewg {
 		int GetBaseZ(LongVector2 block_pos);
 
 		/* Takes an [x, y] position and returns height at that position. The exact method is determined by the heightmap.
+		 * Heights are cached per zone, so this is a lookup unless the column has changed since it was last asked for.
 		 * If the zone has not loaded, it will return cubewg::kNoPosition. Additionally, if there is no valid position for the heightmap, it will return cubewg::kNoPosition.
 		 * 
 		 * @param block_pos: the position to get the height at.
@@ -47,10 +117,32 @@ namespace cubewg {
 		 */
 		int GetHeight(LongVector2 block_pos, const Heightmap heightmap);
 
+		/* Marks the cached heights of the column at [x, y] out of date. Blocks set through the region do this themselves; call it after changing a zone's fields directly.
+		*/
+		void InvalidateHeights(LongVector2 block_pos);
+
 		cube::Block* GetBlock(LongVector3 block_pos);
 
 		void SetBlock(LongVector3 block_pos, cube::Block block, std::set<cube::Zone*>& to_remesh);
 
+		/* Sets every block in the column at [x, y] from min_z to max_z inclusive. Equivalent to calling SetBlock for each, but the zone lookup, buffering and remesh bookkeeping are done once for the column.
+		*/
+		void FillColumn(long long x, long long y, long long min_z, long long max_z, cube::Block block, std::set<cube::Zone*>& to_remesh);
+
+		/* Sets every block in the box from min to max inclusive. Equivalent to calling SetBlock for each, but the zone lookup, buffering and remesh bookkeeping are done once per zone the box spans.
+		 * In zone regions the box may reach into the 8 neighbouring zones, as with SetBlock.
+		 */
+		void FillBox(LongVector3 min, LongVector3 max, cube::Block block, std::set<cube::Zone*>& to_remesh);
+
+		/* Applies the batch's writes, then clears it. Each zone written to is looked up, locked and marked to remesh once, however many blocks it gets.
+		 * Equivalent to calling SetBlock for each write in the batch, other than the order in which they land.
+		 */
+		void Commit(EditBatch& batch, std::set<cube::Zone*>& to_remesh);
+
+		/* Memory for temporaries which need only last until the zone has generated, such as edit batches. nullptr if there is none, in which case use the heap.
+		*/
+		Arena* GetArena();
+
 		/* Get the centre zone. Must provide a block pos in the centre for world-based world regions (i'll modify this in the future).
 		*/
 		cube::Zone* GetZone(LongVector2 block_pos);
@@ -63,12 +155,41 @@ namespace cubewg {
 		/* Internal method called on initialisation.
 		*/
 		static void Initialise();
-		/* Internal method called on zone deletion.
+		/* Internal method called on zone deletion. Also lets each structure know the zone has unloaded.
 		*/
 		static void CleanUpBuffers(IntVector2 zone_pos);
 		/* Internal method called on zone generation.
 		*/
 		static void GenerateInZone(cube::Zone* zone, std::set<cube::Zone*>& to_remesh);
+		/* How many times GenerateInZone has asked a structure to generate in a zone, and how many of those the structure's MayIntersectZone culled.
+		*/
+		static long long GetStructureChecks();
+		static long long GetStructuresCulled();
+		static GenerationAllocations GetAllocations();
+		/* Memory held by buffers for neighbours. Counting the blocks buffered takes each stripe's lock in turn, so this is for reporting, not for every tick.
+		*/
+		static BufferMemory GetBufferMemory();
+		/* Sets how many bytes buffers may hold, and which owners are evicted first when over it. Evicts straight away if they are over the new budget.
+		*/
+		static void SetBufferBudget(size_t bytes, BufferEviction eviction);
+		/* Lets eviction know where the player is, for BufferEviction::FARTHEST.
+		*/
+		static void SetPlayerZone(IntVector2 zone_pos);
+		/* The journal of buffers left by unloaded zones for zones not yet loaded.
+		*/
+		static BufferJournal* GetBufferJournal();
+		/* The deltas of zones' generation, replayed when they reload.
+		*/
+		static ZoneDeltaCache* GetDeltaCache();
+		/* Whether each delta recorded is checked by replaying it onto the zone as it was before generating, and comparing that with what generating did.
+		 * Off by default, as it copies the zone twice more for every zone generated.
+		 */
+		static void SetVerifyDeltas(bool verify);
+		static bool IsVerifyingDeltas();
+		/* Deltas checked, and how many of those didn't replay to what generating did.
+		*/
+		static long long GetDeltasVerified();
+		static long long GetDeltaMismatches();
 		/* Internal method called to force-generate for debug.
 		*/
 		static int GenerateStructureAt(std::wstring structure, const LongVector3& position, std::set<cube::Zone*>& to_remesh);
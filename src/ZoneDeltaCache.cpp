@@ -0,0 +1,446 @@
+#include "ZoneDeltaCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	const int kFieldCount = cube::BLOCKS_PER_ZONE * cube::BLOCKS_PER_ZONE;
+
+	// Encoding
+
+	void WriteUnsigned(std::vector<uint8_t>& bytes, uint32_t value) {
+		while (value >= 0x80) {
+			bytes.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+
+		bytes.push_back((uint8_t)value);
+	}
+
+	// zigzagged, so small negative numbers are as short as small positive ones
+	void WriteSigned(std::vector<uint8_t>& bytes, int value) {
+		WriteUnsigned(bytes, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+	}
+
+	uint32_t ReadUnsigned(const uint8_t*& in) {
+		uint32_t value = 0;
+		int shift = 0;
+
+		while (*in & 0x80) {
+			value |= (uint32_t)(*in++ & 0x7F) << shift;
+			shift += 7;
+		}
+
+		return value | ((uint32_t)*in++ << shift);
+	}
+
+	int ReadSigned(const uint8_t*& in) {
+		const uint32_t value = ReadUnsigned(in);
+		return (int)(value >> 1) ^ -(int)(value & 1);
+	}
+
+	// Distinct blocks of a delta, found by linear search as in CubeBuffer.
+	class Palette {
+	private:
+		std::vector<cube::Block> blocks;
+		uint32_t last;
+	public:
+		Palette() : last(0) {
+		}
+
+		uint32_t IndexOf(const cube::Block& block) {
+			if (last < blocks.size() && std::memcmp(&blocks[last], &block, sizeof(cube::Block)) == 0) {
+				return last;
+			}
+
+			for (size_t i = 0; i < blocks.size(); i++) {
+				if (std::memcmp(&blocks[i], &block, sizeof(cube::Block)) == 0) {
+					last = (uint32_t)i;
+					return last;
+				}
+			}
+
+			blocks.push_back(block);
+			last = (uint32_t)(blocks.size() - 1);
+			return last;
+		}
+
+		void WriteTo(std::vector<uint8_t>& bytes) const {
+			WriteUnsigned(bytes, (uint32_t)blocks.size());
+			const uint8_t* raw = reinterpret_cast<const uint8_t*>(blocks.data());
+			bytes.insert(bytes.end(), raw, raw + blocks.size() * sizeof(cube::Block));
+		}
+	};
+}
+
+// ZoneSnapshot
+
+cubewg::ZoneSnapshot::ZoneSnapshot(MemoryPool* pool) : base_zs(PoolAllocator<int>(pool)), starts(PoolAllocator<uint32_t>(pool)), blocks(PoolAllocator<cube::Block>(pool)) {
+}
+
+void cubewg::ZoneSnapshot::Take(const cube::Zone* zone) {
+	base_zs.resize(kFieldCount);
+	starts.resize(kFieldCount + 1);
+	blocks.clear();
+
+	for (int i = 0; i < kFieldCount; i++) {
+		const cube::Field& field = zone->fields[i];
+		base_zs[i] = field.base_z;
+		starts[i] = (uint32_t)blocks.size();
+		blocks.insert(blocks.end(), field.blocks.begin(), field.blocks.end());
+	}
+
+	starts[kFieldCount] = (uint32_t)blocks.size();
+}
+
+bool cubewg::ZoneSnapshot::HasChanged(const cube::Field& field, int field_index) const {
+	const size_t size = starts[field_index + 1] - starts[field_index];
+
+	if (field.base_z != base_zs[field_index] || field.blocks.size() != size) {
+		return true;
+	}
+
+	return size > 0 && std::memcmp(field.blocks.data(), &blocks[starts[field_index]], size * sizeof(cube::Block)) != 0;
+}
+
+void cubewg::ZoneSnapshot::Restore(cube::Zone* zone) const {
+	for (int i = 0; i < kFieldCount; i++) {
+		cube::Field& field = zone->fields[i];
+		field.base_z = base_zs[i];
+		field.blocks.assign(blocks.begin() + starts[i], blocks.begin() + starts[i + 1]);
+	}
+}
+
+// ZoneDelta
+
+cubewg::ZoneDelta::ZoneDelta() {
+}
+
+cubewg::ZoneDelta::ZoneDelta(std::vector<uint8_t>&& bytes) : bytes(std::move(bytes)) {
+}
+
+cubewg::ZoneDelta cubewg::ZoneDelta::Record(const ZoneSnapshot& before, const cube::Zone* zone, const EditBatch& neighbour_writes) {
+	// The palette is only complete once everything is encoded, but goes first so Apply can read it before what uses it.
+	Palette palette;
+	std::vector<uint8_t> body;
+
+	// changed columns, each as the gap from the last one, base z, and runs of [length, block]
+	std::vector<int> changed;
+
+	for (int i = 0; i < kFieldCount; i++) {
+		if (before.HasChanged(zone->fields[i], i)) {
+			changed.push_back(i);
+		}
+	}
+
+	WriteUnsigned(body, (uint32_t)changed.size());
+	int last_column = -1;
+	std::vector<uint8_t> runs;
+
+	for (int column : changed) {
+		const cube::Field& field = zone->fields[column];
+		WriteUnsigned(body, (uint32_t)(column - last_column));
+		WriteSigned(body, field.base_z);
+		last_column = column;
+
+		runs.clear();
+		uint32_t run_count = 0;
+
+		for (size_t start = 0; start < field.blocks.size();) {
+			size_t end = start + 1;
+
+			while (end < field.blocks.size() && std::memcmp(&field.blocks[end], &field.blocks[start], sizeof(cube::Block)) == 0) {
+				end++;
+			}
+
+			WriteUnsigned(runs, (uint32_t)(end - start));
+			WriteUnsigned(runs, palette.IndexOf(field.blocks[start]));
+			run_count++;
+			start = end;
+		}
+
+		WriteUnsigned(body, run_count);
+		body.insert(body.end(), runs.begin(), runs.end());
+	}
+
+	// writes to neighbours, by zone offset, each run as the gap from the last column, min z, height and block
+	WriteUnsigned(body, (uint32_t)neighbour_writes.GetZoneCount());
+
+	neighbour_writes.ForEachZone([&body, &palette](const IntVector2& zone_offset, const CubeBuffer& blocks) {
+		size_t run_count;
+		blocks.GetRuns(run_count);
+
+		WriteSigned(body, zone_offset.x);
+		WriteSigned(body, zone_offset.y);
+		WriteUnsigned(body, (uint32_t)run_count);
+		int last_column = 0;
+
+		blocks.ForEachRun([&body, &palette, &last_column](int x, int y, int min_z, int max_z, const cube::Block& block) {
+			const int column = x * cube::BLOCKS_PER_ZONE + y;
+			WriteUnsigned(body, (uint32_t)(column - last_column));
+			WriteSigned(body, min_z);
+			WriteUnsigned(body, (uint32_t)(max_z - min_z));
+			WriteUnsigned(body, palette.IndexOf(block));
+			last_column = column;
+		});
+	});
+
+	std::vector<uint8_t> bytes;
+	palette.WriteTo(bytes);
+	bytes.insert(bytes.end(), body.begin(), body.end());
+	bytes.shrink_to_fit();
+	return ZoneDelta(std::move(bytes));
+}
+
+bool cubewg::ZoneDelta::Apply(cube::Zone* zone, EditBatch& neighbour_writes, IntVector2& min, IntVector2& max) const {
+	const uint8_t* in = bytes.data();
+
+	// copied out, as the blocks start wherever the size before them ends, so may not be aligned
+	std::vector<cube::Block> palette(ReadUnsigned(in));
+	std::memcpy(palette.data(), in, palette.size() * sizeof(cube::Block));
+	in += palette.size() * sizeof(cube::Block);
+
+	const uint32_t column_count = ReadUnsigned(in);
+	int column = -1;
+	min = IntVector2(cube::BLOCKS_PER_ZONE, cube::BLOCKS_PER_ZONE);
+	max = IntVector2(-1, -1);
+
+	for (uint32_t i = 0; i < column_count; i++) {
+		column += (int)ReadUnsigned(in);
+		cube::Field& field = zone->fields[column];
+		field.base_z = ReadSigned(in);
+		field.blocks.clear();
+
+		const uint32_t run_count = ReadUnsigned(in);
+
+		for (uint32_t run = 0; run < run_count; run++) {
+			const uint32_t length = ReadUnsigned(in);
+			const cube::Block& block = palette[ReadUnsigned(in)];
+			field.blocks.insert(field.blocks.end(), length, block);
+		}
+
+		const int x = column / cube::BLOCKS_PER_ZONE;
+		const int y = column % cube::BLOCKS_PER_ZONE;
+		min.x = std::min(min.x, x);
+		min.y = std::min(min.y, y);
+		max.x = std::max(max.x, x);
+		max.y = std::max(max.y, y);
+	}
+
+	const uint32_t neighbour_count = ReadUnsigned(in);
+
+	for (uint32_t i = 0; i < neighbour_count; i++) {
+		const long long zone_min_x = (long long)ReadSigned(in) * cube::BLOCKS_PER_ZONE;
+		const long long zone_min_y = (long long)ReadSigned(in) * cube::BLOCKS_PER_ZONE;
+		const uint32_t run_count = ReadUnsigned(in);
+		int column = 0;
+
+		for (uint32_t run = 0; run < run_count; run++) {
+			column += (int)ReadUnsigned(in);
+			const int min_z = ReadSigned(in);
+			const int max_z = min_z + (int)ReadUnsigned(in);
+			const cube::Block& block = palette[ReadUnsigned(in)];
+			neighbour_writes.FillColumn(zone_min_x + column / cube::BLOCKS_PER_ZONE, zone_min_y + column % cube::BLOCKS_PER_ZONE, min_z, max_z, block);
+		}
+	}
+
+	return column_count > 0;
+}
+
+const std::vector<uint8_t>& cubewg::ZoneDelta::GetBytes() const {
+	return bytes;
+}
+
+// ZoneDeltaCache
+
+cubewg::ZoneDeltaCache::ZoneDeltaCache(size_t memory_budget, size_t disk_budget) : memory_budget(memory_budget), disk_budget(disk_budget), memory_bytes(0),
+	file(INVALID_HANDLE_VALUE), disk_end(0), hits(0), disk_hits(0), misses(0), deltas_recorded(0), bytes_recorded(0) {
+}
+
+cubewg::ZoneDeltaCache::~ZoneDeltaCache() {
+	// deletes the file, as it was opened with FILE_FLAG_DELETE_ON_CLOSE
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+	}
+}
+
+bool cubewg::ZoneDeltaCache::Open(const std::wstring& path) {
+	std::lock_guard<std::mutex> lock(mutex);
+	file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+	return file != INVALID_HANDLE_VALUE;
+}
+
+std::shared_ptr<const cubewg::ZoneDelta> cubewg::ZoneDeltaCache::Get(const IntVector2& zone_position, uint64_t world, uint32_t version) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto entry = memory.find(zone_position);
+
+	if (entry != memory.end() && entry->second.world == world && entry->second.version == version) {
+		// most recently used
+		uses.splice(uses.begin(), uses, entry->second.use);
+		hits++;
+		return entry->second.delta;
+	}
+
+	auto on_disk = disk.find(zone_position);
+
+	if (on_disk != disk.end() && on_disk->second.world == world && on_disk->second.version == version) {
+		std::shared_ptr<const ZoneDelta> delta = this->ReadFromDisk(on_disk->second);
+
+		if (delta) {
+			// Back in memory, and still in the file, so it needn't be written again when evicted.
+			if (entry != memory.end()) {
+				memory_bytes -= entry->second.delta->GetBytes().size();
+				uses.erase(entry->second.use);
+				memory.erase(entry);
+			}
+
+			uses.push_front(zone_position);
+			memory[zone_position] = MemoryEntry{ world, version, delta, uses.begin() };
+			memory_bytes += delta->GetBytes().size();
+			this->Evict();
+
+			hits++;
+			disk_hits++;
+			return delta;
+		}
+	}
+
+	misses++;
+	return nullptr;
+}
+
+void cubewg::ZoneDeltaCache::Put(const IntVector2& zone_position, uint64_t world, uint32_t version, ZoneDelta&& delta) {
+	std::shared_ptr<const ZoneDelta> shared = std::make_shared<const ZoneDelta>(std::move(delta));
+	const size_t size = shared->GetBytes().size();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto entry = memory.find(zone_position);
+
+	if (entry != memory.end()) {
+		memory_bytes -= entry->second.delta->GetBytes().size();
+		uses.erase(entry->second.use);
+		memory.erase(entry);
+	}
+
+	// any copy in the file is out of date
+	disk.erase(zone_position);
+
+	uses.push_front(zone_position);
+	memory[zone_position] = MemoryEntry{ world, version, shared, uses.begin() };
+	memory_bytes += size;
+	deltas_recorded++;
+	bytes_recorded += (long long)size;
+
+	this->Evict();
+}
+
+void cubewg::ZoneDeltaCache::Clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	memory.clear();
+	uses.clear();
+	memory_bytes = 0;
+	disk.clear();
+	disk_end = 0;
+}
+
+void cubewg::ZoneDeltaCache::Evict() {
+	// always keeps the most recently used, however large
+	while (memory_bytes > memory_budget && uses.size() > 1) {
+		const IntVector2 zone_position = uses.back();
+		auto entry = memory.find(zone_position);
+		auto on_disk = disk.find(zone_position);
+
+		if (on_disk == disk.end() || on_disk->second.world != entry->second.world || on_disk->second.version != entry->second.version) {
+			this->WriteToDisk(zone_position, entry->second.world, entry->second.version, *entry->second.delta);
+		}
+
+		memory_bytes -= entry->second.delta->GetBytes().size();
+		memory.erase(entry);
+		uses.pop_back();
+	}
+}
+
+bool cubewg::ZoneDeltaCache::WriteToDisk(const IntVector2& zone_position, uint64_t world, uint32_t version, const ZoneDelta& delta) {
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	const std::vector<uint8_t>& bytes = delta.GetBytes();
+
+	if (bytes.size() > disk_budget) return false;
+
+	// full: start again, dropping everything written
+	if (disk_end + bytes.size() > disk_budget) {
+		disk.clear();
+		disk_end = 0;
+	}
+
+	LARGE_INTEGER offset;
+	offset.QuadPart = (LONGLONG)disk_end;
+	DWORD written = 0;
+
+	if (!SetFilePointerEx(file, offset, nullptr, FILE_BEGIN) || !WriteFile(file, bytes.data(), (DWORD)bytes.size(), &written, nullptr) || written != bytes.size()) {
+		disk.erase(zone_position);
+		return false;
+	}
+
+	disk[zone_position] = DiskEntry{ world, version, disk_end, (uint32_t)bytes.size() };
+	disk_end += bytes.size();
+	return true;
+}
+
+std::shared_ptr<const cubewg::ZoneDelta> cubewg::ZoneDeltaCache::ReadFromDisk(const DiskEntry& entry) {
+	std::vector<uint8_t> bytes(entry.size);
+	LARGE_INTEGER offset;
+	offset.QuadPart = (LONGLONG)entry.offset;
+	DWORD read = 0;
+
+	if (!SetFilePointerEx(file, offset, nullptr, FILE_BEGIN) || !ReadFile(file, bytes.data(), entry.size, &read, nullptr) || read != entry.size) {
+		return nullptr;
+	}
+
+	return std::make_shared<const ZoneDelta>(std::move(bytes));
+}
+
+long long cubewg::ZoneDeltaCache::GetHits() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return hits;
+}
+
+long long cubewg::ZoneDeltaCache::GetDiskHits() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return disk_hits;
+}
+
+long long cubewg::ZoneDeltaCache::GetMisses() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return misses;
+}
+
+long long cubewg::ZoneDeltaCache::GetDeltasRecorded() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return deltas_recorded;
+}
+
+long long cubewg::ZoneDeltaCache::GetBytesRecorded() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return bytes_recorded;
+}
+
+size_t cubewg::ZoneDeltaCache::GetMemoryEntries() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return memory.size();
+}
+
+size_t cubewg::ZoneDeltaCache::GetMemoryBytes() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return memory_bytes;
+}
+
+size_t cubewg::ZoneDeltaCache::GetDiskEntries() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return disk.size();
+}
+
+uint64_t cubewg::ZoneDeltaCache::GetDiskBytes() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return disk_end;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cwsdk.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "EditBatch.h"
+#include "MemoryPool.h"
+
+namespace cubewg {
+	/* The fields of a zone as they were before generating in it, to find the columns generation changed.
+	*/
+	class ZoneSnapshot {
+	private:
+		std::vector<int, PoolAllocator<int>> base_zs;
+		// where each field's blocks start in blocks, and where the last ends
+		std::vector<uint32_t, PoolAllocator<uint32_t>> starts;
+		std::vector<cube::Block, PoolAllocator<cube::Block>> blocks;
+	public:
+		/* The snapshot's memory comes from the pool (usually the generating thread's arena), or the heap if it is nullptr.
+		*/
+		explicit ZoneSnapshot(MemoryPool* pool = nullptr);
+
+		void Take(const cube::Zone* zone);
+
+		/* Whether the field (at field_index in the zone taken) differs from when the snapshot was taken, in base z or any block.
+		*/
+		bool HasChanged(const cube::Field& field, int field_index) const;
+
+		/* Sets every field of the zone back to how it was when the snapshot was taken.
+		*/
+		void Restore(cube::Zone* zone) const;
+	};
+
+	/* What generating in a zone did: the columns it changed, whole, and the blocks it wrote to the zone's neighbours.
+	 * Encoded compactly: each distinct block once in a palette, columns as runs of a palette entry, and every number as a variable length integer.
+	 */
+	class ZoneDelta {
+	private:
+		std::vector<uint8_t> bytes;
+	public:
+		ZoneDelta();
+		explicit ZoneDelta(std::vector<uint8_t>&& bytes);
+
+		/* Records the columns of the zone which differ from the snapshot, and the writes to its neighbours, in zone-local positions as a zone region takes them.
+		*/
+		static ZoneDelta Record(const ZoneSnapshot& before, const cube::Zone* zone, const EditBatch& neighbour_writes);
+
+		/* Sets the columns recorded in the zone, replacing what is there, and adds the writes to neighbours to the batch.
+		 * Gets the box of columns set, in x and y. Returns false if there were none.
+		 */
+		bool Apply(cube::Zone* zone, EditBatch& neighbour_writes, IntVector2& min, IntVector2& max) const;
+
+		const std::vector<uint8_t>& GetBytes() const;
+	};
+
+	/* Deltas of generation by zone, so zones which reload are replayed rather than generated again.
+	 * Recently used deltas are kept in memory up to a budget; older ones are written to a file, up to a larger budget, and read back when next needed.
+	 * Deltas are only replayed in the world and for the generator version they were recorded with, so another world's zone at the same position never gets one.
+	 * The file is only for this session, like the buffer journal's. Thread safe.
+	 */
+	class ZoneDeltaCache {
+	private:
+		struct MemoryEntry {
+			uint64_t world;
+			uint32_t version;
+			std::shared_ptr<const ZoneDelta> delta;
+			std::list<IntVector2>::iterator use;
+		};
+
+		struct DiskEntry {
+			uint64_t world;
+			uint32_t version;
+			uint64_t offset;
+			uint32_t size;
+		};
+
+		std::mutex mutex;
+		size_t memory_budget;
+		size_t disk_budget;
+
+		std::unordered_map<IntVector2, MemoryEntry> memory;
+		// zones in memory, most recently used first
+		std::list<IntVector2> uses;
+		size_t memory_bytes;
+
+		HANDLE file;
+		std::unordered_map<IntVector2, DiskEntry> disk;
+		// end of the last delta written. Written deltas are never moved: once the file is full, it is started again.
+		uint64_t disk_end;
+
+		long long hits;
+		long long disk_hits;
+		long long misses;
+		long long deltas_recorded;
+		long long bytes_recorded;
+
+		// Moves the least recently used deltas out to the file until memory is within budget. The mutex must be held.
+		void Evict();
+		bool WriteToDisk(const IntVector2& zone_position, uint64_t world, uint32_t version, const ZoneDelta& delta);
+		std::shared_ptr<const ZoneDelta> ReadFromDisk(const DiskEntry& entry);
+	public:
+		static const size_t kDefaultMemoryBudget = 32 * 1024 * 1024;
+		static const size_t kDefaultDiskBudget = 256 * 1024 * 1024;
+
+		ZoneDeltaCache(size_t memory_budget = kDefaultMemoryBudget, size_t disk_budget = kDefaultDiskBudget);
+		~ZoneDeltaCache();
+
+		ZoneDeltaCache(const ZoneDeltaCache&) = delete;
+		ZoneDeltaCache& operator=(const ZoneDeltaCache&) = delete;
+
+		/* Creates the file for deltas which don't fit in memory at the path, replacing any there. Returns false if it couldn't be created, in which case those deltas are dropped.
+		*/
+		bool Open(const std::wstring& path);
+
+		/* Gets the zone's delta for the world (any number identifying it for the session) and generator version, or nullptr if there isn't one.
+		*/
+		std::shared_ptr<const ZoneDelta> Get(const IntVector2& zone_position, uint64_t world, uint32_t version);
+
+		void Put(const IntVector2& zone_position, uint64_t world, uint32_t version, ZoneDelta&& delta);
+
+		/* Drops every delta, as when the world they were recorded in has been left. The counts are kept, and the file is written over.
+		*/
+		void Clear();
+
+		long long GetHits();
+		long long GetDiskHits();
+		long long GetMisses();
+
+		/* How many deltas have been recorded, and their total size, for the average size of a zone's delta.
+		*/
+		long long GetDeltasRecorded();
+		long long GetBytesRecorded();
+
+		size_t GetMemoryEntries();
+		size_t GetMemoryBytes();
+		size_t GetDiskEntries();
+		uint64_t GetDiskBytes();
+	};
+}
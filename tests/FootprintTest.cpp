@@ -0,0 +1,207 @@
+// Checks footprints' spans cover exactly the columns a per-column test of each shape finds inside it, and that the spans are well formed.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "Footprint.h"
+
+using namespace cubewg;
+
+namespace {
+	const int kShapesPerKind = 300;
+	// Columns this close to a shape's edge may fall either side of it, as the spans are found in floating point.
+	const double kTolerance = 1e-6;
+
+	int failures = 0;
+
+	// Distance from the point to the shape, 0 inside it.
+	typedef std::function<double(double x, double y)> Distance;
+
+	double Length(double x, double y) {
+		return std::sqrt(x * x + y * y);
+	}
+
+	double SegmentDistance(double x, double y, const FootprintPoint& a, const FootprintPoint& b) {
+		const double dx = b.x - a.x;
+		const double dy = b.y - a.y;
+		const double sqr_length = dx * dx + dy * dy;
+		const double t = sqr_length > 0 ? std::min(1.0, std::max(0.0, ((x - a.x) * dx + (y - a.y) * dy) / sqr_length)) : 0;
+		return Length(x - a.x - t * dx, y - a.y - t * dy);
+	}
+
+	/* Rasterises the footprint into a box about the shape, and compares every column of the box against the distance.
+	 * Columns within expand of the shape must be covered. Covered columns must be within spread times expand of it, as convex shapes grow by a square rather than a disc.
+	 */
+	void Check(const char* name, const Footprint& footprint, const Distance& distance, double spread, std::mt19937_64& random) {
+		std::uniform_int_distribution<int> offset(-40, 40);
+		std::uniform_int_distribution<int> size(0, 80);
+		const double expands[] = { 0, 1, 2.5 };
+
+		for (double expand : expands) {
+			const int min_x = offset(random);
+			const int min_y = offset(random);
+			const int max_x = min_x + size(random);
+			const int max_y = min_y + size(random);
+
+			std::vector<FootprintSpan> spans;
+			footprint.Rasterise(min_x, min_y, max_x, max_y, expand, spans);
+
+			const int width = max_x - min_x + 1;
+			const int height = max_y - min_y + 1;
+			std::vector<char> covered((size_t)width * height, 0);
+			bool well_formed = true;
+
+			for (size_t i = 0; i < spans.size(); i++) {
+				const FootprintSpan& span = spans[i];
+
+				// in the box, one x at a time, and never overlapping at the same x
+				if (span.x < min_x || span.x > max_x || span.min_y < min_y || span.max_y > max_y || span.min_y > span.max_y) well_formed = false;
+				if (i > 0 && (span.x < spans[i - 1].x || (span.x == spans[i - 1].x && span.min_y <= spans[i - 1].max_y))) well_formed = false;
+				if (!well_formed) break;
+
+				for (int y = span.min_y; y <= span.max_y; y++) {
+					covered[(size_t)(span.x - min_x) * height + (y - min_y)] = 1;
+				}
+			}
+
+			if (!well_formed) {
+				std::printf("%s, expand %g: spans out of the box, out of order or overlapping\n", name, expand);
+				failures++;
+				continue;
+			}
+
+			for (int x = min_x; x <= max_x; x++) {
+				for (int y = min_y; y <= max_y; y++) {
+					const double d = distance(x, y);
+					const bool is_covered = covered[(size_t)(x - min_x) * height + (y - min_y)] != 0;
+
+					if ((!is_covered && d <= expand - kTolerance) || (is_covered && d > expand * spread + kTolerance)) {
+						if (failures < 20) {
+							std::printf("%s, expand %g: column [%d, %d] at distance %.9g is %s\n", name, expand, x, y, d, is_covered ? "covered" : "missed");
+						}
+
+						failures++;
+					}
+				}
+			}
+		}
+	}
+
+	void CheckCircles(std::mt19937_64& random) {
+		std::uniform_real_distribution<double> centre(-30, 30);
+		std::uniform_real_distribution<double> radius(0, 40);
+
+		for (int i = 0; i < kShapesPerKind; i++) {
+			const double x = centre(random), y = centre(random), r = radius(random);
+
+			Check("Circle", Footprint::Circle(x, y, r), [=](double px, double py) {
+				return std::max(0.0, Length(px - x, py - y) - r);
+			}, 1, random);
+		}
+	}
+
+	void CheckAnnuli(std::mt19937_64& random) {
+		std::uniform_real_distribution<double> centre(-30, 30);
+		std::uniform_real_distribution<double> radius(0, 40);
+
+		for (int i = 0; i < kShapesPerKind; i++) {
+			const double x = centre(random), y = centre(random);
+			double inner = radius(random), outer = radius(random);
+			if (inner > outer) std::swap(inner, outer);
+
+			Check("Annulus", Footprint::Annulus(x, y, inner, outer), [=](double px, double py) {
+				const double d = Length(px - x, py - y);
+				return d < inner ? inner - d : std::max(0.0, d - outer);
+			}, 1, random);
+		}
+	}
+
+	void CheckConvexPolygons(std::mt19937_64& random) {
+		std::uniform_real_distribution<double> centre(-30, 30);
+		std::uniform_real_distribution<double> radius(1, 40);
+		std::uniform_real_distribution<double> angle(0, 6.283185307179586);
+		std::uniform_int_distribution<int> count(3, 8);
+
+		for (int i = 0; i < kShapesPerKind; i++) {
+			// points on an ellipse, in order round it, are convex
+			const double x = centre(random), y = centre(random), rx = radius(random), ry = radius(random), turn = angle(random);
+			std::vector<double> angles(count(random));
+			for (double& a : angles) a = angle(random);
+			std::sort(angles.begin(), angles.end());
+
+			std::vector<FootprintPoint> vertices;
+
+			for (double a : angles) {
+				const double ex = std::cos(a) * rx, ey = std::sin(a) * ry;
+				vertices.push_back(FootprintPoint(x + ex * std::cos(turn) - ey * std::sin(turn), y + ex * std::sin(turn) + ey * std::cos(turn)));
+			}
+
+			if (i % 2) std::reverse(vertices.begin(), vertices.end());
+
+			Check("ConvexPolygon", Footprint::ConvexPolygon(vertices), [=](double px, double py) {
+				bool left = false, right = false;
+				double nearest = INFINITY;
+
+				for (size_t v = 0; v < vertices.size(); v++) {
+					const FootprintPoint& a = vertices[v];
+					const FootprintPoint& b = vertices[(v + 1) % vertices.size()];
+					const double cross = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+					left |= cross > 0;
+					right |= cross < 0;
+					nearest = std::min(nearest, SegmentDistance(px, py, a, b));
+				}
+
+				return left && right ? nearest : 0.0;
+			}, std::sqrt(2.0), random);
+		}
+	}
+
+	void CheckPolylines(std::mt19937_64& random) {
+		std::uniform_real_distribution<double> start(-30, 30);
+		std::uniform_real_distribution<double> step(-25, 25);
+		std::uniform_real_distribution<double> width(0, 6);
+		std::uniform_int_distribution<int> count(1, 5);
+
+		for (int i = 0; i < kShapesPerKind; i++) {
+			std::vector<FootprintPoint> points(1, FootprintPoint(start(random), start(random)));
+			const int n = count(random);
+
+			for (int p = 1; p < n; p++) {
+				points.push_back(FootprintPoint(points.back().x + step(random), points.back().y + step(random)));
+			}
+
+			const double half_width = width(random);
+
+			Check("Polyline", Footprint::Polyline(points, half_width), [=](double px, double py) {
+				double nearest = INFINITY;
+
+				for (size_t p = 0; p < points.size(); p++) {
+					nearest = std::min(nearest, SegmentDistance(px, py, points[p], points[p + 1 < points.size() ? p + 1 : p]));
+				}
+
+				return std::max(0.0, nearest - half_width);
+			}, std::sqrt(2.0), random);
+		}
+	}
+}
+
+int main() {
+	std::mt19937_64 random(12345);
+
+	CheckCircles(random);
+	CheckAnnuli(random);
+	CheckConvexPolygons(random);
+	CheckPolylines(random);
+
+	if (failures > 0) {
+		std::printf("%d columns differ\n", failures);
+		return 1;
+	}
+
+	std::printf("spans match\n");
+	return 0;
+}
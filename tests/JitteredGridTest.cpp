@@ -0,0 +1,111 @@
+// Checks the tile paths of jittered grids give the same results as sampling each position on its own, on every instruction set the CPU supports.
+// Needs nothing from the game, so runs on any machine: see CUBEWG_BUILD_TESTS.
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <ratio>
+#include <vector>
+
+#include "JitteredGrid.h"
+#include "Kernels.h"
+
+using namespace cubewg;
+
+namespace {
+	const int kTilesPerGrid = 40;
+	const int kMaxTileSize = 70;
+
+	int failures = 0;
+
+	// Bit for bit, as the tile paths promise.
+	bool Same(double a, double b) {
+		return std::memcmp(&a, &b, sizeof(double)) == 0;
+	}
+
+	template <typename Grid>
+	void CheckGrid(const char* name, Grid grid, std::mt19937_64& random) {
+		std::uniform_real_distribution<double> origin(-1e6, 1e6);
+		std::uniform_int_distribution<int> size(1, kMaxTileSize);
+		std::vector<double> tile(kMaxTileSize * kMaxTileSize);
+
+		for (int i = 0; i < kTilesPerGrid; i++) {
+			// whole origins, as generation uses, and fractional ones
+			double origin_x = origin(random);
+			double origin_y = origin(random);
+
+			if (i % 2 == 0) {
+				origin_x = (double)(int64_t)origin_x;
+				origin_y = (double)(int64_t)origin_y;
+			}
+
+			const int width = size(random);
+			const int height = size(random);
+
+			for (int worley = 0; worley <= 1; worley++) {
+				if (worley) {
+					grid.Worley2Tile(origin_x, origin_y, width, height, tile.data());
+				} else {
+					grid.SqrDist2NearestTile(origin_x, origin_y, width, height, tile.data());
+				}
+
+				for (int x = 0; x < width; x++) {
+					for (int y = 0; y < height; y++) {
+						const double expected = worley ? grid.Worley2(origin_x + x, origin_y + y) : grid.SqrDist2Nearest(origin_x + x, origin_y + y);
+						const double actual = tile[x * height + y];
+
+						if (!Same(expected, actual)) {
+							if (failures < 20) {
+								std::printf("%s %s: tile at [%.17g, %.17g] (%d x %d) differs at [%d, %d]: %.17g, expected %.17g\n",
+									name, worley ? "Worley2Tile" : "SqrDist2NearestTile", origin_x, origin_y, width, height, x, y, actual, expected);
+							}
+
+							failures++;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void CheckGrids(std::mt19937_64& random) {
+		const double relaxations[] = { 0, 0.2, 0.5 };
+		const double scales[] = { 1, 7.5, 64 };
+		const GridHash hashes[] = { GridHash::LEGACY, GridHash::COUNTER };
+
+		for (double relaxation : relaxations) {
+			for (double scale : scales) {
+				for (GridHash hash : hashes) {
+					JitteredGrid grid((int64_t)random(), relaxation, scale, hash);
+					CheckGrid("JitteredGrid", grid, random);
+
+					// through the point cache, as cities use it
+					grid.EnableCache(64);
+					CheckGrid("cached JitteredGrid", grid, random);
+				}
+			}
+		}
+
+		CheckGrid("compile time grid", BasicJitteredGrid<double, std::ratio<1, 5>, std::ratio<256>, kLegacySearchRadius>((int64_t)random()), random);
+		CheckGrid("derived search grid", BasicJitteredGrid<double, std::ratio<1, 2>, std::ratio<16>>((int64_t)random(), GridHash::COUNTER), random);
+	}
+}
+
+int main() {
+	InitKernels();
+
+	for (int isa = 0; isa < kKernelIsaCount; isa++) {
+		if (!ForceKernels((KernelIsa)isa)) {
+			std::printf("%ls: unsupported, skipped\n", GetKernelIsaName((KernelIsa)isa));
+			continue;
+		}
+
+		// the same inputs on every instruction set
+		std::mt19937_64 random(12345);
+		const int before = failures;
+		CheckGrids(random);
+		std::printf("%ls: %s\n", GetKernelIsaName((KernelIsa)isa), failures == before ? "tiles match" : "tiles differ");
+	}
+
+	return failures == 0 ? 0 : 1;
+}